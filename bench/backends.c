@@ -0,0 +1,134 @@
+// Compares the stack (with and without superinstructions) and register
+// backends on a generated, arithmetic-heavy program, reporting the size of the
+// bytecode each produces and how long it takes to run. The program is
+// straight-line `let`s, `if`s and arithmetic, since the register backend
+// doesn't support functions, calls or lists, so this says nothing about how
+// the backends compare on those.
+//
+// Build with the 'benchmarks' meson option.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "src/chunk.h"
+#include "src/compiler.h"
+#include "src/parser.h"
+#include "src/peephole.h"
+#include "src/register_compiler.h"
+#include "src/symbol.h"
+#include "src/vm.h"
+
+constexpr size_t BINDINGS = 2000;
+constexpr size_t RUNS = 2000;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Generates a chain of `let` bindings which each branch on and do arithmetic
+// with the previous binding
+static StringBuf generate_program(void) {
+    StringBuf source = StringBuf_new();
+    char line[160];
+    StringBuf_push_string(&source, STR("let x0 = 1"));
+    for (size_t i = 1; i < BINDINGS; i++) {
+        int length = snprintf(
+            line, sizeof(line),
+            ",\n    x%zu = if x%zu < 100000 then x%zu * 3 + %zu else x%zu / 2 "
+            "- %zu",
+            i, i - 1, i - 1, i, i - 1, i);
+        StringBuf_push_string(&source,
+                              (String){.buffer = line, .length = length});
+    }
+    int length = snprintf(line, sizeof(line), "\nin x%zu\n", BINDINGS - 1);
+    StringBuf_push_string(&source, (String){.buffer = line, .length = length});
+    StringBuf_push(&source, '\0');
+    return source;
+}
+
+// Counts the instructions in 'chunk', given a function which returns the
+// number of operands each opcode takes
+static size_t count_instructions(Chunk *chunk,
+                                 size_t (*operand_count)(uint16_t op)) {
+    size_t count = 0;
+    for (size_t offset = 0; offset < chunk->code.length; count++)
+        offset += 1 + operand_count(chunk->code.buffer[offset]);
+    return count;
+}
+
+static size_t stack_operand_count(uint16_t op) {
+    return OpCode_operand_count((OpCode)op);
+}
+
+static size_t register_operand_count(uint16_t op) {
+    return RegOpCode_operand_count((RegOpCode)op);
+}
+
+static void run_backend(const char *name, Chunk *chunk,
+                        RunResult (*run)(VM *, Chunk *),
+                        size_t (*operand_count)(uint16_t op), Heap *heap) {
+    VM vm = VM_new(heap);
+    RunResult result = run(&vm, chunk);
+    if (result.tag == RESULT_ERR) {
+        RuntimeError_print(result.value.err, stderr);
+        exit(1);
+    }
+
+    double start = now_seconds();
+    for (size_t i = 0; i < RUNS; i++)
+        run(&vm, chunk);
+    double elapsed = now_seconds() - start;
+
+    printf("%-8s  %12zu  %12zu  %9zu  %10.2f  ", name,
+           count_instructions(chunk, operand_count), chunk->code.length,
+           chunk->max_stack, elapsed * 1e6 / (double)RUNS);
+    Value_write(result.value.ok, stdout);
+    putchar('\n');
+    VM_free(&vm);
+}
+
+int main(void) {
+    StringBuf source = generate_program();
+    // The trailing NUL is the lexer's sentinel rather than part of the source
+    Parser parser = Parser_new(
+        STR("bench"),
+        (String){.buffer = source.buffer, .length = source.length - 1});
+    ParseResult parsed = Parser_parse_expr(&parser);
+    if (parsed.tag == RESULT_ERR) {
+        Parser_print_diag(&parser, parsed.value.err, stderr);
+        return 1;
+    }
+
+    Heap heap = Heap_new();
+    CompileResult stack = compile(&parser.ast, parsed.value.ok, &heap);
+    CompileResult fused = compile(&parser.ast, parsed.value.ok, &heap);
+    CompileResult registers =
+        compile_registers(&parser.ast, parsed.value.ok, &heap);
+    if (stack.tag == RESULT_ERR || fused.tag == RESULT_ERR ||
+        registers.tag == RESULT_ERR) {
+        fputs("Failed to compile the benchmark program\n", stderr);
+        return 1;
+    }
+    peephole_optimise(&fused.value.ok, NULL);
+
+    printf("dispatch mode: %s, value repr: %s, %zu bindings, %zu runs\n\n",
+           VM_DISPATCH_MODE, VALUE_REPR, BINDINGS, RUNS);
+    printf("%-8s  %12s  %12s  %9s  %10s  %s\n", "backend", "instructions",
+           "code words", "slots", "us/run", "result");
+    run_backend("stack", &stack.value.ok, VM_run, stack_operand_count, &heap);
+    run_backend("fused", &fused.value.ok, VM_run, stack_operand_count, &heap);
+    run_backend("register", &registers.value.ok, VM_run_registers,
+                register_operand_count, &heap);
+
+    Chunk_free(&stack.value.ok);
+    Chunk_free(&fused.value.ok);
+    Chunk_free(&registers.value.ok);
+    Heap_free(&heap);
+    Parser_free(&parser);
+    Symbol_free_all();
+    StringBuf_free(&source);
+    return 0;
+}
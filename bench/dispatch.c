@@ -0,0 +1,88 @@
+// Measures raw instruction dispatch throughput of `VM_run` by executing a long
+// straight-line chunk of cheap arithmetic instructions many times over.
+//
+// Build with the 'benchmarks' meson option, which produces one executable per
+// dispatch mode so the two can be compared side by side.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "src/chunk.h"
+#include "src/vm.h"
+
+constexpr size_t BLOCKS = 1024;
+constexpr size_t RUNS = 20000;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void emit_const(Chunk *chunk, uint16_t index) {
+    Chunk_write(chunk, VM_OP_LOAD_CONST);
+    Chunk_write(chunk, index);
+}
+
+// Builds `BLOCKS` copies of `not ((a + b) * b - a < a)` with each result
+// discarded, which mixes loads, arithmetic and comparisons without growing the
+// stack. Returns the number of instructions dispatched per run.
+static size_t build_chunk(Chunk *chunk) {
+    uint16_t a = (uint16_t)Chunk_add_constant(chunk, Value_int(3));
+    uint16_t b = (uint16_t)Chunk_add_constant(chunk, Value_int(7));
+
+    size_t dispatches = 0;
+    for (size_t i = 0; i < BLOCKS; i++) {
+        emit_const(chunk, a);
+        emit_const(chunk, b);
+        Chunk_write(chunk, VM_OP_ADD);
+        emit_const(chunk, b);
+        Chunk_write(chunk, VM_OP_MUL);
+        emit_const(chunk, a);
+        Chunk_write(chunk, VM_OP_SUB);
+        emit_const(chunk, a);
+        Chunk_write(chunk, VM_OP_LT);
+        Chunk_write(chunk, VM_OP_NOT);
+        Chunk_write(chunk, VM_OP_POP);
+        dispatches += 11;
+    }
+    emit_const(chunk, a);
+    Chunk_write(chunk, VM_OP_RETURN);
+    chunk->max_stack = 2;
+    return dispatches + 2;
+}
+
+int main(void) {
+    Chunk chunk = Chunk_new();
+    size_t dispatches = build_chunk(&chunk);
+    Heap heap = Heap_new();
+    VM vm = VM_new(&heap);
+
+    // Warm up the caches and branch predictors before timing anything
+    for (size_t i = 0; i < RUNS / 10; i++)
+        VM_run(&vm, &chunk);
+
+    double start = now_seconds();
+    for (size_t i = 0; i < RUNS; i++) {
+        RunResult result = VM_run(&vm, &chunk);
+        if (result.tag == RESULT_ERR) {
+            RuntimeError_print(result.value.err, stderr);
+            return 1;
+        }
+    }
+    double elapsed = now_seconds() - start;
+
+    double total = (double)dispatches * (double)RUNS;
+    printf("dispatch mode:   %s\n", VM_DISPATCH_MODE);
+    printf("value repr:      %s (%zu bytes)\n", VALUE_REPR, sizeof(Value));
+    printf("dispatches:      %.0f\n", total);
+    printf("elapsed:         %.3f s\n", elapsed);
+    printf("dispatches/sec:  %.1f M\n", total / elapsed / 1e6);
+    printf("ns/dispatch:     %.3f\n", elapsed * 1e9 / total);
+
+    VM_free(&vm);
+    Heap_free(&heap);
+    Chunk_free(&chunk);
+    return 0;
+}
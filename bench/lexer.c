@@ -0,0 +1,125 @@
+// Measures how fast "src/lexer.c" turns sources into tokens, in megabytes and
+// tokens per second. Two sources are generated: one made of short tokens, like
+// typical code, and one where most of the bytes are in long runs of
+// indentation, comments and string literals. Any files passed on the command
+// line are measured as well.
+//
+// Build with the 'benchmarks' meson option.
+
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/lexer.h"
+
+// Roughly how big each generated source is
+constexpr size_t SOURCE_SIZE = 1 << 22;
+// Each source is tokenized this many times and the fastest run is reported,
+// which keeps page faults and other noise out of the numbers
+constexpr size_t RUNS = 10;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static void push_line(StringBuf *source, const char *line) {
+    StringBuf_push_string(source,
+                          (String){.buffer = line, .length = strlen(line)});
+}
+
+// Bindings with arithmetic, comparisons, calls and keywords, where tokens are
+// rarely more than a few characters long
+static StringBuf generate_code(void) {
+    StringBuf source = StringBuf_new();
+    char line[160];
+    push_line(&source, "let x0 = 1");
+    for (size_t i = 1; source.length < SOURCE_SIZE; i++) {
+        snprintf(line, sizeof(line),
+                 ",\nx%zu = if x%zu <= %zu and not (x%zu == 0) then f(x%zu, "
+                 "%zu.5) else [x%zu, x%zu %% 7] |> g",
+                 i, i - 1, i * 31, i - 1, i - 1, i, i - 1, i - 1);
+        push_line(&source, line);
+    }
+    push_line(&source, "\nin unit\n");
+    StringBuf_push(&source, '\0');
+    return source;
+}
+
+// Deeply indented bindings to long strings, each under a long comment
+static StringBuf generate_text(void) {
+    StringBuf source = StringBuf_new();
+    char line[256];
+    push_line(&source, "let s0 = \"\"");
+    for (size_t i = 1; source.length < SOURCE_SIZE; i++) {
+        snprintf(line, sizeof(line),
+                 ",\n                # binding number %zu holds a string "
+                 "which is long enough to span several blocks\n"
+                 "                s%zu = \"the quick brown fox jumps over "
+                 "the lazy dog, \\\"escaped\\\" %zu\"",
+                 i, i, i);
+        push_line(&source, line);
+    }
+    push_line(&source, "\nin unit\n");
+    StringBuf_push(&source, '\0');
+    return source;
+}
+
+static StringBuf read_source(const char *path) {
+    StringBuf source = StringBuf_new();
+    FILE *file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "Could not access file %s\n", path);
+        exit(1);
+    }
+    int c;
+    while ((c = fgetc(file)) != EOF)
+        StringBuf_push(&source, (char)c);
+    fclose(file);
+    StringBuf_push(&source, '\0');
+    return source;
+}
+
+static void measure(const char *name, StringBuf source) {
+    // The trailing NUL is the lexer's sentinel rather than part of the source
+    String string = {.buffer = source.buffer, .length = source.length - 1};
+    double best = INFINITY;
+    size_t tokens = 0;
+    for (size_t run = 0; run < RUNS; run++) {
+        double start = now_seconds();
+        TokenVec vec = Lexer_tokenize(string);
+        double elapsed = now_seconds() - start;
+        if (elapsed < best)
+            best = elapsed;
+        tokens = vec.length;
+        TokenVec_free(&vec);
+    }
+
+    printf("%-16s  %10zu  %10zu  %8.1f  %8.1f\n", name, string.length, tokens,
+           (double)string.length / best / 1e6, (double)tokens / best / 1e6);
+}
+
+int main(int argc, char **argv) {
+    printf("best of %zu runs\n\n", RUNS);
+    printf("%-16s  %10s  %10s  %8s  %8s\n", "source", "bytes", "tokens",
+           "MB/s", "Mtok/s");
+
+    StringBuf code = generate_code();
+    measure("code", code);
+    StringBuf_free(&code);
+
+    StringBuf text = generate_text();
+    measure("text", text);
+    StringBuf_free(&text);
+
+    for (int i = 1; i < argc; i++) {
+        StringBuf file = read_source(argv[i]);
+        measure(argv[i], file);
+        StringBuf_free(&file);
+    }
+    return 0;
+}
@@ -0,0 +1,181 @@
+#ifndef CLAM_BENCH_LINEAR_TABLE_H
+#define CLAM_BENCH_LINEAR_TABLE_H
+
+// The hash table that "src/hashtable.h" used to provide, kept around as the
+// baseline for bench/tables.c: linear probing with `% capacity`, tombstones
+// encoded in the key's length, FNV-1a hashes recomputed on every probe and
+// keys compared by address (so they have to be interned).
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "src/memory.h"
+#include "src/string.h"
+
+constexpr double LINEAR_TABLE_MAX_LOAD_FACTOR = 0.75;
+
+#define LINEAR_CREATE_ENTRY(T, Name)                                           \
+    typedef struct Name##LinearTable_Entry {                                   \
+        String key;                                                            \
+        T value;                                                               \
+    } Name##LinearTable_Entry;
+
+#define LINEAR_CREATE_TABLE(T, Name)                                           \
+    typedef struct Name##LinearTable {                                         \
+        size_t count;                                                          \
+        size_t capacity;                                                       \
+        Name##LinearTable_Entry *entries;                                      \
+    } Name##LinearTable;
+
+#define LINEAR_TABLE_NEW(T, Name)                                              \
+    Name##LinearTable Name##LinearTable_new(void) {                            \
+        return (Name##LinearTable){                                            \
+            .count = 0,                                                        \
+            .capacity = 0,                                                     \
+            .entries = NULL,                                                   \
+        };                                                                     \
+    }
+
+#define LINEAR_TABLE_FREE(T, Name)                                             \
+    void Name##LinearTable_free(Name##LinearTable *table) {                    \
+        reallocate(table->entries,                                             \
+                   sizeof(Name##LinearTable_Entry) * table->capacity, 0);      \
+        *table = Name##LinearTable_new();                                      \
+    }
+
+static uint32_t fnv_1a_hash(String string) {
+    uint32_t hash = 2166136261u;
+    for (uint32_t i = 0; i < string.length; i++) {
+        hash ^= (uint8_t)string.buffer[i];
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// Pre-conditions:
+//
+// * `key` is an interned string
+//
+#define LINEAR_TABLE_ENTRY_FIND(T, Name)                                       \
+    static Name##LinearTable_Entry *Name##LinearTable_Entry_find(              \
+        Name##LinearTable_Entry *entries, size_t capacity, String key) {       \
+        uint32_t index = fnv_1a_hash(key) % capacity;                          \
+        Name##LinearTable_Entry *tombstone = NULL;                             \
+        while (true) {                                                         \
+            Name##LinearTable_Entry *entry = &entries[index];                  \
+            if (entry->key.buffer == NULL) {                                   \
+                if (entry->key.length == 0) {                                  \
+                    return tombstone != NULL ? tombstone : entry;              \
+                } else {                                                       \
+                    if (tombstone == NULL)                                     \
+                        tombstone = entry;                                     \
+                }                                                              \
+            } else if (entry->key.buffer == key.buffer) {                      \
+                return entry;                                                  \
+            }                                                                  \
+                                                                               \
+            index = (index + 1) % capacity;                                    \
+        }                                                                      \
+    }
+
+// Resizes a table by simply allocating a new array of entries and copying over
+// the old ones.
+#define LINEAR_TABLE_ADJUST_CAPACITY(T, Name)                                  \
+    static void Name##LinearTable_adjust_capacity(Name##LinearTable *table,    \
+                                                  size_t capacity) {           \
+        Name##LinearTable_Entry *entries =                                     \
+            reallocate(NULL, 0, sizeof(Name##LinearTable_Entry) * capacity);   \
+        for (size_t i = 0; i < capacity; i++) {                                \
+            entries[i].key = (String){.buffer = NULL, .length = 0};            \
+        }                                                                      \
+        table->count = 0;                                                      \
+        for (size_t i = 0; i < table->capacity; i++) {                         \
+            Name##LinearTable_Entry *entry = &table->entries[i];               \
+            if (entry->key.buffer != NULL) {                                   \
+                Name##LinearTable_Entry *dest =                                \
+                    Name##LinearTable_Entry_find(entries, capacity,            \
+                                                 entry->key);                  \
+                                                                               \
+                dest->key = entry->key;                                        \
+                dest->value = entry->value;                                    \
+                table->count++;                                                \
+            }                                                                  \
+        }                                                                      \
+        reallocate(table->entries,                                             \
+                   sizeof(Name##LinearTable_Entry) * table->capacity, 0);      \
+        table->entries = entries;                                              \
+        table->capacity = capacity;                                            \
+    }
+
+// Sets the value corresponding to `key` to `value`, overwriting an existing
+// value or creating a new entry. This function will return true if a new entry
+// was created.
+#define LINEAR_TABLE_SET(T, Name)                                              \
+    bool Name##LinearTable_set(Name##LinearTable *table, String key,           \
+                               T value) {                                      \
+        if (table->count + 1 >                                                 \
+            table->capacity * LINEAR_TABLE_MAX_LOAD_FACTOR) {                  \
+            size_t capacity = grow_allocation(table->capacity);                \
+            Name##LinearTable_adjust_capacity(table, capacity);                \
+        }                                                                      \
+        Name##LinearTable_Entry *entry =                                       \
+            Name##LinearTable_Entry_find(table->entries, table->capacity,      \
+                                         key);                                 \
+        bool key_is_new = entry->key.buffer == NULL;                           \
+        if (key_is_new && entry->key.length == 0)                              \
+            table->count++;                                                    \
+                                                                               \
+        entry->key = key;                                                      \
+        entry->value = value;                                                  \
+        return key_is_new;                                                     \
+    }
+
+// Attempts to find the entry identified by `key`, returning `false` if not
+// found, else, returning `true` and writing the corresponding value to `value`.
+#define LINEAR_TABLE_GET(T, Name)                                              \
+    bool Name##LinearTable_get(Name##LinearTable *table, String key,           \
+                               /* out */ T *value) {                           \
+        if (table->count == 0)                                                 \
+            return false;                                                      \
+                                                                               \
+        Name##LinearTable_Entry *entry =                                       \
+            Name##LinearTable_Entry_find(table->entries, table->capacity,      \
+                                         key);                                 \
+        if (entry->key.buffer != NULL) {                                       \
+            *value = entry->value;                                             \
+            return true;                                                       \
+        } else                                                                 \
+            return false;                                                      \
+    }
+
+// Attempts to delete an entry, replacing it with a tombstone entry. Returns
+// `false` if the entry does not exist, and `true` if it was deleted.
+#define LINEAR_TABLE_DELETE(T, Name)                                           \
+    bool Name##LinearTable_delete(Name##LinearTable *table, String key) {      \
+        if (table->count == 0)                                                 \
+            return false;                                                      \
+                                                                               \
+        Name##LinearTable_Entry *entry =                                       \
+            Name##LinearTable_Entry_find(table->entries, table->capacity,      \
+                                         key);                                 \
+        if (entry->key.buffer != NULL) {                                       \
+            entry->key = (String){.buffer = NULL, .length = 1};                \
+            return true;                                                       \
+        } else                                                                 \
+            return false;                                                      \
+    }
+
+#define DEF_LINEAR_TABLE(T, Name)                                              \
+    LINEAR_CREATE_ENTRY(T, Name)                                               \
+    LINEAR_CREATE_TABLE(T, Name)                                               \
+    LINEAR_TABLE_NEW(T, Name)                                                  \
+    LINEAR_TABLE_FREE(T, Name)                                                 \
+    LINEAR_TABLE_ENTRY_FIND(T, Name)                                           \
+    LINEAR_TABLE_ADJUST_CAPACITY(T, Name)                                      \
+    LINEAR_TABLE_SET(T, Name)                                                  \
+    LINEAR_TABLE_GET(T, Name)                                                  \
+    LINEAR_TABLE_DELETE(T, Name)
+
+#endif
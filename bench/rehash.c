@@ -0,0 +1,95 @@
+// Measures the latency of individual table operations while a table grows
+// from empty to a few million slots, reporting percentiles rather than an
+// average, since the cost of a resize only shows up in the tail.
+//
+// Build with the 'benchmarks' meson option, which produces one executable per
+// resize mode so the two can be compared side by side.
+
+#include <inttypes.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "src/hashtable.h"
+
+constexpr size_t KEYS = 1 << 21;
+
+DECL_TABLE(size_t, Index)
+DEF_TABLE(size_t, Index)
+
+// Individual operations are far too short to time with a double's worth of
+// seconds since the epoch, so this counts whole nanoseconds instead
+static uint64_t now_nanoseconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (uint64_t)ts.tv_sec * 1000000000 + (uint64_t)ts.tv_nsec;
+}
+
+static int compare_latencies(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return (x > y) - (x < y);
+}
+
+// Sorts 'latencies' and prints their percentiles
+static void report(const char *name, uint64_t *latencies, size_t count) {
+    static const double PERCENTILES[] = {50, 90, 99, 99.9, 99.99};
+    qsort(latencies, count, sizeof(uint64_t), compare_latencies);
+
+    uint64_t total = 0;
+    for (size_t i = 0; i < count; i++)
+        total += latencies[i];
+    printf("%-6s  %8.0f", name, (double)total / (double)count);
+    for (size_t i = 0; i < sizeof(PERCENTILES) / sizeof(PERCENTILES[0]); i++) {
+        size_t rank = (size_t)((double)count * PERCENTILES[i] / 100);
+        printf("  %8" PRIu64, latencies[rank < count ? rank : count - 1]);
+    }
+    printf("  %10" PRIu64 "\n", latencies[count - 1]);
+}
+
+int main(void) {
+    // The strings are all formatted up front so that only the table is timed
+    constexpr size_t KEY_MAX = 16;
+    char *storage = malloc(KEYS * KEY_MAX);
+    String *keys = malloc(KEYS * sizeof(String));
+    for (size_t i = 0; i < KEYS; i++) {
+        char *buffer = storage + i * KEY_MAX;
+        int length = snprintf(buffer, KEY_MAX, "key%zu", i);
+        keys[i] = (String){.buffer = buffer, .length = length};
+    }
+
+    // Every insert is followed by a lookup of an earlier key, so both are
+    // measured while resizes are under way
+    uint64_t *inserts = malloc(KEYS * sizeof(uint64_t));
+    uint64_t *lookups = malloc(KEYS * sizeof(uint64_t));
+    IndexTable table = IndexTable_new();
+    size_t checksum = 0;
+    uint64_t state = 0x2545f4914f6cdd1d;
+    for (size_t i = 0; i < KEYS; i++) {
+        uint64_t start = now_nanoseconds();
+        IndexTable_set(&table, keys[i], i);
+        uint64_t middle = now_nanoseconds();
+        size_t value;
+        state = state * 6364136223846793005 + 1442695040888963407;
+        if (IndexTable_get(&table, keys[(state >> 33) % (i + 1)], &value))
+            checksum += value;
+        uint64_t end = now_nanoseconds();
+
+        inserts[i] = middle - start;
+        lookups[i] = end - middle;
+    }
+
+    printf("resize mode: %s, %zu keys, final capacity %zu, checksum %zu\n\n",
+           TABLE_RESIZE_MODE, KEYS, table.capacity, checksum);
+    printf("%-6s  %8s  %8s  %8s  %8s  %8s  %8s  %10s\n", "ns", "mean", "p50",
+           "p90", "p99", "p99.9", "p99.99", "max");
+    report("insert", inserts, KEYS);
+    report("lookup", lookups, KEYS);
+
+    IndexTable_free(&table);
+    free(inserts);
+    free(lookups);
+    free(keys);
+    free(storage);
+    return 0;
+}
@@ -0,0 +1,121 @@
+// Compares parsing a generated program from scratch with reparsing it after a
+// one character edit in the middle, which an incremental parser keeps toggling
+// on and off, and checks that both give the same AST.
+//
+// Build with the 'benchmarks' meson option.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "src/parser.h"
+#include "src/symbol.h"
+
+constexpr size_t BINDINGS = 20000;
+constexpr size_t RUNS = 200;
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Generates a chain of `let` bindings which each branch on and do arithmetic
+// with the previous binding, storing where the multiplier of the middle one is
+// in 'edit_at'
+static StringBuf generate_program(size_t *edit_at) {
+    StringBuf source = StringBuf_new();
+    char line[160];
+    StringBuf_push_string(&source, STR("let x0 = 1"));
+    for (size_t i = 1; i < BINDINGS; i++) {
+        int length = snprintf(
+            line, sizeof(line),
+            ",\n    x%zu = if x%zu < 100000 then x%zu * 3 + %zu else x%zu / 2 "
+            "- %zu",
+            i, i - 1, i - 1, i, i - 1, i);
+        if (i == BINDINGS / 2)
+            *edit_at = source.length + (size_t)(strstr(line, "* 3") - line) + 2;
+        StringBuf_push_string(&source,
+                              (String){.buffer = line, .length = length});
+    }
+    int length = snprintf(line, sizeof(line), "\nin x%zu\n", BINDINGS - 1);
+    StringBuf_push_string(&source, (String){.buffer = line, .length = length});
+    StringBuf_push(&source, '\0');
+    return source;
+}
+
+// The trailing NUL is the lexer's sentinel rather than part of the source
+static String without_sentinel(StringBuf source) {
+    return (String){.buffer = source.buffer, .length = source.length - 1};
+}
+
+static ASTIndex expect_ok(Parser *parser, ParseResult result) {
+    if (result.tag == RESULT_ERR) {
+        Parser_print_diag(parser, result.value.err, stderr);
+        exit(1);
+    }
+    return result.value.ok;
+}
+
+int main(void) {
+    size_t edit_at = 0;
+    StringBuf original = generate_program(&edit_at);
+    // The same program with the middle multiplier changed from 3 to 33
+    StringBuf edited = StringBuf_new();
+    StringBuf_extend(&edited, original.buffer, edit_at + 1);
+    StringBuf_extend(&edited, original.buffer + edit_at,
+                     original.length - edit_at);
+    TextEdit insert = {
+        .start = edit_at, .old_end = edit_at, .new_end = edit_at + 1};
+    TextEdit remove = {
+        .start = edit_at, .old_end = edit_at + 1, .new_end = edit_at};
+
+    double start = now_seconds();
+    for (size_t i = 0; i < RUNS; i++) {
+        Parser parser = Parser_new(STR("bench"), without_sentinel(edited));
+        expect_ok(&parser, Parser_parse_expr(&parser));
+        Parser_free(&parser);
+    }
+    double full = (now_seconds() - start) / (double)RUNS;
+
+    Parser parser = Parser_new_incremental(STR("bench"),
+                                           without_sentinel(original));
+    expect_ok(&parser, Parser_parse_expr(&parser));
+    start = now_seconds();
+    for (size_t i = 0; i < RUNS; i++) {
+        expect_ok(&parser,
+                  Parser_reparse(&parser, without_sentinel(edited), insert));
+        expect_ok(&parser,
+                  Parser_reparse(&parser, without_sentinel(original), remove));
+    }
+    double reparse = (now_seconds() - start) / (double)(2 * RUNS);
+
+    ASTIndex root = expect_ok(
+        &parser, Parser_reparse(&parser, without_sentinel(edited), insert));
+    Parser fresh = Parser_new(STR("bench"), without_sentinel(edited));
+    ASTIndex fresh_root = expect_ok(&fresh, Parser_parse_expr(&fresh));
+    StringBuf reparsed_ast = format_ast(&parser.ast, root);
+    StringBuf fresh_ast = format_ast(&fresh.ast, fresh_root);
+    if (reparsed_ast.length != fresh_ast.length ||
+        memcmp(reparsed_ast.buffer, fresh_ast.buffer, fresh_ast.length) != 0) {
+        fputs("The reparsed AST differs from the one parsed from scratch\n",
+              stderr);
+        return 1;
+    }
+
+    printf("%zu bindings, %zu bytes, %zu tokens, %zu runs\n\n", BINDINGS,
+           edited.length - 1, fresh.tokens.length, RUNS);
+    printf("%-8s  %10s\n", "parse", "us/run");
+    printf("%-8s  %10.2f\n", "full", full * 1e6);
+    printf("%-8s  %10.2f\n", "reparse", reparse * 1e6);
+
+    StringBuf_free(&reparsed_ast);
+    StringBuf_free(&fresh_ast);
+    Parser_free(&fresh);
+    Parser_free(&parser);
+    StringBuf_free(&edited);
+    StringBuf_free(&original);
+    Symbol_free_all();
+    return 0;
+}
@@ -0,0 +1,161 @@
+// Compares the Swiss table in "src/hashtable.h" against the linear-probing
+// table it replaced, on inserts, successful and failed lookups, and a
+// delete-heavy workload which keeps a sliding window of keys alive.
+//
+// Build with the 'benchmarks' meson option.
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "bench/linear_table.h"
+#include "src/hashtable.h"
+
+// The table sizes to measure, from ones that fit in cache to one that doesn't
+static const size_t SIZES[] = {1 << 8, 1 << 12, 1 << 16, 1 << 20};
+// Every workload does this many operations, however big the table is
+constexpr size_t OPERATIONS = 1 << 22;
+// How many keys the delete-heavy workload keeps alive at once, as a fraction
+// of the table size
+constexpr size_t WINDOW_DIVISOR = 4;
+
+DECL_TABLE(size_t, Index)
+DEF_TABLE(size_t, Index)
+DEF_LINEAR_TABLE(size_t, Index)
+
+static double now_seconds(void) {
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+// Formats 'count' keys of the form "<prefix><n>" into one buffer. The strings
+// are never moved, since the linear table compares keys by address.
+static String *generate_keys(const char *prefix, size_t count,
+                             /* out */ char **storage) {
+    constexpr size_t KEY_MAX = 32;
+    *storage = malloc(count * KEY_MAX);
+    String *keys = malloc(count * sizeof(String));
+    for (size_t i = 0; i < count; i++) {
+        char *buffer = *storage + i * KEY_MAX;
+        int length = snprintf(buffer, KEY_MAX, "%s%zu", prefix, i);
+        keys[i] = (String){.buffer = buffer, .length = length};
+    }
+    return keys;
+}
+
+// Shuffles 'keys' in place with a fixed seed, so that lookups don't visit the
+// keys in the order they were inserted, which flatters the linear table since
+// FNV-1a maps consecutive keys to predictable slots
+static void shuffle_keys(String *keys, size_t count) {
+    uint64_t state = 0x2545f4914f6cdd1d;
+    for (size_t i = count - 1; i > 0; i--) {
+        state ^= state << 13;
+        state ^= state >> 7;
+        state ^= state << 17;
+        size_t j = state % (i + 1);
+        String key = keys[i];
+        keys[i] = keys[j];
+        keys[j] = key;
+    }
+}
+
+typedef struct Timings {
+    double insert;
+    double hit;
+    double miss;
+    double churn;
+    // Folded into the output so that the lookups can't be optimised away
+    size_t checksum;
+} Timings;
+
+// Both tables have the same interface apart from their names, so the
+// workloads are stamped out once for each
+#define DEF_WORKLOADS(Table)                                                   \
+    static Timings run_##Table(String *keys, String *shuffled,                 \
+                               String *misses, size_t count) {                 \
+        Timings timings = {0};                                                 \
+        size_t rounds = OPERATIONS / count;                                    \
+        Table table = Table##_new();                                           \
+                                                                               \
+        double start = now_seconds();                                          \
+        for (size_t round = 0; round < rounds; round++) {                      \
+            Table##_free(&table);                                              \
+            for (size_t i = 0; i < count; i++)                                 \
+                Table##_set(&table, keys[i], i);                               \
+        }                                                                      \
+        timings.insert = now_seconds() - start;                                \
+                                                                               \
+        start = now_seconds();                                                 \
+        for (size_t round = 0; round < rounds; round++) {                      \
+            for (size_t i = 0; i < count; i++) {                               \
+                size_t value;                                                  \
+                if (Table##_get(&table, shuffled[i], &value))                  \
+                    timings.checksum += value;                                 \
+            }                                                                  \
+        }                                                                      \
+        timings.hit = now_seconds() - start;                                   \
+                                                                               \
+        start = now_seconds();                                                 \
+        for (size_t round = 0; round < rounds; round++) {                      \
+            for (size_t i = 0; i < count; i++) {                               \
+                size_t value;                                                  \
+                if (Table##_get(&table, misses[i], &value))                    \
+                    timings.checksum += value;                                 \
+            }                                                                  \
+        }                                                                      \
+        timings.miss = now_seconds() - start;                                  \
+        Table##_free(&table);                                                  \
+                                                                               \
+        size_t window = count / WINDOW_DIVISOR;                                \
+        start = now_seconds();                                                 \
+        for (size_t i = 0; i < OPERATIONS; i++) {                              \
+            Table##_set(&table, keys[i % count], i);                           \
+            if (i >= window)                                                   \
+                Table##_delete(&table, keys[(i - window) % count]);            \
+        }                                                                      \
+        timings.churn = now_seconds() - start;                                 \
+        Table##_free(&table);                                                  \
+        return timings;                                                        \
+    }
+
+DEF_WORKLOADS(IndexTable)
+DEF_WORKLOADS(IndexLinearTable)
+
+static void report(const char *name, size_t count, Timings timings) {
+    double scale = 1e9 / (double)OPERATIONS;
+    printf("%-8s  %8zu  %8.2f  %8.2f  %8.2f  %8.2f  %zu\n", name, count,
+           timings.insert * scale, timings.hit * scale, timings.miss * scale,
+           timings.churn * scale, timings.checksum);
+}
+
+int main(void) {
+    size_t max_keys = SIZES[sizeof(SIZES) / sizeof(SIZES[0]) - 1];
+    char *key_storage, *miss_storage;
+    String *keys = generate_keys("key", max_keys, &key_storage);
+    String *misses = generate_keys("miss", max_keys, &miss_storage);
+    String *shuffled = malloc(max_keys * sizeof(String));
+
+    printf("%zu operations per workload, ns/op\n\n", OPERATIONS);
+    printf("%-8s  %8s  %8s  %8s  %8s  %8s  %s\n", "table", "keys", "insert",
+           "hit", "miss", "churn", "checksum");
+    for (size_t i = 0; i < sizeof(SIZES) / sizeof(SIZES[0]); i++) {
+        size_t count = SIZES[i];
+        memcpy(shuffled, keys, count * sizeof(String));
+        shuffle_keys(shuffled, count);
+        shuffle_keys(misses, count);
+        report("swiss", count,
+               run_IndexTable(keys, shuffled, misses, count));
+        report("linear", count,
+               run_IndexLinearTable(keys, shuffled, misses, count));
+    }
+
+    free(keys);
+    free(shuffled);
+    free(misses);
+    free(key_storage);
+    free(miss_storage);
+    return 0;
+}
@@ -0,0 +1,51 @@
+#include <stdalign.h>
+
+#include "arena.h"
+#include "memory.h"
+
+Arena Arena_new(void) { return (Arena){.current = NULL}; }
+
+static inline size_t block_size(size_t capacity) {
+    return sizeof(ArenaBlock) + capacity;
+}
+
+void *Arena_alloc(Arena *self, size_t size) {
+    if (size == 0)
+        return NULL;
+
+    // Keep every allocation aligned by rounding the sizes up
+    size = (size + alignof(max_align_t) - 1) & ~(alignof(max_align_t) - 1);
+    ArenaBlock *block = self->current;
+    if (block == NULL || block->capacity - block->used < size) {
+        size_t capacity = block == NULL ? ARENA_MIN_BLOCK_SIZE
+                                        : grow_allocation(block->capacity);
+        if (capacity < size)
+            capacity = size;
+
+        ArenaBlock *new_block =
+            (ArenaBlock *)reallocate_as(MEMORY_ARENA, NULL, 0,
+                                        block_size(capacity));
+        new_block->prev = block;
+        new_block->capacity = capacity;
+        new_block->used = 0;
+        self->current = block = new_block;
+    }
+
+    void *result = (char *)block->data + block->used;
+    block->used += size;
+    return result;
+}
+
+// Free 'block' and every block that was allocated before it
+static void free_blocks(ArenaBlock *block) {
+    while (block != NULL) {
+        ArenaBlock *prev = block->prev;
+        reallocate_as(MEMORY_ARENA, block, block_size(block->capacity), 0);
+        block = prev;
+    }
+}
+
+void Arena_free(Arena *self) {
+    free_blocks(self->current);
+    self->current = NULL;
+}
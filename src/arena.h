@@ -0,0 +1,32 @@
+#ifndef CLAM_ARENA_H
+#define CLAM_ARENA_H
+
+#include <stddef.h>
+
+// The smallest block an arena allocates, later blocks double in size so that
+// there are only ever logarithmically many of them
+constexpr size_t ARENA_MIN_BLOCK_SIZE = 4096;
+
+typedef struct ArenaBlock {
+    // The block that was current before this one
+    struct ArenaBlock *prev;
+    size_t capacity;
+    size_t used;
+    max_align_t data[];
+} ArenaBlock;
+
+// A region allocator, which hands out memory by bumping a pointer through a
+// block and frees everything it has handed out at once
+typedef struct Arena {
+    ArenaBlock *current;
+} Arena;
+
+Arena Arena_new(void);
+
+// Allocate 'size' bytes, aligned for any type, which stay valid until the
+// arena is freed. Allocating 0 bytes returns NULL.
+void *Arena_alloc(Arena *self, size_t size);
+
+void Arena_free(Arena *self);
+
+#endif
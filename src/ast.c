@@ -4,8 +4,291 @@
 #include <string.h>
 
 #include "ast.h"
+#include "lexer.h"
+#include "memory.h"
 
-DEF_VEC(AST, ASTVec)
+DEF_VEC(AST_LetBind, AST_LetBindVec)
+DEF_VEC(ASTIndex, ASTExtra)
+VEC_BULK(ASTIndex, ASTExtra)
+DEF_VEC(AST_Shift, AST_Shifts)
+
+AST AST_new(String source) {
+    return (AST){
+        .tags = NULL,
+        .data = NULL,
+        .starts = NULL,
+        .length = 0,
+        .capacity = 0,
+        .extra = ASTExtra_new(),
+        .strings = StringBuf_new(),
+        .source = source,
+        .shifts = AST_Shifts_new(),
+    };
+}
+
+void AST_free(AST *self) {
+    reallocate(self->tags, sizeof(uint8_t) * self->capacity, 0);
+    reallocate(self->data, sizeof(ASTData) * self->capacity, 0);
+    reallocate(self->starts, sizeof(uint32_t) * self->capacity, 0);
+    ASTExtra_free(&self->extra);
+    StringBuf_free(&self->strings);
+    AST_Shifts_free(&self->shifts);
+    *self = AST_new(self->source);
+}
+
+void AST_clear(AST *self) {
+    self->length = 0;
+    ASTExtra_truncate(&self->extra, 0);
+    StringBuf_truncate(&self->strings, 0);
+    self->shifts.length = 0;
+}
+
+void AST_shift(AST *self, size_t from, ptrdiff_t delta) {
+    if (delta == 0)
+        return;
+    ASSERT(from <= UINT32_MAX && delta >= INT32_MIN && delta <= INT32_MAX,
+           "Offsets fit in 32 bits");
+    AST_Shifts_push(&self->shifts,
+                    (AST_Shift){.from = (uint32_t)from,
+                                .delta = (int32_t)delta,
+                                .nodes = (uint32_t)self->length,
+                                .extra = (uint32_t)self->extra.length});
+}
+
+// Apply the shifts made since the offset stored with the node or extra word at
+// 'index' was added. Those are the last few, which are found by a binary
+// search, since the number of nodes and extra words only ever grows between
+// shifts.
+static size_t shifted(const AST *self, size_t offset, ASTIndex index,
+                      bool extra) {
+    const AST_Shift *shifts = self->shifts.buffer;
+    size_t low = 0, high = self->shifts.length;
+    while (low < high) {
+        size_t middle = low + (high - low) / 2;
+        if ((extra ? shifts[middle].extra : shifts[middle].nodes) <= index)
+            low = middle + 1;
+        else
+            high = middle;
+    }
+    for (size_t i = low; i < self->shifts.length; i++) {
+        if (offset >= shifts[i].from)
+            offset = (size_t)((ptrdiff_t)offset + shifts[i].delta);
+    }
+    return offset;
+}
+
+size_t AST_start(const AST *self, ASTIndex index) {
+    return shifted(self, self->starts[index], index, false);
+}
+
+ASTIndex AST_push(AST *self, uint8_t tag, ASTData data, size_t start) {
+    ASSERT(self->length < UINT32_MAX && start <= UINT32_MAX,
+           "Node indices and offsets fit in 32 bits");
+    if (self->capacity < self->length + 1) {
+        size_t old_capacity = self->capacity;
+        self->capacity = grow_allocation(old_capacity);
+        self->tags = reallocate(self->tags, sizeof(uint8_t) * old_capacity,
+                                sizeof(uint8_t) * self->capacity);
+        self->data = reallocate(self->data, sizeof(ASTData) * old_capacity,
+                                sizeof(ASTData) * self->capacity);
+        self->starts = reallocate(self->starts, sizeof(uint32_t) * old_capacity,
+                                  sizeof(uint32_t) * self->capacity);
+    }
+
+    self->tags[self->length] = tag;
+    self->data[self->length] = data;
+    self->starts[self->length] = (uint32_t)start;
+    return (ASTIndex)self->length++;
+}
+
+ASTIndex AST_push_extra(AST *self, const ASTIndex *words, size_t count) {
+    ASSERT(self->extra.length + count <= UINT32_MAX,
+           "Extra word indices fit in 32 bits");
+    ASTIndex first = (ASTIndex)self->extra.length;
+    ASTExtra_extend(&self->extra, words, count);
+    return first;
+}
+
+ASTData AST_literal_data(AST *self, AST_Literal literal) {
+    struct AST_LiteralData data = {.tag = literal.tag, .payload = 0};
+    switch (literal.tag) {
+    case LITERAL_UNIT:
+        break;
+    case LITERAL_BOOL:
+        data.payload = literal.value.boolean;
+        break;
+    case LITERAL_INT:
+        data.payload = (uint32_t)literal.value.integer;
+        break;
+    case LITERAL_FLOAT: {
+        ASTIndex words[2];
+        memcpy(words, &literal.value.real, sizeof(words));
+        data.payload = AST_push_extra(self, words, 2);
+        break;
+    }
+    case LITERAL_STRING: {
+        String string = literal.value.string;
+        ASSERT(self->strings.length + string.length <= UINT32_MAX,
+               "String offsets fit in 32 bits");
+        ASTIndex words[2] = {(ASTIndex)self->strings.length,
+                             (ASTIndex)string.length};
+        StringBuf_extend(&self->strings, string.buffer, string.length);
+        data.payload = AST_push_extra(self, words, 2);
+        break;
+    }
+    }
+    return (ASTData){.literal = data};
+}
+
+AST_Literal AST_literal(const AST *self, ASTIndex index) {
+    struct AST_LiteralData data = self->data[index].literal;
+    AST_Literal literal = {.tag = data.tag};
+    switch (data.tag) {
+    case LITERAL_UNIT:
+        break;
+    case LITERAL_BOOL:
+        literal.value.boolean = data.payload != 0;
+        break;
+    case LITERAL_INT:
+        literal.value.integer = (int32_t)data.payload;
+        break;
+    case LITERAL_FLOAT:
+        memcpy(&literal.value.real, &self->extra.buffer[data.payload],
+               sizeof(double));
+        break;
+    case LITERAL_STRING: {
+        ASTIndex *words = &self->extra.buffer[data.payload];
+        literal.value.string = (String){
+            .buffer = self->strings.buffer + words[0],
+            .length = words[1],
+        };
+        break;
+    }
+    }
+    return literal;
+}
+
+ASTIndex AST_push_list(AST *self, const ASTIndex *items, size_t length,
+                       size_t start, size_t end) {
+    ASTIndex count = (ASTIndex)length;
+    ASTIndex first = AST_push_extra(self, &count, 1);
+    AST_push_extra(self, items, length);
+    ASTData data = {.list = {.items = first, .end = (uint32_t)end}};
+    return AST_push(self, AST_LIST, data, start);
+}
+
+ASTIndex AST_push_run(AST *self, const AST_LetBind *bindings, size_t length,
+                      size_t tokens) {
+    ASTIndex header[AST_BINDINGS_HEADER_WORDS] = {
+        (ASTIndex)length, 0, (ASTIndex)length, (ASTIndex)tokens};
+    ASTIndex first = AST_push_extra(self, header, AST_BINDINGS_HEADER_WORDS);
+    ASTExtra_reserve(&self->extra, 3 * length);
+    for (size_t i = 0; i < length; i++) {
+        ASTIndex words[3] = {bindings[i].ident, bindings[i].value,
+                             bindings[i].start};
+        AST_push_extra(self, words, 3);
+    }
+    return first;
+}
+
+ASTIndex AST_push_binding_node(AST *self, const ASTIndex *children,
+                               size_t length, size_t tokens) {
+    ASSERT(length > 0, "A node of a tree of bindings has children");
+    size_t height = AST_bindings_header(self, children[0]).height + 1;
+    ASSERT(height < AST_MAX_BINDINGS_HEIGHT, "Trees of bindings stay low");
+    size_t bindings = 0;
+    for (size_t i = 0; i < length; i++)
+        bindings += AST_bindings_header(self, children[i]).bindings;
+    ASTIndex header[AST_BINDINGS_HEADER_WORDS] = {
+        (ASTIndex)length, (ASTIndex)height, (ASTIndex)bindings,
+        (ASTIndex)tokens};
+    ASTIndex first = AST_push_extra(self, header, AST_BINDINGS_HEADER_WORDS);
+    AST_push_extra(self, children, length);
+    return first;
+}
+
+ASTIndex AST_push_let_in(AST *self, ASTIndex bindings, ASTIndex body,
+                         size_t start) {
+    ASTData data = {.let_in = {.bindings = bindings, .body = body}};
+    return AST_push(self, AST_LET_IN, data, start);
+}
+
+AST_BindingIter AST_bindings(const AST *self, ASTIndex index) {
+    AST_BindingIter iter = {.ast = self, .depth = 1};
+    iter.path[0] = (struct AST_BindingStep){
+        .node = self->data[index].let_in.bindings, .next = 0};
+    return iter;
+}
+
+bool AST_next_binding(AST_BindingIter *iter, AST_LetBind *binding) {
+    const AST *ast = iter->ast;
+    while (iter->depth > 0) {
+        struct AST_BindingStep *step = &iter->path[iter->depth - 1];
+        AST_BindingsHeader header = AST_bindings_header(ast, step->node);
+        if (step->next == header.length) {
+            iter->depth--;
+            continue;
+        }
+        ASTIndex i = step->next++;
+        if (header.height > 0) {
+            iter->path[iter->depth++] = (struct AST_BindingStep){
+                .node = AST_bindings_child(ast, step->node, i), .next = 0};
+            continue;
+        }
+        ASTIndex word = step->node + AST_BINDINGS_HEADER_WORDS + 3 * i;
+        ASTIndex *words = &ast->extra.buffer[word];
+        *binding = (AST_LetBind){
+            .ident = words[0],
+            .value = words[1],
+            .start = (uint32_t)shifted(ast, words[2], word + 2, true),
+        };
+        return true;
+    }
+    return false;
+}
+
+// Every node other than a literal, identifier or list ends where its last child
+// does, so the end is found by following the last children down to one of
+// those. A literal that folding made out of a larger expression only covers
+// the first token of that expression.
+Span AST_span(const AST *self, ASTIndex index) {
+    size_t start = AST_start(self, index);
+    while (true) {
+        ASTData data = self->data[index];
+        switch (AST_tag(self, index)) {
+        case AST_LITERAL: {
+            Token token = {.start = (uint32_t)AST_start(self, index)};
+            return (Span){start, Token_span(self->source, token).end};
+        }
+        case AST_IDENT:
+            return (Span){start, AST_start(self, index) +
+                                     Symbol_name(data.ident).length};
+        case AST_LIST:
+            return (Span){start, shifted(self, data.list.end, index, false)};
+        case AST_LET_IN:
+            index = data.let_in.body;
+            break;
+        case AST_ABSTRACTION:
+            index = data.abstraction.body;
+            break;
+        case AST_APPLICATION:
+            index = data.application.argument;
+            break;
+        case AST_PRINT:
+            index = data.print.expr;
+            break;
+        case AST_IF_ELSE:
+            index = AST_branches(self, index)[1];
+            break;
+        case AST_UNARY_OP:
+            index = data.unary_op.operand;
+            break;
+        case AST_BINARY_OP:
+            index = data.binary_op.rhs;
+            break;
+        }
+    }
+}
 
 static String binop_to_string(AST_BinOp op) {
     switch (op) {
@@ -60,21 +343,21 @@ static void format_int(StringBuf *buf, int32_t num) {
     }
 }
 
-static void format_ast_node(ASTVec *arena, size_t index, StringBuf *buf) {
-    AST *node = &arena->buffer[index];
-    switch (node->tag) {
+static void format_ast_node(const AST *ast, ASTIndex index, StringBuf *buf) {
+    ASTData *node = &ast->data[index];
+    switch (AST_tag(ast, index)) {
     case AST_LITERAL: {
-        AST_Literal *literal = &node->value.literal;
-        switch (literal->tag) {
+        AST_Literal literal = AST_literal(ast, index);
+        switch (literal.tag) {
         case LITERAL_UNIT:
             StringBuf_push_string(buf, STR("unit"));
             break;
         case LITERAL_BOOL:
-            StringBuf_push_string(buf, literal->value.boolean ? STR("true")
-                                                              : STR("false"));
+            StringBuf_push_string(buf, literal.value.boolean ? STR("true")
+                                                             : STR("false"));
             break;
         case LITERAL_INT: {
-            int32_t num = literal->value.integer;
+            int32_t num = literal.value.integer;
             if (num == 0)
                 StringBuf_push(buf, '0');
             else
@@ -84,7 +367,7 @@ static void format_ast_node(ASTVec *arena, size_t index, StringBuf *buf) {
         case LITERAL_FLOAT: {
             char num[20];
             // I hate that I have to use a printf-style function but needs must
-            snprintf(num, 20, "%f", literal->value.real);
+            snprintf(num, 20, "%f", literal.value.real);
             StringBuf_push_string(buf,
                                   (String){.buffer = num,
                                            // 20 is the maximum length, the null
@@ -93,9 +376,8 @@ static void format_ast_node(ASTVec *arena, size_t index, StringBuf *buf) {
             break;
         }
         case LITERAL_STRING: {
-            StringBuf str = literal->value.string;
             StringBuf_push(buf, '"');
-            StringBuf_push_string(buf, (String){str.buffer, str.length});
+            StringBuf_push_string(buf, literal.value.string);
             StringBuf_push(buf, '"');
             break;
         }
@@ -103,95 +385,87 @@ static void format_ast_node(ASTVec *arena, size_t index, StringBuf *buf) {
         break;
     }
     case AST_IDENT:
-        StringBuf_push_string(buf, node->value.ident);
+        StringBuf_push_string(buf, Symbol_name(node->ident));
         break;
     case AST_LIST: {
-        AST_List *list = &node->value.list;
+        AST_Items list = AST_list(ast, index);
         StringBuf_push_string(buf, STR("(list"));
-        for (size_t i = 0; i < list->length; i++) {
+        for (size_t i = 0; i < list.length; i++) {
             StringBuf_push(buf, ' ');
-            ASTIndex item = list->buffer[i];
-            format_ast_node(arena, item, buf);
+            format_ast_node(ast, list.buffer[i], buf);
         }
         StringBuf_push(buf, ')');
         break;
     }
     case AST_LET_IN: {
-        AST_LetIn *let_in = &node->value.let_in;
         StringBuf_push_string(buf, STR("(let ["));
-        StringBuf_push(buf, '(');
-
-        AST_LetBind binding = let_in->bindings.buffer[0];
-        StringBuf_push_string(buf, binding.ident);
-        StringBuf_push(buf, ' ');
-        format_ast_node(arena, binding.value, buf);
-        StringBuf_push(buf, ')');
-        for (size_t i = 1; i < let_in->bindings.length; i++) {
-            StringBuf_push_string(buf, STR(" ("));
-            AST_LetBind binding = let_in->bindings.buffer[i];
-            StringBuf_push_string(buf, binding.ident);
+        // A `let` can have no bindings at all
+        AST_BindingIter bindings = AST_bindings(ast, index);
+        AST_LetBind binding;
+        for (size_t i = 0; AST_next_binding(&bindings, &binding); i++) {
+            StringBuf_push_string(buf, i == 0 ? STR("(") : STR(" ("));
+            StringBuf_push_string(buf, Symbol_name(binding.ident));
             StringBuf_push(buf, ' ');
-            format_ast_node(arena, binding.value, buf);
+            format_ast_node(ast, binding.value, buf);
             StringBuf_push(buf, ')');
         }
         StringBuf_push_string(buf, STR("] "));
-        format_ast_node(arena, let_in->body, buf);
+        format_ast_node(ast, node->let_in.body, buf);
         StringBuf_push(buf, ')');
         break;
     }
     case AST_ABSTRACTION: {
-        AST_Abstraction *abs = &node->value.abstraction;
+        struct AST_Abstraction *abs = &node->abstraction;
         StringBuf_push_string(buf, STR("(fun ["));
-        StringBuf_push_string(buf, abs->argument);
+        StringBuf_push_string(buf, Symbol_name(abs->argument));
         StringBuf_push_string(buf, STR("] "));
-        format_ast_node(arena, abs->body, buf);
+        format_ast_node(ast, abs->body, buf);
         StringBuf_push(buf, ')');
         break;
     }
     case AST_APPLICATION: {
-        AST_Application *app = &node->value.application;
+        struct AST_Application *app = &node->application;
         StringBuf_push_string(buf, STR("(app "));
-        format_ast_node(arena, app->function, buf);
+        format_ast_node(ast, app->function, buf);
         StringBuf_push(buf, ' ');
-        format_ast_node(arena, app->argument, buf);
+        format_ast_node(ast, app->argument, buf);
         StringBuf_push(buf, ')');
         break;
     }
     case AST_PRINT: {
-        AST_Print *print = &node->value.print;
         StringBuf_push_string(buf, STR("(print "));
-        format_ast_node(arena, print->expr, buf);
+        format_ast_node(ast, node->print.expr, buf);
         StringBuf_push(buf, ')');
         break;
     }
     case AST_IF_ELSE: {
-        AST_IfElse *if_else = &node->value.if_else;
+        ASTIndex *branches = AST_branches(ast, index);
         StringBuf_push_string(buf, STR("(if "));
-        format_ast_node(arena, if_else->condition, buf);
+        format_ast_node(ast, node->if_else.condition, buf);
         StringBuf_push_string(buf, STR(" :then "));
-        format_ast_node(arena, if_else->then, buf);
+        format_ast_node(ast, branches[0], buf);
         StringBuf_push_string(buf, STR(" :else "));
-        format_ast_node(arena, if_else->else_, buf);
+        format_ast_node(ast, branches[1], buf);
         StringBuf_push(buf, ')');
         break;
     }
     case AST_UNARY_OP: {
-        AST_UnaryOp *unop = &node->value.unary_op;
+        struct AST_UnaryOp *unop = &node->unary_op;
         StringBuf_push(buf, '(');
         StringBuf_push_string(buf, unop_to_string(unop->op));
         StringBuf_push(buf, ' ');
-        format_ast_node(arena, unop->operand, buf);
+        format_ast_node(ast, unop->operand, buf);
         StringBuf_push(buf, ')');
         break;
     }
     case AST_BINARY_OP: {
-        AST_BinaryOp *binop = &node->value.binary_op;
+        struct AST_BinaryOp *binop = &node->binary_op;
         StringBuf_push(buf, '(');
-        StringBuf_push_string(buf, binop_to_string(binop->op));
+        StringBuf_push_string(buf, binop_to_string(AST_binop(ast, index)));
         StringBuf_push(buf, ' ');
-        format_ast_node(arena, binop->lhs, buf);
+        format_ast_node(ast, binop->lhs, buf);
         StringBuf_push(buf, ' ');
-        format_ast_node(arena, binop->rhs, buf);
+        format_ast_node(ast, binop->rhs, buf);
         StringBuf_push(buf, ')');
         // Definitely didn't miss this out originally 👀
         break;
@@ -199,8 +473,8 @@ static void format_ast_node(ASTVec *arena, size_t index, StringBuf *buf) {
     }
 }
 
-StringBuf format_ast(ASTVec *arena, size_t index) {
+StringBuf format_ast(const AST *ast, ASTIndex index) {
     StringBuf buf = StringBuf_new();
-    format_ast_node(arena, index, &buf);
+    format_ast_node(ast, index, &buf);
     return buf;
 }
@@ -2,75 +2,59 @@
 #define CLAM_AST_H
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "common.h"
 #include "string.h"
+#include "symbol.h"
 #include "vec.h"
 
-// A type alias which represents the index into the arena of nodes
-typedef size_t ASTIndex;
+// The index of a node in an 'AST', or of a word in its 'extra' words
+typedef uint32_t ASTIndex;
 
-DECL_VEC_HEADER(ASTIndex, AST_List)
+// The compiler gathers the arguments of a call into one of these, and most
+// calls only have a few
+DECL_SMALLVEC_HEADER(ASTIndex, AST_List, 4)
 
-// A literal
+// The values should match up with VM_ValueTag
+typedef enum AST_LiteralTag : uint8_t {
+    LITERAL_UNIT = 0,   // "unit"
+    LITERAL_BOOL = 1,   // "true", "false"
+    LITERAL_INT = 2,    // e.g. "1234"
+    LITERAL_FLOAT = 3,  // e.g. "12.34"
+    LITERAL_STRING = 4, // e.g. ""this is a string""
+} AST_LiteralTag;
+
+// A literal, as decoded from its node by 'AST_literal'
 typedef struct AST_Literal {
-    // The values should match up with VM_ValueTag
-    enum AST_LiteralTag : uint8_t {
-        LITERAL_UNIT = 0,   // "unit"
-        LITERAL_BOOL = 1,   // "true", "false"
-        LITERAL_INT = 2,    // e.g. "1234"
-        LITERAL_FLOAT = 3,  // e.g. "12.34"
-        LITERAL_STRING = 4, // e.g. ""this is a string""
-    } tag;
+    AST_LiteralTag tag;
     union AST_LiteralUnion {
         bool boolean;
         int32_t integer;
         double real;
-        StringBuf string;
+        // Points into the AST's 'strings', so it is only valid until another
+        // string literal is added
+        String string;
     } value;
 } AST_Literal;
 
-// A singular let binding (variable definition) in 'AST_LetIn'
+// A singular let binding (variable definition) in a `let`, which is stored as
+// three words in a run of bindings (see 'AST_push_run')
 typedef struct AST_LetBind {
-    Span span;
-    String ident;
+    Symbol ident;
     ASTIndex value;
+    // Where 'ident' starts in the source
+    uint32_t start;
 } AST_LetBind;
 
-// clang-format off
+// The parser collects the bindings of a `let` in one of these
 DECL_VEC_HEADER(AST_LetBind, AST_LetBindVec)
 
-// An expression that introduces a new scope, defines the variables in 'bindings' and evaluates 'body' in that scope
-typedef struct AST_LetIn {
-    AST_LetBindVec bindings;
-    ASTIndex body;
-    // clang-format on
-} AST_LetIn;
-
-// An anonymous function
-typedef struct AST_Abstraction {
-    String argument;
-    ASTIndex body;
-} AST_Abstraction;
-
-// A function call
-typedef struct AST_Application {
-    ASTIndex function;
-    ASTIndex argument;
-} AST_Application;
-
-// An expression that when evaluated, prints 'expr' and returns the unit value
-typedef struct AST_Print {
-    ASTIndex expr;
-} AST_Print;
-
-// An if-else expression
-typedef struct AST_IfElse {
-    ASTIndex condition;
-    ASTIndex then;
-    ASTIndex else_;
-} AST_IfElse;
+static inline Span AST_LetBind_span(AST_LetBind binding) {
+    return (Span){.start = binding.start,
+                  .end = binding.start + Symbol_name(binding.ident).length};
+}
 
 // A binary operation, with a value matching that of the corresponding
 // enumeration in 'VM_Op' so we can safely cast to it (doesn't match with
@@ -80,13 +64,6 @@ typedef enum AST_UnOp {
     UNOP_NEGATE = 42,
 } AST_UnOp;
 
-// A unary operation `op` on the node referenced by `operand`
-typedef struct AST_UnaryOp {
-    Span op_span;
-    AST_UnOp op;
-    ASTIndex operand;
-} AST_UnaryOp;
-
 // A binary operation, with a value matching that of the corresponding
 // enumeration in 'TokenKind' so we can safely cast from it
 typedef enum AST_BinOp {
@@ -111,46 +88,257 @@ typedef enum AST_BinOp {
     BINOP_NEQ = 39,
 } AST_BinOp;
 
-// A binary operation 'op' on the nodes referenced by 'lhs' and 'rhs'
-typedef struct AST_BinaryOp {
-    Span op_span;
-    AST_BinOp op;
-    ASTIndex lhs;
-    ASTIndex rhs;
-} AST_BinaryOp;
+typedef enum ASTTag : uint8_t {
+    AST_LITERAL,
+    AST_IDENT,
+    AST_LIST,
+    AST_LET_IN,
+    AST_ABSTRACTION,
+    AST_APPLICATION,
+    AST_PRINT,
+    AST_IF_ELSE,
+    AST_UNARY_OP,
+    // Binary operations are stored with their 'AST_BinOp' as their tag, which
+    // never clashes with the other tags
+    AST_BINARY_OP,
+} ASTTag;
+
+// The two words that every node has, whose meaning depends on its tag. Whatever
+// doesn't fit in them goes in the AST's 'extra' words, which are referred to by
+// the index of the first one.
+typedef union ASTData {
+    struct AST_LiteralData {
+        AST_LiteralTag tag;
+        // The value of a bool or int, or the index of two extra words holding
+        // a float's bits or a string's offset in 'strings' and its length
+        uint32_t payload;
+    } literal;
+    Symbol ident;
+    struct AST_ListData {
+        // The index of the extra word holding the number of items, followed by
+        // the items themselves
+        ASTIndex items;
+        // The end of the closing brace
+        uint32_t end;
+    } list;
+    struct AST_LetInData {
+        // The index of the extra words of the node at the root of the
+        // bindings' tree (see 'AST_push_binding_node')
+        ASTIndex bindings;
+        ASTIndex body;
+    } let_in;
+    // An anonymous function
+    struct AST_Abstraction {
+        Symbol argument;
+        ASTIndex body;
+    } abstraction;
+    // A function call
+    struct AST_Application {
+        ASTIndex function;
+        ASTIndex argument;
+    } application;
+    // Prints 'expr' and evaluates to unit
+    struct AST_Print {
+        ASTIndex expr;
+    } print;
+    struct AST_IfElse {
+        ASTIndex condition;
+        // The index of the extra word holding the then branch, followed by the
+        // else branch
+        ASTIndex branches;
+    } if_else;
+    struct AST_UnaryOp {
+        AST_UnOp op;
+        ASTIndex operand;
+    } unary_op;
+    // The operator is the node's tag
+    struct AST_BinaryOp {
+        ASTIndex lhs;
+        ASTIndex rhs;
+    } binary_op;
+} ASTData;
+
+DECL_VEC_HEADER(ASTIndex, ASTExtra)
+
+VEC_BULK_SIG(ASTIndex, ASTExtra)
 
-// The Abstract Syntax Tree
+// An edit that moved every offset at or after 'from' by 'delta', which applies
+// to the first 'nodes' nodes and 'extra' extra words, the ones there were when
+// it was made
+typedef struct AST_Shift {
+    uint32_t from;
+    int32_t delta;
+    uint32_t nodes;
+    uint32_t extra;
+} AST_Shift;
+
+DECL_VEC_HEADER(AST_Shift, AST_Shifts)
+
+// The Abstract Syntax Tree, stored as a struct of arrays with an entry for each
+// node in each of 'tags', 'data' and 'starts', so that a node takes 13 bytes.
+//
+// Only the start of each node's span is stored, since the end is only needed
+// for error messages, and can be worked out from the node's last child (see
+// 'AST_span').
+//
+// Offsets into the source are stored as they were when they were added, and
+// edits since then are applied as they are read (see 'AST_start'), so that an
+// edit doesn't have to visit every node that comes after it.
 typedef struct AST {
-    enum ASTTag {
-        AST_LITERAL,
-        AST_IDENT,
-        AST_LIST,
-        AST_LET_IN,
-        AST_ABSTRACTION,
-        AST_APPLICATION,
-        AST_PRINT,
-        AST_IF_ELSE,
-        AST_UNARY_OP,
-        AST_BINARY_OP,
-    } tag;
-    union ASTUnion {
-        AST_Literal literal;
-        String ident;
-        AST_List list;
-        AST_LetIn let_in;
-        AST_Abstraction abstraction;
-        AST_Application application;
-        AST_Print print;
-        AST_IfElse if_else;
-        AST_UnaryOp unary_op;
-        AST_BinaryOp binary_op;
-    } value;
-    Span span;
+    uint8_t *tags;
+    ASTData *data;
+    uint32_t *starts;
+    size_t length;
+    size_t capacity;
+    ASTExtra extra;
+    // The contents of every string literal, with escape sequences replaced
+    StringBuf strings;
+    // What the nodes' spans are offsets into
+    String source;
+    // Every edit since the AST was last cleared, oldest first
+    AST_Shifts shifts;
 } AST;
 
-// clang-format off
-DECL_VEC_HEADER(AST, ASTVec)
+AST AST_new(String source);
+
+void AST_free(AST *self);
+
+// Drop every node, extra word, string and shift, keeping the memory they were
+// in
+void AST_clear(AST *self);
+
+// Move every offset into the source at or after 'from' by 'delta', for nodes
+// which are kept after an edit which changed the source's length. This only
+// records the shift, which is applied to each offset when it is read.
+void AST_shift(AST *self, size_t from, ptrdiff_t delta);
+
+// Where the node at 'index' starts in the source
+size_t AST_start(const AST *self, ASTIndex index);
+
+// Add a node, where 'tag' is an 'ASTTag' or, for binary operations, an
+// 'AST_BinOp'
+ASTIndex AST_push(AST *self, uint8_t tag, ASTData data, size_t start);
+
+// Add 'count' extra words, returning the index of the first
+ASTIndex AST_push_extra(AST *self, const ASTIndex *words, size_t count);
+
+// Encode 'literal' as the data of a literal node, copying any string into
+// 'strings' and putting floats and strings in extra words
+ASTData AST_literal_data(AST *self, AST_Literal literal);
+
+AST_Literal AST_literal(const AST *self, ASTIndex index);
+
+// Add a list node with the 'length' items at 'items'
+ASTIndex AST_push_list(AST *self, const ASTIndex *items, size_t length,
+                       size_t start, size_t end);
+
+// The bindings of a `let` are stored as a tree in the extra words, so that an
+// incremental parser can reuse the parts of a long `let` that an edit isn't
+// in. Each node of the tree starts with these four words. The bindings are in
+// runs, the nodes of height 0, which are followed by the three words of each
+// binding. Every other node is followed by the extra index of each of its
+// children, which are one lower.
+typedef struct AST_BindingsHeader {
+    // The number of bindings or children that follow
+    uint32_t length;
+    uint32_t height;
+    // The number of bindings under the node
+    uint32_t bindings;
+    // The number of tokens the bindings were parsed from, up to the first one
+    // after them, or 0 if they weren't parsed incrementally
+    uint32_t tokens;
+} AST_BindingsHeader;
+
+constexpr size_t AST_BINDINGS_HEADER_WORDS = 4;
+
+// How high a tree of bindings can get, which is far higher than the trees an
+// incremental parser makes (see 'parse_let_binding')
+constexpr size_t AST_MAX_BINDINGS_HEIGHT = 32;
+
+// Add a run of the 'length' bindings at 'bindings', parsed from 'tokens' tokens
+ASTIndex AST_push_run(AST *self, const AST_LetBind *bindings, size_t length,
+                      size_t tokens);
+
+// Add a node of a tree of bindings over the 'length' nodes of the same height
+// at 'children', parsed from 'tokens' tokens
+ASTIndex AST_push_binding_node(AST *self, const ASTIndex *children,
+                               size_t length, size_t tokens);
+
+static inline AST_BindingsHeader AST_bindings_header(const AST *self,
+                                                     ASTIndex node) {
+    ASTIndex *words = &self->extra.buffer[node];
+    return (AST_BindingsHeader){
+        .length = words[0],
+        .height = words[1],
+        .bindings = words[2],
+        .tokens = words[3],
+    };
+}
+
+// Child 'i' of a node of a tree of bindings which isn't a run
+static inline ASTIndex AST_bindings_child(const AST *self, ASTIndex node,
+                                          size_t i) {
+    return self->extra.buffer[node + AST_BINDINGS_HEADER_WORDS + i];
+}
+
+// Add a `let` node whose bindings are the tree at 'bindings'
+ASTIndex AST_push_let_in(AST *self, ASTIndex bindings, ASTIndex body,
+                         size_t start);
+
+Span AST_span(const AST *self, ASTIndex index);
+
+static inline ASTTag AST_tag(const AST *self, ASTIndex index) {
+    uint8_t tag = self->tags[index];
+    return tag >= BINOP_FNPIPE ? AST_BINARY_OP : (ASTTag)tag;
+}
+
+// Pre-condition: `AST_tag(self, index) == AST_BINARY_OP`
+static inline AST_BinOp AST_binop(const AST *self, ASTIndex index) {
+    return (AST_BinOp)self->tags[index];
+}
+
+// The items of a list node, which are only valid until more extra words are
+// added
+typedef struct AST_Items {
+    ASTIndex *buffer;
+    size_t length;
+} AST_Items;
+
+static inline AST_Items AST_list(const AST *self, ASTIndex index) {
+    ASTIndex *words = &self->extra.buffer[self->data[index].list.items];
+    return (AST_Items){.buffer = words + 1, .length = words[0]};
+}
+
+static inline size_t AST_bindings_length(const AST *self, ASTIndex index) {
+    return AST_bindings_header(self, self->data[index].let_in.bindings)
+        .bindings;
+}
+
+// Goes through the bindings of a `let` in order. Only indices are kept, so
+// extra words can be added in the meantime.
+typedef struct AST_BindingIter {
+    const AST *ast;
+    // The nodes from the root down to the run the next binding is in, and the
+    // index of the next binding or child of each
+    struct AST_BindingStep {
+        ASTIndex node;
+        uint32_t next;
+    } path[AST_MAX_BINDINGS_HEIGHT];
+    size_t depth;
+} AST_BindingIter;
+
+// Start going through the bindings of the `let` node at 'index'
+AST_BindingIter AST_bindings(const AST *self, ASTIndex index);
+
+// Write the next binding to 'binding', or return false if there are no more
+bool AST_next_binding(AST_BindingIter *iter, AST_LetBind *binding);
+
+// The then and else branches of an if-else node, which are only valid until
+// more extra words are added
+static inline ASTIndex *AST_branches(const AST *self, ASTIndex index) {
+    return &self->extra.buffer[self->data[index].if_else.branches];
+}
 
-StringBuf format_ast(ASTVec *arena, size_t index);
+StringBuf format_ast(const AST *ast, ASTIndex index);
 
 #endif
@@ -0,0 +1,122 @@
+#include "chunk.h"
+#include "common.h"
+
+DEF_VEC(uint16_t, Code)
+
+size_t OpCode_operand_count(OpCode op) {
+    switch (op) {
+    case VM_OP_LOAD_CONST:
+    case VM_OP_LOAD_LOCAL:
+    case VM_OP_SLIDE:
+    case VM_OP_JUMP:
+    case VM_OP_JUMP_IF_FALSE:
+    case VM_OP_LOAD_UPVALUE:
+    case VM_OP_CLOSURE:
+    case VM_OP_CALL:
+    case VM_OP_TAIL_CALL:
+    case VM_OP_LOOP:
+    case VM_OP_LIST:
+    case VM_OP_ADD_CONST:
+    case VM_OP_SUB_CONST:
+    case VM_OP_JUMP_IF_NOT_LT:
+    case VM_OP_JUMP_IF_NOT_LEQ:
+    case VM_OP_JUMP_IF_NOT_GT:
+    case VM_OP_JUMP_IF_NOT_GEQ:
+    case VM_OP_JUMP_IF_NOT_EQ:
+    case VM_OP_JUMP_IF_NOT_NEQ:
+        return 1;
+    case VM_OP_ADD_LOCALS:
+    case VM_OP_SUB_LOCALS:
+        return 2;
+    case VM_OP_POP:
+    case VM_OP_PRINT:
+    case VM_OP_RETURN:
+    case VM_OP_APPEND:
+    case VM_OP_CONCAT:
+    case VM_OP_ADD:
+    case VM_OP_SUB:
+    case VM_OP_MUL:
+    case VM_OP_DIV:
+    case VM_OP_MOD:
+    case VM_OP_AND:
+    case VM_OP_OR:
+    case VM_OP_LT:
+    case VM_OP_LEQ:
+    case VM_OP_GT:
+    case VM_OP_GEQ:
+    case VM_OP_EQ:
+    case VM_OP_NEQ:
+    case VM_OP_NOT:
+    case VM_OP_NEGATE:
+    case VM_OP_ADD_INT:
+    case VM_OP_SUB_INT:
+    case VM_OP_MUL_INT:
+    case VM_OP_DIV_INT:
+    case VM_OP_LT_INT:
+    case VM_OP_LEQ_INT:
+    case VM_OP_GT_INT:
+    case VM_OP_GEQ_INT:
+    case VM_OP_ADD_FLOAT:
+    case VM_OP_SUB_FLOAT:
+    case VM_OP_MUL_FLOAT:
+    case VM_OP_DIV_FLOAT:
+    case VM_OP_LT_FLOAT:
+    case VM_OP_LEQ_FLOAT:
+    case VM_OP_GT_FLOAT:
+    case VM_OP_GEQ_FLOAT:
+        return 0;
+    }
+    UNREACHABLE;
+}
+
+size_t RegOpCode_operand_count(RegOpCode op) {
+    switch (op) {
+    case REG_OP_JUMP:
+    case REG_OP_RETURN:
+        return 1;
+    case REG_OP_LOAD_CONST:
+    case REG_OP_MOVE:
+    case REG_OP_PRINT:
+    case REG_OP_JUMP_IF_FALSE:
+    case REG_OP_NOT:
+    case REG_OP_NEGATE:
+        return 2;
+    case REG_OP_ADD:
+    case REG_OP_SUB:
+    case REG_OP_MUL:
+    case REG_OP_DIV:
+    case REG_OP_MOD:
+    case REG_OP_AND:
+    case REG_OP_OR:
+    case REG_OP_LT:
+    case REG_OP_LEQ:
+    case REG_OP_GT:
+    case REG_OP_GEQ:
+    case REG_OP_EQ:
+    case REG_OP_NEQ:
+        return 3;
+    }
+    UNREACHABLE;
+}
+
+Chunk Chunk_new(void) {
+    return (Chunk){
+        .constants = Values_new(),
+        .code = Code_new(),
+        .max_stack = 0,
+    };
+}
+
+size_t Chunk_write(Chunk *self, uint16_t word) {
+    return Code_push(&self->code, word);
+}
+
+size_t Chunk_add_constant(Chunk *self, Value value) {
+    return Values_push(&self->constants, value);
+}
+
+void Chunk_free(Chunk *self) {
+    Values_free(&self->constants);
+    Code_free(&self->code);
+    self->max_stack = 0;
+}
@@ -0,0 +1,167 @@
+#ifndef CLAM_CHUNK_H
+#define CLAM_CHUNK_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "value.h"
+#include "vec.h"
+
+// Each instruction is a single opcode word followed by zero or more operand
+// words, the operands of each instruction are listed in square brackets
+typedef enum OpCode : uint16_t {
+    VM_OP_LOAD_CONST = 1, // [index] Push 'constants[index]'
+    VM_OP_POP = 2,        // Discard the top of the stack
+    VM_OP_PRINT = 3,      // Print and pop the top of the stack, pushing unit
+    VM_OP_LOAD_LOCAL = 4, // [slot] Push a copy of the local in stack slot 'slot'
+    VM_OP_SLIDE = 5,      // [count] Discard 'count' values below the top
+    VM_OP_JUMP = 6,       // [offset] Jump forwards by 'offset' words
+    VM_OP_JUMP_IF_FALSE = 7, // [offset] Pop the top and jump if it is false
+    VM_OP_RETURN = 8,        // Return the top of the stack from the function
+    VM_OP_LOAD_UPVALUE = 9,  // [index] Push the current closure's upvalue
+    VM_OP_CLOSURE = 10,      // [index] Push a closure over 'constants[index]'
+    // [count] Call the function below the top 'count' values with them as its
+    // arguments, replacing all of them with its result. The count must not be
+    // more than the function still takes, and when it is less, the result is a
+    // partial application.
+    VM_OP_CALL = 11,
+    // [count] Like CALL, but the callee replaces the current function's frame.
+    // It is always followed by a RETURN, for when the call only creates a
+    // partial application or calls a native, neither of which has a frame.
+    VM_OP_TAIL_CALL = 12,
+    // [count] Replace the current function's arguments with the top 'count'
+    // values, discarding everything else in the frame, and jump back to the
+    // start of the function
+    VM_OP_LOOP = 13,
+    // [count] Replace the top 'count' values with a list of them, the first
+    // of which is the deepest
+    VM_OP_LIST = 14,
+
+    /* BINARY OPERATIONS (values match up with AST_BinOp) */
+
+    VM_OP_APPEND = 24,
+    VM_OP_CONCAT = 25,
+
+    VM_OP_ADD = 26,
+    VM_OP_SUB = 27,
+    VM_OP_MUL = 28,
+    VM_OP_DIV = 29,
+    VM_OP_MOD = 30,
+
+    VM_OP_AND = 32,
+    VM_OP_OR = 33,
+
+    VM_OP_LT = 34,
+    VM_OP_LEQ = 35,
+    VM_OP_GT = 36,
+    VM_OP_GEQ = 37,
+    VM_OP_EQ = 38,
+    VM_OP_NEQ = 39,
+
+    /* UNARY OPERATIONS (values match up with AST_UnOp) */
+
+    VM_OP_NOT = 31,
+    VM_OP_NEGATE = 42,
+
+    /* SUPERINSTRUCTIONS (only produced by the peephole optimiser) */
+
+    VM_OP_ADD_CONST = 64,  // [index] LOAD_CONST index, ADD
+    VM_OP_SUB_CONST = 65,  // [index] LOAD_CONST index, SUB
+    VM_OP_ADD_LOCALS = 66, // [a, b] LOAD_LOCAL a, LOAD_LOCAL b, ADD
+    VM_OP_SUB_LOCALS = 67, // [a, b] LOAD_LOCAL a, LOAD_LOCAL b, SUB
+
+    // [offset] A comparison followed by JUMP_IF_FALSE, these are in the same
+    // order as the comparison opcodes so that they can be derived from them
+    VM_OP_JUMP_IF_NOT_LT = 68,
+    VM_OP_JUMP_IF_NOT_LEQ = 69,
+    VM_OP_JUMP_IF_NOT_GT = 70,
+    VM_OP_JUMP_IF_NOT_GEQ = 71,
+    VM_OP_JUMP_IF_NOT_EQ = 72,
+    VM_OP_JUMP_IF_NOT_NEQ = 73,
+
+    /* TYPE-SPECIALISED OPERATIONS (emitted when the operand types are known) */
+
+    // Both operands are ints, these are in the same order as the generic
+    // opcodes so that they can be derived from them
+    VM_OP_ADD_INT = 80,
+    VM_OP_SUB_INT = 81,
+    VM_OP_MUL_INT = 82,
+    VM_OP_DIV_INT = 83,
+    VM_OP_LT_INT = 84,
+    VM_OP_LEQ_INT = 85,
+    VM_OP_GT_INT = 86,
+    VM_OP_GEQ_INT = 87,
+
+    // Both operands are floats, in the same order as the int versions
+    VM_OP_ADD_FLOAT = 88,
+    VM_OP_SUB_FLOAT = 89,
+    VM_OP_MUL_FLOAT = 90,
+    VM_OP_DIV_FLOAT = 91,
+    VM_OP_LT_FLOAT = 92,
+    VM_OP_LEQ_FLOAT = 93,
+    VM_OP_GT_FLOAT = 94,
+    VM_OP_GEQ_FLOAT = 95,
+} OpCode;
+
+// The register machine's counterpart to 'OpCode', where each operand is the
+// index of a register unless stated otherwise
+typedef enum RegOpCode : uint16_t {
+    REG_OP_LOAD_CONST = 1, // [dst, index] Load 'constants[index]' into 'dst'
+    REG_OP_MOVE = 2,       // [dst, src] Copy 'src' into 'dst'
+    REG_OP_PRINT = 3,      // [dst, src] Print 'src' and load unit into 'dst'
+    REG_OP_JUMP = 6,       // [offset] Jump forwards by 'offset' words
+    REG_OP_JUMP_IF_FALSE = 7, // [condition, offset] Jump if 'condition' is false
+    REG_OP_RETURN = 8,        // [src] Stop executing and return 'src'
+
+    /* BINARY OPERATIONS [dst, lhs, rhs] (values match up with AST_BinOp) */
+
+    REG_OP_ADD = 26,
+    REG_OP_SUB = 27,
+    REG_OP_MUL = 28,
+    REG_OP_DIV = 29,
+    REG_OP_MOD = 30,
+
+    REG_OP_AND = 32,
+    REG_OP_OR = 33,
+
+    REG_OP_LT = 34,
+    REG_OP_LEQ = 35,
+    REG_OP_GT = 36,
+    REG_OP_GEQ = 37,
+    REG_OP_EQ = 38,
+    REG_OP_NEQ = 39,
+
+    /* UNARY OPERATIONS [dst, src] (values match up with AST_UnOp) */
+
+    REG_OP_NOT = 31,
+    REG_OP_NEGATE = 42,
+} RegOpCode;
+
+// The number of operand words following 'op'
+size_t OpCode_operand_count(OpCode op);
+
+// The number of operand words following 'op'
+size_t RegOpCode_operand_count(RegOpCode op);
+
+DECL_VEC_HEADER(uint16_t, Code)
+
+// A unit of bytecode for either the stack or the register machine
+typedef struct Chunk {
+    Values constants;
+    Code code;
+    // The maximum number of stack slots (or registers, for register bytecode)
+    // needed to execute `code`
+    size_t max_stack;
+} Chunk;
+
+Chunk Chunk_new(void);
+
+// Append a word to the chunk's code, returning its offset
+size_t Chunk_write(Chunk *self, uint16_t word);
+
+// Append a value to the constant pool, returning its index
+size_t Chunk_add_constant(Chunk *self, Value value);
+
+void Chunk_free(Chunk *self);
+
+#endif
@@ -5,6 +5,9 @@
 #include <stdlib.h>
 
 #define DEBUG_MODE
+// Collect garbage before every allocation the VM makes, which shakes out
+// objects that are live but aren't reachable from the roots
+// #define DEBUG_STRESS_GC
 
 // I hate this language, all of its compilers and all of their stupid
 // idiosyncrasies, anyways, this expression should signal to the MSVC, GCC and
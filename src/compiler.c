@@ -1,8 +1,15 @@
+#include <stdint.h>
+#include <stdio.h>
+
 #include "compiler.h"
+#include "diagnostic.h"
+#include "native.h"
+#include "object.h"
+#include "rope.h"
+#include "types.h"
 
-MaybeNameError resolve_names(ASTVec arena, ASTIndex root) {
-    AST node = arena.buffer[root];
-    switch (node.tag) {
+MaybeNameError resolve_names(const AST *ast, ASTIndex root) {
+    switch (AST_tag(ast, root)) {
     case AST_LITERAL:
     case AST_IDENT:
     case AST_LIST:
@@ -15,4 +22,662 @@ MaybeNameError resolve_names(ASTVec arena, ASTIndex root) {
     case AST_BINARY_OP:
         break;
     }
+    return (MaybeNameError){.tag = MAYBE_NONE};
+}
+
+// A variable bound by a `let` or a function's parameter, which lives in a stack
+// slot (relative to the start of the function's frame) while it is in scope
+typedef struct Local {
+    Symbol name;
+    uint16_t slot;
+    // The arity of the function bound to the local if it is known, otherwise 0
+    uint16_t arity;
+} Local;
+
+DEF_VEC_T(Local, Locals)
+
+// A free variable of the function being compiled
+typedef struct Upvalue {
+    Capture capture;
+    // The arity of the function bound to the variable if it is known, otherwise
+    // 0
+    uint16_t arity;
+} Upvalue;
+
+DEF_VEC_T(Upvalue, Upvalues)
+
+// Stores compiler state, with one compiler for each function being compiled
+typedef struct Compiler {
+    // The compiler for the function that this one's is nested in, or NULL for
+    // the top-level expression
+    struct Compiler *enclosing;
+    AST *ast;
+    // The static type of each node in 'ast'
+    StaticTypes *types;
+    // Where constant objects (e.g. strings) are allocated
+    Heap *heap;
+    Chunk chunk;
+    // The locals currently in scope, innermost last
+    Locals locals;
+    // The free variables of the function, in upvalue order
+    Upvalues upvalues;
+    // The number of values on the stack at the current point in the code
+    size_t stack_depth;
+} Compiler;
+
+#define NO_ERROR ((MaybeCompileError){.tag = MAYBE_NONE})
+
+static inline MaybeCompileError compile_error(enum CompileErrorTag tag,
+                                              Span span) {
+    return (MaybeCompileError){
+        .tag = MAYBE_SOME,
+        .some = {.tag = tag, .span = span},
+    };
+}
+
+// An error pointing at the node at 'index', whose span is only worked out now
+// that it is needed
+static inline MaybeCompileError node_error(Compiler *self,
+                                           enum CompileErrorTag tag,
+                                           ASTIndex index) {
+    return compile_error(tag, AST_span(self->ast, index));
+}
+
+// Return early if 'maybe_error' contains an error
+#define TRY(maybe_error)                                                       \
+    do {                                                                       \
+        MaybeCompileError maybe = maybe_error;                                 \
+        if (maybe.tag == MAYBE_SOME)                                           \
+            return maybe;                                                      \
+    } while (0)
+
+static inline ASTData *get_node(Compiler *self, ASTIndex index) {
+    return &self->ast->data[index];
+}
+
+static inline size_t emit(Compiler *self, uint16_t word) {
+    return Chunk_write(&self->chunk, word);
+}
+
+// Emit 'op' which pushes (or pops, when negative) 'stack_effect' values
+static inline void emit_op(Compiler *self, OpCode op, int stack_effect) {
+    emit(self, op);
+    self->stack_depth += stack_effect;
+    if (self->stack_depth > self->chunk.max_stack)
+        self->chunk.max_stack = self->stack_depth;
+}
+
+// 'node' is what any error points at
+static MaybeCompileError make_constant(Compiler *self, Value value,
+                                       ASTIndex node,
+                                       /* out */ uint16_t *index) {
+    size_t constant = Chunk_add_constant(&self->chunk, value);
+    if (constant > UINT16_MAX)
+        return node_error(self, COMPILE_ERROR_TOO_MANY_CONSTANTS, node);
+
+    *index = (uint16_t)constant;
+    return NO_ERROR;
+}
+
+static MaybeCompileError emit_constant(Compiler *self, Value value,
+                                       ASTIndex node) {
+    uint16_t index;
+    TRY(make_constant(self, value, node, &index));
+    emit_op(self, VM_OP_LOAD_CONST, 1);
+    emit(self, index);
+    return NO_ERROR;
+}
+
+// Emit a jump instruction with a placeholder offset, returning the location of
+// the offset so it can be patched later
+static size_t emit_jump(Compiler *self, OpCode op, int stack_effect) {
+    emit_op(self, op, stack_effect);
+    return emit(self, UINT16_MAX);
+}
+
+// Point the jump whose offset is at 'location' to the end of the code
+static MaybeCompileError patch_jump(Compiler *self, size_t location,
+                                    ASTIndex node) {
+    size_t offset = self->chunk.code.length - (location + 1);
+    if (offset > UINT16_MAX)
+        return node_error(self, COMPILE_ERROR_JUMP_TOO_LONG, node);
+
+    self->chunk.code.buffer[location] = (uint16_t)offset;
+    return NO_ERROR;
+}
+
+static MaybeCompileError compile_node(Compiler *self, ASTIndex index);
+
+static MaybeCompileError compile_return(Compiler *self, ASTIndex index);
+
+static MaybeCompileError compile_literal(Compiler *self, ASTIndex index) {
+    AST_Literal literal = AST_literal(self->ast, index);
+    switch (literal.tag) {
+    case LITERAL_UNIT:
+        return emit_constant(self, Value_unit(), index);
+    case LITERAL_BOOL:
+        return emit_constant(self, Value_bool(literal.value.boolean), index);
+    case LITERAL_INT:
+        return emit_constant(self, Value_int(literal.value.integer), index);
+    case LITERAL_FLOAT:
+        return emit_constant(self, Value_float(literal.value.real), index);
+    case LITERAL_STRING: {
+        Value string = Value_string(self->heap, literal.value.string);
+        return emit_constant(self, string, index);
+    }
+    }
+    UNREACHABLE;
+}
+
+// Returns the innermost local called 'name' in the function being compiled, or
+// NULL if it isn't one of its locals
+static Local *resolve_local(Compiler *self, Symbol name) {
+    for (size_t i = self->locals.length; i > 0; i--) {
+        Local *local = &self->locals.buffer[i - 1];
+        if (local->name == name)
+            return local;
+    }
+    return NULL;
+}
+
+// Get the index of the upvalue that captures the same variable as 'upvalue',
+// adding it if the function doesn't capture it already
+static MaybeCompileError add_upvalue(Compiler *self, Upvalue upvalue,
+                                     ASTIndex node,
+                                     /* out */ int32_t *index) {
+    for (size_t i = 0; i < self->upvalues.length; i++) {
+        Capture *existing = &self->upvalues.buffer[i].capture;
+        if (existing->kind == upvalue.capture.kind &&
+            existing->index == upvalue.capture.index) {
+            *index = (int32_t)i;
+            return NO_ERROR;
+        }
+    }
+
+    // The number of upvalues has to fit in a closure's 'upvalue_count' too
+    if (self->upvalues.length >= UINT16_MAX)
+        return node_error(self, COMPILE_ERROR_TOO_MANY_LOCALS, node);
+    *index = (int32_t)Upvalues_push(&self->upvalues, upvalue);
+    return NO_ERROR;
+}
+
+// Find the upvalue of the function being compiled which holds the free
+// variable 'name', capturing it from the enclosing functions (which may need
+// to capture it themselves) if needed. The index is -1 if 'name' isn't bound.
+static MaybeCompileError resolve_upvalue(Compiler *self, Symbol name,
+                                         ASTIndex node,
+                                         /* out */ int32_t *index) {
+    *index = -1;
+    if (self->enclosing == NULL)
+        return NO_ERROR;
+
+    Local *local = resolve_local(self->enclosing, name);
+    if (local != NULL) {
+        Upvalue upvalue = {
+            .capture = {.kind = CAPTURE_LOCAL, .index = local->slot},
+            .arity = local->arity,
+        };
+        return add_upvalue(self, upvalue, node, index);
+    }
+
+    int32_t enclosing_index;
+    TRY(resolve_upvalue(self->enclosing, name, node, &enclosing_index));
+    if (enclosing_index >= 0) {
+        Upvalue upvalue = {
+            .capture = {.kind = CAPTURE_UPVALUE,
+                        .index = (uint16_t)enclosing_index},
+            .arity = self->enclosing->upvalues.buffer[enclosing_index].arity,
+        };
+        return add_upvalue(self, upvalue, node, index);
+    }
+    return NO_ERROR;
+}
+
+// Load the native function called 'native' as a constant. Natives which take
+// no arguments are constants themselves, so they are called here instead.
+static MaybeCompileError compile_native(Compiler *self, const Native *native,
+                                        ASTIndex node,
+                                        /* out */ uint16_t *arity) {
+    *arity = native->arity;
+    if (native->arity == 0) {
+        RunResult result = native->function(self->heap, NULL);
+        ASSERT(result.tag == RESULT_OK, "Constant natives never fail");
+        return emit_constant(self, result.value.ok, node);
+    }
+
+    ObjNative *object = ObjNative_new(self->heap, native);
+    return emit_constant(self, Value_obj(&object->obj), node);
+}
+
+// Also produces the arity of the function bound to the identifier, if known
+static MaybeCompileError compile_ident(Compiler *self, ASTIndex index,
+                                       /* out */ uint16_t *arity) {
+    Symbol ident = get_node(self, index)->ident;
+    Local *local = resolve_local(self, ident);
+    if (local != NULL) {
+        emit_op(self, VM_OP_LOAD_LOCAL, 1);
+        emit(self, local->slot);
+        *arity = local->arity;
+        return NO_ERROR;
+    }
+
+    int32_t upvalue;
+    TRY(resolve_upvalue(self, ident, index, &upvalue));
+    if (upvalue < 0) {
+        // Natives are only used if nothing in scope shadows them
+        const Native *native = Native_lookup(ident);
+        if (native == NULL)
+            return node_error(self, COMPILE_ERROR_UNBOUND_NAME, index);
+        return compile_native(self, native, index, arity);
+    }
+
+    emit_op(self, VM_OP_LOAD_UPVALUE, 1);
+    emit(self, (uint16_t)upvalue);
+    *arity = self->upvalues.buffer[upvalue].arity;
+    return NO_ERROR;
+}
+
+// Compile a `fun` into a function constant, and emit code to create a closure
+// over it. 'name' is the name of the `let` binding it is the value of, if any,
+// which the function can use to refer to itself.
+//
+// `fun a b => ...` is parsed as a `fun` for each parameter nested inside each
+// other, which are all compiled into one function that takes every parameter
+// at once, whose arity is produced.
+static MaybeCompileError compile_abstraction(Compiler *self, ASTIndex index,
+                                             Symbol name,
+                                             /* out */ uint16_t *arity) {
+    Compiler function = {
+        .enclosing = self,
+        .ast = self->ast,
+        .types = self->types,
+        .heap = self->heap,
+        .chunk = Chunk_new(),
+        .locals = Locals_new(),
+        .upvalues = Upvalues_new(),
+        .stack_depth = 0,
+    };
+    Locals_push(&function.locals, (Local){.name = name, .slot = 0, .arity = 0});
+
+    // Bind each parameter to the slot after the previous one
+    struct AST_Abstraction *abstraction = &get_node(self, index)->abstraction;
+    while (true) {
+        size_t slot = function.locals.length;
+        if (slot > UINT16_MAX)
+            break;
+        Locals_push(&function.locals, (Local){.name = abstraction->argument,
+                                              .slot = (uint16_t)slot,
+                                              .arity = 0});
+
+        if (AST_tag(self->ast, abstraction->body) != AST_ABSTRACTION)
+            break;
+        abstraction = &get_node(self, abstraction->body)->abstraction;
+    }
+
+    MaybeCompileError maybe_error;
+    if (function.locals.length > UINT16_MAX) {
+        maybe_error = node_error(self, COMPILE_ERROR_TOO_MANY_LOCALS, index);
+    } else {
+        *arity = (uint16_t)(function.locals.length - 1);
+        function.locals.buffer[0].arity = *arity;
+        // The closure being called and its arguments
+        function.stack_depth = function.locals.length;
+        function.chunk.max_stack = function.stack_depth;
+        maybe_error = compile_return(&function, abstraction->body);
+    }
+    Locals_free(&function.locals);
+    if (maybe_error.tag == MAYBE_SOME) {
+        Chunk_free(&function.chunk);
+        Upvalues_free(&function.upvalues);
+        return maybe_error;
+    }
+
+    Captures captures = Captures_new();
+    for (size_t i = 0; i < function.upvalues.length; i++)
+        Captures_push(&captures, function.upvalues.buffer[i].capture);
+    Upvalues_free(&function.upvalues);
+
+    ObjFunction *object = ObjFunction_new(self->heap, function.chunk, *arity,
+                                          captures, Symbol_name(name));
+    uint16_t constant;
+    TRY(make_constant(self, Value_obj(&object->obj), index, &constant));
+    emit_op(self, VM_OP_CLOSURE, 1);
+    emit(self, constant);
+    return NO_ERROR;
+}
+
+// Whether the node at 'index' refers to the function being compiled, through
+// the name of the `let` binding that it is the value of
+static bool is_self_reference(Compiler *self, ASTIndex index) {
+    return self->enclosing != NULL &&
+           AST_tag(self->ast, index) == AST_IDENT &&
+           resolve_local(self, get_node(self, index)->ident) ==
+               &self->locals.buffer[0];
+}
+
+// `f a b c` is parsed as `((f a) b) c`, so the arguments are gathered from the
+// whole spine of applications. When the arity of 'f' is known, as many of them
+// as it takes are passed in a single call, and any left over are applied to
+// the result one at a time, otherwise each is applied one at a time.
+//
+// In tail position, the last call reuses the current frame, or turns into a
+// jump back to the start of the function when it calls the function itself
+// with all of its arguments.
+static MaybeCompileError compile_application(Compiler *self, ASTIndex index,
+                                             bool tail) {
+    // The arguments, in reverse order
+    AST_List arguments = AST_List_new();
+    AST_List_push(&arguments, get_node(self, index)->application.argument);
+    ASTIndex callee = get_node(self, index)->application.function;
+    while (AST_tag(self->ast, callee) == AST_APPLICATION) {
+        struct AST_Application *application =
+            &get_node(self, callee)->application;
+        AST_List_push(&arguments, application->argument);
+        callee = application->function;
+    }
+    ASTIndex *items = AST_List_items(&arguments);
+
+    uint16_t arity = 0;
+    MaybeCompileError maybe_error = NO_ERROR;
+    if (tail && is_self_reference(self, callee) &&
+        arguments.length == self->locals.buffer[0].arity) {
+        for (size_t i = arguments.length;
+             i > 0 && maybe_error.tag == MAYBE_NONE; i--)
+            maybe_error = compile_node(self, items[i - 1]);
+        emit_op(self, VM_OP_LOOP, -(int)arguments.length);
+        emit(self, (uint16_t)arguments.length);
+        AST_List_free(&arguments);
+        return maybe_error;
+    }
+
+    if (AST_tag(self->ast, callee) == AST_IDENT)
+        maybe_error = compile_ident(self, callee, &arity);
+    else if (AST_tag(self->ast, callee) == AST_ABSTRACTION)
+        maybe_error = compile_abstraction(self, callee, SYMBOL_NONE, &arity);
+    else
+        maybe_error = compile_node(self, callee);
+
+    size_t remaining = arguments.length;
+    while (maybe_error.tag == MAYBE_NONE && remaining > 0) {
+        // Passing fewer arguments than the function takes is fine, the VM
+        // creates a partial application
+        size_t count = arity == 0 ? 1 : arity < remaining ? arity : remaining;
+        for (size_t i = 0; i < count && maybe_error.tag == MAYBE_NONE; i++)
+            maybe_error = compile_node(self, items[--remaining]);
+        if (tail && remaining == 0) {
+            emit_op(self, VM_OP_TAIL_CALL, -(int)count);
+            emit(self, (uint16_t)count);
+            // Only reached if the call creates a partial application or
+            // calls a native
+            emit_op(self, VM_OP_RETURN, -1);
+        } else {
+            emit_op(self, VM_OP_CALL, -(int)count);
+            emit(self, (uint16_t)count);
+        }
+        // Nothing is known about the function that the call returns
+        arity = 0;
+    }
+
+    AST_List_free(&arguments);
+    return maybe_error;
+}
+
+// In tail position, the body's value is returned from the function
+static MaybeCompileError compile_let_in(Compiler *self, ASTIndex index,
+                                        bool tail) {
+    size_t bindings_length = AST_bindings_length(self->ast, index);
+    AST_BindingIter bindings = AST_bindings(self->ast, index);
+    AST_LetBind binding;
+    while (AST_next_binding(&bindings, &binding)) {
+        uint16_t arity = 0;
+        if (AST_tag(self->ast, binding.value) == AST_ABSTRACTION)
+            TRY(compile_abstraction(self, binding.value, binding.ident,
+                                    &arity));
+        else if (AST_tag(self->ast, binding.value) == AST_IDENT)
+            TRY(compile_ident(self, binding.value, &arity));
+        else
+            TRY(compile_node(self, binding.value));
+
+        // The value of the binding is now the top of the stack
+        size_t slot = self->stack_depth - 1;
+        if (slot > UINT16_MAX)
+            return compile_error(COMPILE_ERROR_TOO_MANY_LOCALS,
+                                 AST_LetBind_span(binding));
+
+        Locals_push(&self->locals, (Local){.name = binding.ident,
+                                           .slot = (uint16_t)slot,
+                                           .arity = arity});
+    }
+
+    ASTIndex body = get_node(self, index)->let_in.body;
+    if (tail) {
+        // Returning discards the bindings anyway
+        TRY(compile_return(self, body));
+        self->stack_depth -= bindings_length;
+        self->locals.length -= bindings_length;
+        return NO_ERROR;
+    }
+
+    TRY(compile_node(self, body));
+
+    // Discard the bindings from underneath the value of the body
+    if (bindings_length > 0) {
+        emit_op(self, VM_OP_SLIDE, -(int)bindings_length);
+        emit(self, (uint16_t)bindings_length);
+        self->locals.length -= bindings_length;
+    }
+    return NO_ERROR;
+}
+
+// In tail position, each branch returns its value from the function itself
+static MaybeCompileError compile_if_else(Compiler *self, ASTIndex index,
+                                         bool tail) {
+    TRY(compile_node(self, get_node(self, index)->if_else.condition));
+    ASTIndex *branches = AST_branches(self->ast, index);
+    ASTIndex then = branches[0], else_ = branches[1];
+
+    size_t else_jump = emit_jump(self, VM_OP_JUMP_IF_FALSE, -1);
+    if (tail) {
+        size_t stack_depth = self->stack_depth;
+        TRY(compile_return(self, then));
+        self->stack_depth = stack_depth;
+        TRY(patch_jump(self, else_jump, index));
+        return compile_return(self, else_);
+    }
+
+    TRY(compile_node(self, then));
+    size_t end_jump = emit_jump(self, VM_OP_JUMP, 0);
+
+    // Only one of the branches runs, so the else branch starts from the same
+    // stack depth as the then branch did
+    self->stack_depth--;
+    TRY(patch_jump(self, else_jump, index));
+    TRY(compile_node(self, else_));
+    return patch_jump(self, end_jump, index);
+}
+
+// Get the opcode for the binary operation at 'index', which skips checking the
+// types of the operands if they are known to both be ints or both be floats
+static OpCode binary_op_code(Compiler *self, ASTIndex index) {
+    struct AST_BinaryOp *binop = &get_node(self, index)->binary_op;
+    StaticType lhs = self->types->buffer[binop->lhs];
+    StaticType rhs = self->types->buffer[binop->rhs];
+    AST_BinOp op = AST_binop(self->ast, index);
+    OpCode generic = (OpCode)op;
+    if (lhs != rhs || (lhs != STATIC_TYPE_INT && lhs != STATIC_TYPE_FLOAT))
+        return generic;
+
+    OpCode first = lhs == STATIC_TYPE_INT ? VM_OP_ADD_INT : VM_OP_ADD_FLOAT;
+    switch (op) {
+    case BINOP_ADD:
+    case BINOP_SUB:
+    case BINOP_MUL:
+    case BINOP_DIV:
+        return first + (generic - VM_OP_ADD);
+    case BINOP_LT:
+    case BINOP_LEQ:
+    case BINOP_GT:
+    case BINOP_GEQ:
+        return first + (VM_OP_LT_INT - VM_OP_ADD_INT) + (generic - VM_OP_LT);
+    default:
+        return generic;
+    }
+}
+
+static MaybeCompileError compile_binary_op(Compiler *self, ASTIndex index) {
+    struct AST_BinaryOp *binop = &get_node(self, index)->binary_op;
+    switch (AST_binop(self->ast, index)) {
+    case BINOP_FNPIPE:
+        return node_error(self, COMPILE_ERROR_UNSUPPORTED, index);
+    default:
+        TRY(compile_node(self, binop->lhs));
+        TRY(compile_node(self, binop->rhs));
+        emit_op(self, binary_op_code(self, index), -1);
+        return NO_ERROR;
+    }
+}
+
+// The most items of a list literal that are on the stack at once, the items
+// are turned into lists this many at a time which are then concatenated
+constexpr size_t LIST_LITERAL_BATCH = 64;
+
+static MaybeCompileError compile_list(Compiler *self, ASTIndex index) {
+    AST_Items list = AST_list(self->ast, index);
+    size_t start = 0;
+    do {
+        size_t count = list.length - start < LIST_LITERAL_BATCH
+                           ? list.length - start
+                           : LIST_LITERAL_BATCH;
+        for (size_t i = start; i < start + count; i++)
+            TRY(compile_node(self, list.buffer[i]));
+        emit_op(self, VM_OP_LIST, 1 - (int)count);
+        emit(self, (uint16_t)count);
+        if (start > 0)
+            emit_op(self, VM_OP_CONCAT, -1);
+        start += count;
+    } while (start < list.length);
+    return NO_ERROR;
+}
+
+static MaybeCompileError compile_node(Compiler *self, ASTIndex index) {
+    ASTData *node = get_node(self, index);
+    switch (AST_tag(self->ast, index)) {
+    case AST_LITERAL:
+        return compile_literal(self, index);
+    case AST_IDENT: {
+        uint16_t arity;
+        return compile_ident(self, index, &arity);
+    }
+    case AST_LET_IN:
+        return compile_let_in(self, index, false);
+    case AST_PRINT:
+        TRY(compile_node(self, node->print.expr));
+        emit_op(self, VM_OP_PRINT, 0);
+        return NO_ERROR;
+    case AST_IF_ELSE:
+        return compile_if_else(self, index, false);
+    case AST_UNARY_OP:
+        TRY(compile_node(self, node->unary_op.operand));
+        emit_op(self, (OpCode)node->unary_op.op, 0);
+        return NO_ERROR;
+    case AST_BINARY_OP:
+        return compile_binary_op(self, index);
+    case AST_ABSTRACTION: {
+        uint16_t arity;
+        return compile_abstraction(self, index, SYMBOL_NONE, &arity);
+    }
+    case AST_APPLICATION:
+        return compile_application(self, index, false);
+    case AST_LIST:
+        return compile_list(self, index);
+    }
+    UNREACHABLE;
+}
+
+// Compile the node at 'index' in tail position, returning its value from the
+// function being compiled
+static MaybeCompileError compile_return(Compiler *self, ASTIndex index) {
+    switch (AST_tag(self->ast, index)) {
+    case AST_LET_IN:
+        return compile_let_in(self, index, true);
+    case AST_IF_ELSE:
+        return compile_if_else(self, index, true);
+    case AST_APPLICATION:
+        return compile_application(self, index, true);
+    default:
+        TRY(compile_node(self, index));
+        emit_op(self, VM_OP_RETURN, -1);
+        return NO_ERROR;
+    }
+}
+
+CompileResult compile(AST *ast, ASTIndex root, Heap *heap) {
+    StaticTypes types = infer_types(ast, root);
+    Compiler compiler = {
+        .enclosing = NULL,
+        .ast = ast,
+        .types = &types,
+        .heap = heap,
+        .chunk = Chunk_new(),
+        .locals = Locals_new(),
+        .upvalues = Upvalues_new(),
+        .stack_depth = 0,
+    };
+
+    MaybeCompileError maybe_error = compile_return(&compiler, root);
+    Locals_free(&compiler.locals);
+    // The top-level expression has no free variables to capture
+    Upvalues_free(&compiler.upvalues);
+    StaticTypes_free(&types);
+    if (maybe_error.tag == MAYBE_SOME) {
+        Chunk_free(&compiler.chunk);
+        return (CompileResult){.tag = RESULT_ERR,
+                               .value = {.err = maybe_error.some}};
+    }
+    return (CompileResult){.tag = RESULT_OK, .value = {.ok = compiler.chunk}};
+}
+
+void CompileError_print_diag(CompileError error, String file_name,
+                             String source, FILE *stream) {
+    fputs("\x1b[31;1mError\x1b[0m: ", stream);
+    switch (error.tag) {
+    case COMPILE_ERROR_UNBOUND_NAME:
+        fputs("unbound name\n", stream);
+        break;
+    case COMPILE_ERROR_UNSUPPORTED:
+        fputs("unsupported expression\n", stream);
+        break;
+    case COMPILE_ERROR_TOO_MANY_CONSTANTS:
+        fputs("too many constants\n", stream);
+        break;
+    case COMPILE_ERROR_TOO_MANY_LOCALS:
+        fputs("too many locals\n", stream);
+        break;
+    case COMPILE_ERROR_JUMP_TOO_LONG:
+        fputs("jump too long\n", stream);
+        break;
+    }
+    Diagnostic_print_snippet(file_name, source, error.span, stream);
+    switch (error.tag) {
+    case COMPILE_ERROR_UNBOUND_NAME:
+        fputc('\'', stream);
+        String_write((String){.buffer = source.buffer + error.span.start,
+                              .length = error.span.end - error.span.start},
+                     stream);
+        fputs("' is not defined", stream);
+        break;
+    case COMPILE_ERROR_UNSUPPORTED:
+        fputs("the compiler does not support this expression yet", stream);
+        break;
+    case COMPILE_ERROR_TOO_MANY_CONSTANTS:
+        fputs("a chunk can only contain up to 65536 constants", stream);
+        break;
+    case COMPILE_ERROR_TOO_MANY_LOCALS:
+        fputs("the stack can only address up to 65536 slots", stream);
+        break;
+    case COMPILE_ERROR_JUMP_TOO_LONG:
+        fputs("a branch can only span up to 65535 words of bytecode", stream);
+        break;
+    }
+    fputc('\n', stream);
 }
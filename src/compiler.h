@@ -2,19 +2,16 @@
 #define CLAM_COMPILER_H
 
 #include <stdint.h>
+#include <stdio.h>
 
 #include "ast.h"
+#include "chunk.h"
 #include "maybe.h"
+#include "object.h"
+#include "result.h"
 #include "vec.h"
 #include "vm.h"
 
-DECL_VEC_HEADER(uint16_t, Code)
-
-typedef struct Chunk {
-    Values constants;
-    Code code;
-} Chunk;
-
 typedef struct NameError {
     Span location;
     ValueType got;
@@ -23,6 +20,30 @@ typedef struct NameError {
 
 CREATE_MAYBE(NameError, MaybeNameError);
 
-MaybeNameError resolve_names(ASTVec arena, ASTIndex root);
+MaybeNameError resolve_names(const AST *ast, ASTIndex root);
+
+typedef struct CompileError {
+    enum CompileErrorTag {
+        COMPILE_ERROR_UNBOUND_NAME,
+        COMPILE_ERROR_UNSUPPORTED,
+        COMPILE_ERROR_TOO_MANY_CONSTANTS,
+        COMPILE_ERROR_TOO_MANY_LOCALS,
+        COMPILE_ERROR_JUMP_TOO_LONG,
+    } tag;
+    Span span;
+} CompileError;
+
+// Generate an error diagnostic message from a `CompileError`
+void CompileError_print_diag(CompileError error, String file_name,
+                             String source, FILE *stream);
+
+CREATE_MAYBE(CompileError, MaybeCompileError);
+
+DEF_RESULT(Chunk, CompileError, Compile);
+
+// Compile the expression at 'root' into a chunk of stack-based bytecode which
+// returns the value of the expression, allocating any constant objects in
+// 'heap'
+CompileResult compile(AST *ast, ASTIndex root, Heap *heap);
 
 #endif
@@ -0,0 +1,81 @@
+#include <math.h>
+#include <stdio.h>
+
+#include "diagnostic.h"
+
+typedef struct {
+    size_t line_num;
+    size_t line_start;
+    size_t line_end;
+} LineInfo;
+
+static LineInfo get_line_nums(String source, size_t span_start) {
+    LineInfo result = {.line_num = 1, .line_start = 0};
+
+    bool on_line = false;
+    for (size_t i = 0; i < source.length; i++) {
+        char c = source.buffer[i];
+        if (i == span_start)
+            on_line = true;
+        else if (c == '\n') {
+            if (on_line) {
+                result.line_end = i;
+                break;
+            }
+            result.line_num++;
+            result.line_start = i + 1;
+        } else if (c == '\0') {
+            if (on_line)
+                result.line_end = i;
+        }
+    }
+
+    return result;
+}
+
+static inline void write_repeat(char c, size_t n, FILE *stream) {
+    for (size_t i = 0; i < n; i++)
+        fputc(c, stream);
+}
+
+static inline void write_num(size_t n, FILE *stream) {
+    if (n / 10)
+        write_num(n / 10, stream);
+    fputc((int)n % 10 + '0', stream);
+}
+
+void Diagnostic_print_snippet(String file_name, String source, Span span,
+                              FILE *stream) {
+    LineInfo line_info = get_line_nums(source, span.start);
+    size_t num_digits = (size_t)(log10((double)line_info.line_num) + 1.0);
+    write_repeat(' ', num_digits + 2, stream);
+    fputs("┌─[", stream);
+    String_write(file_name, stream);
+    fputc(':', stream);
+    write_num(line_info.line_num, stream);
+    fputc(':', stream);
+    write_num(span.start - line_info.line_start, stream);
+    fputs("]\n", stream);
+    write_repeat(' ', num_digits + 2, stream);
+    fputs("│\n", stream);
+    fputc(' ', stream);
+    write_num(line_info.line_num, stream);
+    fputs(" │ ", stream);
+    String_write((String){.buffer = source.buffer + line_info.line_start,
+                          .length = span.start - line_info.line_start},
+                 stream);
+    String_write((String){.buffer = source.buffer + span.start,
+                          .length = span.end - span.start},
+                 stream);
+    String_write((String){.buffer = source.buffer + span.end,
+                          .length = line_info.line_end - span.end},
+                 stream);
+    fputc('\n', stream);
+    write_repeat(' ', num_digits + 2, stream);
+    fputs("│", stream);
+    write_repeat(' ', span.start - line_info.line_start + 1, stream);
+    write_repeat('^', span.end - span.start, stream);
+    fputc('\n', stream);
+    write_repeat(' ', num_digits + 4 + span.start - line_info.line_start,
+                 stream);
+}
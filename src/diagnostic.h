@@ -0,0 +1,15 @@
+#ifndef CLAM_DIAGNOSTIC_H
+#define CLAM_DIAGNOSTIC_H
+
+#include <stdio.h>
+
+#include "common.h"
+#include "string.h"
+
+// Write the location of `span` and the line of `source` it occurs on with the
+// span underlined, leaving the stream indented to line up with the start of the
+// span so that the caller can follow up with a message
+void Diagnostic_print_snippet(String file_name, String source, Span span,
+                              FILE *stream);
+
+#endif
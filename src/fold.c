@@ -0,0 +1,317 @@
+#include <math.h>
+
+#include "fold.h"
+#include "vm_ops.h"
+
+// A variable in scope, and its value if it is a literal that can be
+// substituted into its uses
+typedef struct Constant {
+    Symbol name;
+    bool known;
+    // The data of the literal node, which can be shared between nodes since
+    // whatever it refers to is never changed
+    ASTData value;
+} Constant;
+
+DEF_VEC_T(Constant, Constants)
+
+// Stores constant folding state
+typedef struct Folder {
+    AST *ast;
+    // The variables currently in scope, innermost last, which mirrors how the
+    // compiler resolves names
+    Constants scope;
+    // The bindings that are kept in each `let` being folded (nested ones above
+    // the ones they're nested in), which make up a new run of bindings for it
+    AST_LetBindVec kept;
+} Folder;
+
+static ASTIndex fold(Folder *self, ASTIndex index);
+
+// Folding never adds nodes, so pointers to them stay valid, but it does add
+// extra words (for floats and bindings), so pointers to those don't
+static inline ASTData *get_node(Folder *self, ASTIndex index) {
+    return &self->ast->data[index];
+}
+
+static inline bool is_literal(Folder *self, ASTIndex index,
+                              AST_LiteralTag tag) {
+    return AST_tag(self->ast, index) == AST_LITERAL &&
+           get_node(self, index)->literal.tag == tag;
+}
+
+static inline bool is_number(AST_Literal *literal) {
+    return literal->tag == LITERAL_INT || literal->tag == LITERAL_FLOAT;
+}
+
+// Pre-condition: `is_number(literal)`
+static inline double as_number(AST_Literal *literal) {
+    return literal->tag == LITERAL_INT ? (double)literal->value.integer
+                                       : literal->value.real;
+}
+
+static inline AST_Literal bool_literal(bool boolean) {
+    return (AST_Literal){.tag = LITERAL_BOOL, .value = {.boolean = boolean}};
+}
+
+static inline AST_Literal int_literal(int32_t integer) {
+    return (AST_Literal){.tag = LITERAL_INT, .value = {.integer = integer}};
+}
+
+static inline AST_Literal float_literal(double real) {
+    return (AST_Literal){.tag = LITERAL_FLOAT, .value = {.real = real}};
+}
+
+// Replace the node at 'index' with the literal node whose data is 'literal',
+// keeping its start
+static inline void replace_with_literal(Folder *self, ASTIndex index,
+                                        ASTData literal) {
+    self->ast->tags[index] = AST_LITERAL;
+    self->ast->data[index] = literal;
+}
+
+// Matches the semantics of Value_eq
+static bool literal_eq(AST_Literal *a, AST_Literal *b) {
+    if (is_number(a) && is_number(b)) {
+        if (a->tag == LITERAL_INT && b->tag == LITERAL_INT)
+            return a->value.integer == b->value.integer;
+        else
+            return as_number(a) == as_number(b);
+    } else if (a->tag != b->tag) {
+        return false;
+    }
+
+    switch (a->tag) {
+    case LITERAL_UNIT:
+        return true;
+    case LITERAL_BOOL:
+        return a->value.boolean == b->value.boolean;
+    case LITERAL_STRING:
+        return String_eq(a->value.string, b->value.string);
+    default:
+        UNREACHABLE;
+    }
+}
+
+// Evaluate 'op' on two literals, returning false if it can't be done without
+// failing, in which case it is left for the VM to report
+static bool fold_binary_op(AST_BinOp op, AST_Literal *lhs, AST_Literal *rhs,
+                           /* out */ AST_Literal *result) {
+    bool ints = lhs->tag == LITERAL_INT && rhs->tag == LITERAL_INT;
+    bool numbers = is_number(lhs) && is_number(rhs);
+    int32_t a = lhs->value.integer, b = rhs->value.integer;
+    switch (op) {
+    case BINOP_ADD:
+    case BINOP_SUB:
+    case BINOP_MUL:
+    case BINOP_DIV:
+    case BINOP_MOD:
+        if (ints) {
+            if ((op == BINOP_DIV || op == BINOP_MOD) && b == 0)
+                return false;
+            *result = int_literal(op == BINOP_ADD   ? wrapping_add(a, b)
+                                  : op == BINOP_SUB ? wrapping_sub(a, b)
+                                  : op == BINOP_MUL ? wrapping_mul(a, b)
+                                  : op == BINOP_DIV ? wrapping_div(a, b)
+                                                    : wrapping_mod(a, b));
+        } else if (numbers) {
+            double x = as_number(lhs), y = as_number(rhs);
+            *result = float_literal(op == BINOP_ADD   ? x + y
+                                    : op == BINOP_SUB ? x - y
+                                    : op == BINOP_MUL ? x * y
+                                    : op == BINOP_DIV ? x / y
+                                                      : fmod(x, y));
+        } else {
+            return false;
+        }
+        return true;
+    case BINOP_LT:
+    case BINOP_LEQ:
+    case BINOP_GT:
+    case BINOP_GEQ: {
+        if (!numbers)
+            return false;
+        // Comparing ints as doubles is exact
+        double x = as_number(lhs), y = as_number(rhs);
+        *result = bool_literal(op == BINOP_LT    ? x < y
+                               : op == BINOP_LEQ ? x <= y
+                               : op == BINOP_GT  ? x > y
+                                                 : x >= y);
+        return true;
+    }
+    case BINOP_AND:
+    case BINOP_OR:
+        if (lhs->tag != LITERAL_BOOL || rhs->tag != LITERAL_BOOL)
+            return false;
+        *result = bool_literal(op == BINOP_AND
+                                   ? lhs->value.boolean && rhs->value.boolean
+                                   : lhs->value.boolean || rhs->value.boolean);
+        return true;
+    case BINOP_EQ:
+        *result = bool_literal(literal_eq(lhs, rhs));
+        return true;
+    case BINOP_NEQ:
+        *result = bool_literal(!literal_eq(lhs, rhs));
+        return true;
+    case BINOP_FNPIPE:
+    case BINOP_APPEND:
+    case BINOP_CONCAT:
+        return false;
+    }
+    UNREACHABLE;
+}
+
+static bool fold_unary_op(AST_UnOp op, AST_Literal *operand,
+                          /* out */ AST_Literal *result) {
+    switch (op) {
+    case UNOP_NOT:
+        if (operand->tag != LITERAL_BOOL)
+            return false;
+        *result = bool_literal(!operand->value.boolean);
+        return true;
+    case UNOP_NEGATE:
+        if (operand->tag == LITERAL_INT)
+            *result = int_literal(wrapping_sub(0, operand->value.integer));
+        else if (operand->tag == LITERAL_FLOAT)
+            *result = float_literal(-operand->value.real);
+        else
+            return false;
+        return true;
+    }
+    UNREACHABLE;
+}
+
+// 'name' is the name of the `let` binding that the function is the value of,
+// which the function can use to refer to itself
+static void fold_abstraction(Folder *self, ASTIndex index, Symbol name) {
+    size_t saved_scope = self->scope.length;
+    Constants_push(&self->scope, (Constant){.name = name, .known = false});
+    struct AST_Abstraction *abstraction = &get_node(self, index)->abstraction;
+    Constants_push(&self->scope, (Constant){.name = abstraction->argument,
+                                            .known = false});
+    abstraction->body = fold(self, abstraction->body);
+    self->scope.length = saved_scope;
+}
+
+static ASTIndex fold_let_in(Folder *self, ASTIndex index) {
+    size_t saved_scope = self->scope.length;
+    size_t first_kept = self->kept.length;
+    AST_BindingIter bindings = AST_bindings(self->ast, index);
+    AST_LetBind binding;
+    while (AST_next_binding(&bindings, &binding)) {
+        if (AST_tag(self->ast, binding.value) == AST_ABSTRACTION)
+            fold_abstraction(self, binding.value, binding.ident);
+        else
+            binding.value = fold(self, binding.value);
+
+        if (AST_tag(self->ast, binding.value) == AST_LITERAL) {
+            Constants_push(&self->scope,
+                           (Constant){.name = binding.ident,
+                                      .known = true,
+                                      .value = *get_node(self, binding.value)});
+        } else {
+            Constants_push(&self->scope,
+                           (Constant){.name = binding.ident, .known = false});
+            AST_LetBindVec_push(&self->kept, binding);
+        }
+    }
+    size_t kept = self->kept.length - first_kept;
+    ASTIndex run = AST_push_run(self->ast, self->kept.buffer + first_kept,
+                                kept, 0);
+    self->kept.length = first_kept;
+
+    struct AST_LetInData *let_in = &get_node(self, index)->let_in;
+    let_in->bindings = run;
+    ASTIndex body = fold(self, let_in->body);
+    self->scope.length = saved_scope;
+    if (kept == 0)
+        return body;
+    let_in->body = body;
+    return index;
+}
+
+static ASTIndex fold(Folder *self, ASTIndex index) {
+    ASTData *node = get_node(self, index);
+    switch (AST_tag(self->ast, index)) {
+    case AST_LITERAL:
+        return index;
+    case AST_IDENT:
+        for (size_t i = self->scope.length; i > 0; i--) {
+            Constant *constant = &self->scope.buffer[i - 1];
+            if (constant->name == node->ident) {
+                if (constant->known)
+                    replace_with_literal(self, index, constant->value);
+                break;
+            }
+        }
+        return index;
+    case AST_LIST:
+        for (size_t i = 0; i < AST_list(self->ast, index).length; i++) {
+            ASTIndex item = fold(self, AST_list(self->ast, index).buffer[i]);
+            AST_list(self->ast, index).buffer[i] = item;
+        }
+        return index;
+    case AST_LET_IN:
+        return fold_let_in(self, index);
+    case AST_ABSTRACTION:
+        fold_abstraction(self, index, SYMBOL_NONE);
+        return index;
+    case AST_APPLICATION: {
+        struct AST_Application *application = &node->application;
+        application->function = fold(self, application->function);
+        application->argument = fold(self, application->argument);
+        return index;
+    }
+    case AST_PRINT:
+        node->print.expr = fold(self, node->print.expr);
+        return index;
+    case AST_IF_ELSE: {
+        ASTIndex condition = fold(self, node->if_else.condition);
+        node->if_else.condition = condition;
+        if (is_literal(self, condition, LITERAL_BOOL)) {
+            bool taken = AST_literal(self->ast, condition).value.boolean;
+            return fold(self, AST_branches(self->ast, index)[taken ? 0 : 1]);
+        }
+        ASTIndex then = fold(self, AST_branches(self->ast, index)[0]);
+        ASTIndex else_ = fold(self, AST_branches(self->ast, index)[1]);
+        AST_branches(self->ast, index)[0] = then;
+        AST_branches(self->ast, index)[1] = else_;
+        return index;
+    }
+    case AST_UNARY_OP: {
+        struct AST_UnaryOp *unary_op = &node->unary_op;
+        unary_op->operand = fold(self, unary_op->operand);
+        if (AST_tag(self->ast, unary_op->operand) != AST_LITERAL)
+            return index;
+        AST_Literal operand = AST_literal(self->ast, unary_op->operand), result;
+        if (fold_unary_op(unary_op->op, &operand, &result))
+            replace_with_literal(self, index,
+                                 AST_literal_data(self->ast, result));
+        return index;
+    }
+    case AST_BINARY_OP: {
+        struct AST_BinaryOp *binop = &node->binary_op;
+        binop->lhs = fold(self, binop->lhs);
+        binop->rhs = fold(self, binop->rhs);
+        if (AST_tag(self->ast, binop->lhs) != AST_LITERAL ||
+            AST_tag(self->ast, binop->rhs) != AST_LITERAL)
+            return index;
+        AST_Literal lhs = AST_literal(self->ast, binop->lhs);
+        AST_Literal rhs = AST_literal(self->ast, binop->rhs), result;
+        if (fold_binary_op(AST_binop(self->ast, index), &lhs, &rhs, &result))
+            replace_with_literal(self, index,
+                                 AST_literal_data(self->ast, result));
+        return index;
+    }
+    }
+    UNREACHABLE;
+}
+
+ASTIndex fold_constants(AST *ast, ASTIndex root) {
+    Folder folder = {
+        .ast = ast, .scope = Constants_new(), .kept = AST_LetBindVec_new()};
+    ASTIndex result = fold(&folder, root);
+    Constants_free(&folder.scope);
+    AST_LetBindVec_free(&folder.kept);
+    return result;
+}
@@ -0,0 +1,17 @@
+#ifndef CLAM_FOLD_H
+#define CLAM_FOLD_H
+
+#include "ast.h"
+
+// Evaluate whatever can be evaluated ahead of time in the expression at 'root'
+// by rewriting the nodes in 'ast', returning the index of the rewritten
+// expression (which may differ from 'root'):
+//
+// * Operations whose operands are all literals become literals, unless they
+//   would fail at runtime (e.g. integer division by zero), so the error still
+//   happens when the program runs
+// * `if` expressions with literal conditions become the branch that is taken
+// * `let` bindings to literals are substituted into their uses and removed
+ASTIndex fold_constants(AST *ast, ASTIndex root);
+
+#endif
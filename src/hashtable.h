@@ -7,193 +7,582 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "src/memory.h"
 #include "string.h"
 
-constexpr double TABLE_MAX_LOAD_FACTOR = 0.75;
+// The tables here are Swiss tables: open-addressing hash tables where each
+// slot has a control byte saying whether it is empty, deleted (a tombstone) or
+// full, and a full slot's control byte holds the low 7 bits of its key's hash.
+// Probing loads a whole group of control bytes at once and matches them all
+// against the hash in a handful of instructions, so keys are only compared for
+// the slots whose bits match, which is almost always only the right one.
+//
+// Groups are 16 bytes matched with SSE2 where it's available, and otherwise 8
+// bytes matched with plain 64-bit arithmetic (SWAR).
+
+constexpr uint8_t TABLE_CTRL_EMPTY = 0x80;
+constexpr uint8_t TABLE_CTRL_DELETED = 0xfe;
+// The control bytes of full slots only ever have these bits set
+constexpr uint8_t TABLE_CTRL_HASH_MASK = 0x7f;
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+
+constexpr size_t TABLE_GROUP_WIDTH = 16;
+// Matches have a bit for each slot
+constexpr unsigned TABLE_GROUP_SHIFT = 0;
+
+typedef __m128i TableGroup;
+
+static inline TableGroup TableGroup_load(const uint8_t *ctrl) {
+    return _mm_loadu_si128((const __m128i *)ctrl);
+}
+
+// A mask of the slots in 'group' whose control byte is 'byte'
+static inline uint64_t TableGroup_match(TableGroup group, uint8_t byte) {
+    return (uint32_t)_mm_movemask_epi8(
+        _mm_cmpeq_epi8(group, _mm_set1_epi8((char)byte)));
+}
+
+static inline uint64_t TableGroup_match_empty(TableGroup group) {
+    return TableGroup_match(group, TABLE_CTRL_EMPTY);
+}
+
+// Only empty and deleted slots have the top bit of their control byte set
+static inline uint64_t TableGroup_match_empty_or_deleted(TableGroup group) {
+    return (uint32_t)_mm_movemask_epi8(group);
+}
+
+#else
+
+constexpr size_t TABLE_GROUP_WIDTH = 8;
+// Matches have the top bit of each slot's byte
+constexpr unsigned TABLE_GROUP_SHIFT = 3;
+
+constexpr uint64_t TABLE_LSBS = 0x0101010101010101;
+constexpr uint64_t TABLE_MSBS = 0x8080808080808080;
+
+typedef uint64_t TableGroup;
+
+static inline TableGroup TableGroup_load(const uint8_t *ctrl) {
+    TableGroup group;
+    memcpy(&group, ctrl, sizeof(group));
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    // The first slot has to be in the low byte
+    group = __builtin_bswap64(group);
+#endif
+    return group;
+}
+
+// Sets the top bit of every byte of 'group' that equals 'byte', along with
+// the occasional false positive, which is fine since keys are compared anyway
+static inline uint64_t TableGroup_match(TableGroup group, uint8_t byte) {
+    uint64_t x = group ^ (TABLE_LSBS * byte);
+    return (x - TABLE_LSBS) & ~x & TABLE_MSBS;
+}
+
+// Empty slots are the only ones with the top bit set and the second lowest bit
+// clear
+static inline uint64_t TableGroup_match_empty(TableGroup group) {
+    return group & ~(group << 6) & TABLE_MSBS;
+}
+
+static inline uint64_t TableGroup_match_empty_or_deleted(TableGroup group) {
+    return group & TABLE_MSBS;
+}
+
+#endif
+
+// The smallest capacity that a table allocates
+constexpr size_t TABLE_MIN_CAPACITY = 16;
+
+// Tables with at least this many slots are resized incrementally: the new
+// arrays are allocated straight away, but the entries are moved over a few at
+// a time by each operation that follows, with lookups checking both sets of
+// arrays in the meantime. That way no single insert has to move a big table.
+constexpr size_t TABLE_INCREMENTAL_MIN_CAPACITY = 1024;
+// How many old slots each operation moves during an incremental resize, where
+// anything over 2 finishes before the new arrays can fill up
+constexpr size_t TABLE_MIGRATE_STEP = TABLE_GROUP_WIDTH;
+// How many of the spare control bytes each operation sets to empty. Spares are
+// twice the capacity and there are at least 7/16 of the capacity inserts
+// before the next resize, so anything over 5 has it ready in time.
+constexpr size_t TABLE_CLEAR_STEP = 2 * TABLE_GROUP_WIDTH;
+
+// Tables are always resized in one go if 'CLAM_TABLE_ONESHOT_RESIZE' is
+// defined, which is only useful for comparing the two (see bench/rehash.c)
+#ifndef CLAM_TABLE_ONESHOT_RESIZE
+#define TABLE_RESIZE_MODE "incremental"
+constexpr bool TABLE_INCREMENTAL_RESIZE = true;
+#else
+#define TABLE_RESIZE_MODE "one-shot"
+constexpr bool TABLE_INCREMENTAL_RESIZE = false;
+#endif
+
+// The index within its group of the first slot in the non-zero 'match'
+static inline size_t table_match_first(uint64_t match) {
+#if defined(__GNUC__)
+    return (size_t)__builtin_ctzll(match) >> TABLE_GROUP_SHIFT;
+#else
+    size_t index = 0;
+    while ((match & 1) == 0) {
+        match >>= 1;
+        index++;
+    }
+    return index >> TABLE_GROUP_SHIFT;
+#endif
+}
+
+// Mixes every bit of 'word' into a 32-bit hash, with the MurmurHash3 finaliser
+static inline uint32_t hash_word(uint64_t word) {
+    word ^= word >> 33;
+    word *= 0xff51afd7ed558ccd;
+    word ^= word >> 33;
+    word *= 0xc4ceb9fe1a85ec53;
+    word ^= word >> 33;
+    return (uint32_t)word;
+}
+
+// A fast non-cryptographic hash, which mixes in a word at a time rather than a
+// byte at a time and finishes with 'hash_word'. The bytes left over after the
+// last whole word are read with overlapping loads, since a variable-length
+// memcpy() would be a call to the library version.
+static inline uint32_t hash_string(String string) {
+    constexpr uint64_t multiplier = 0x9e3779b97f4a7c15;
+    const char *bytes = string.buffer;
+    size_t length = string.length;
+    uint64_t hash = (uint64_t)length * multiplier;
+    for (; length > sizeof(uint64_t); length -= sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, bytes, sizeof(word));
+        hash = (hash ^ word) * multiplier;
+        hash ^= hash >> 32;
+        bytes += sizeof(uint64_t);
+    }
+
+    uint64_t word = 0;
+    if (string.length >= sizeof(uint64_t)) {
+        // Re-reads some of the previous word if this one is partial
+        memcpy(&word, string.buffer + string.length - sizeof(word),
+               sizeof(word));
+    } else if (length >= sizeof(uint32_t)) {
+        uint32_t low, high;
+        memcpy(&low, bytes, sizeof(low));
+        memcpy(&high, bytes + length - sizeof(high), sizeof(high));
+        word = (uint64_t)high << 32 | low;
+    } else if (length != 0) {
+        word = (uint64_t)(uint8_t)bytes[0] << 16 |
+               (uint64_t)(uint8_t)bytes[length / 2] << 8 |
+               (uint8_t)bytes[length - 1];
+    }
+    hash = (hash ^ word) * multiplier;
+    hash ^= hash >> 32;
+    return hash_word(hash);
+}
+
+// Whether two keys are equal, which takes a shortcut for keys that share a
+// buffer, such as the ones that were used to insert them
+static inline bool table_key_eq(String a, String b) {
+    return a.length == b.length &&
+           (a.buffer == b.buffer || memcmp(a.buffer, b.buffer, a.length) == 0);
+}
+
+// The control byte of a slot holding a key with 'hash'
+static inline uint8_t table_ctrl_byte(uint32_t hash) {
+    return (uint8_t)(hash & TABLE_CTRL_HASH_MASK);
+}
+
+// The control bytes are followed by a copy of the first group's, so that a
+// group can be loaded starting from any slot, which this keeps up to date
+static inline void table_set_ctrl(uint8_t *ctrl, size_t capacity, size_t index,
+                                  uint8_t byte) {
+    ctrl[index] = byte;
+    if (index < TABLE_GROUP_WIDTH)
+        ctrl[capacity + index] = byte;
+}
+
+// The most full slots a table can have, where the 1/8 that are always left
+// empty guarantee that every probe sequence ends
+static inline size_t table_max_load(size_t capacity) {
+    return capacity - capacity / 8;
+}
+
+// Find the first empty or deleted slot in the probe sequence of 'hash', which
+// visits every group since the capacity is a power of two
+//
+// Pre-condition: `capacity != 0`
+static inline size_t table_find_insert_slot(const uint8_t *ctrl,
+                                            size_t capacity, uint32_t hash) {
+    size_t mask = capacity - 1;
+    size_t position = (hash >> 7) & mask;
+    for (size_t stride = TABLE_GROUP_WIDTH;; stride += TABLE_GROUP_WIDTH) {
+        uint64_t match =
+            TableGroup_match_empty_or_deleted(TableGroup_load(ctrl + position));
+        if (match != 0)
+            return (position + table_match_first(match)) & mask;
+        position = (position + stride) & mask;
+    }
+}
 
-#define CREATE_ENTRY(T, Name)                                                  \
+#define CREATE_TABLE(T, Name)                                                  \
     typedef struct Name##Table_Entry {                                         \
         String key;                                                            \
+        uint32_t hash;                                                         \
         T value;                                                               \
-    } Name##Table_Entry;
-
-#define CREATE_TABLE(T, Name)                                                  \
+    } Name##Table_Entry;                                                       \
+                                                                               \
     typedef struct Name##Table {                                               \
-        size_t count;                                                          \
-        size_t capacity;                                                       \
+        /* 'capacity' + 'TABLE_GROUP_WIDTH' control bytes */                   \
+        uint8_t *ctrl;                                                         \
         Name##Table_Entry *entries;                                            \
+        /* Either 0 or a power of two of at least 'TABLE_MIN_CAPACITY' */      \
+        size_t capacity;                                                       \
+        /* Includes the entries that are still in the old arrays */            \
+        size_t count;                                                          \
+        /* How many more empty slots can be filled before growing */           \
+        size_t growth_left;                                                    \
+        /* The arrays being moved out of by an incremental resize, where */    \
+        /* 'old_capacity' is 0 unless one is under way */                      \
+        uint8_t *old_ctrl;                                                     \
+        Name##Table_Entry *old_entries;                                        \
+        size_t old_capacity;                                                   \
+        /* The old slots before this one have all been moved */                \
+        size_t migrated;                                                       \
+        /* The control bytes for the next resize of an incrementally */        \
+        /* resized table, which are set to empty a few at a time ahead of */   \
+        /* it. There are 'spare_capacity' + 'TABLE_GROUP_WIDTH' of them, of */ \
+        /* which the first 'spare_cleared' are done. */                        \
+        uint8_t *spare_ctrl;                                                   \
+        size_t spare_capacity;                                                 \
+        size_t spare_cleared;                                                  \
     } Name##Table;
 
-#define TABLE_NEW_SIG(T, Name) Name##Table Name##Table_new();
+#define TABLE_NEW_SIG(T, Name) Name##Table Name##Table_new(void);
 #define TABLE_NEW(T, Name)                                                     \
-    Name##Table Name##Table_new() {                                            \
+    Name##Table Name##Table_new(void) {                                        \
         return (Name##Table){                                                  \
-            .count = 0,                                                        \
-            .capacity = 0,                                                     \
+            .ctrl = NULL,                                                      \
             .entries = NULL,                                                   \
+            .capacity = 0,                                                     \
+            .count = 0,                                                        \
+            .growth_left = 0,                                                  \
+            .old_ctrl = NULL,                                                  \
+            .old_entries = NULL,                                               \
+            .old_capacity = 0,                                                 \
+            .migrated = 0,                                                     \
+            .spare_ctrl = NULL,                                                \
+            .spare_capacity = 0,                                               \
+            .spare_cleared = 0,                                                \
         };                                                                     \
     }
 
+#define TABLE_FREE_ARRAYS(T, Name)                                             \
+    static void Name##Table_free_arrays(uint8_t *ctrl,                         \
+                                        Name##Table_Entry *entries,            \
+                                        size_t capacity) {                     \
+        if (capacity != 0) {                                                   \
+            reallocate_as(MEMORY_HASHTABLE, ctrl,                              \
+                          capacity + TABLE_GROUP_WIDTH, 0);                    \
+            reallocate_as(MEMORY_HASHTABLE, entries,                           \
+                          sizeof(Name##Table_Entry) * capacity, 0);            \
+        }                                                                      \
+    }
+
 #define TABLE_FREE_SIG(T, Name) void Name##Table_free(Name##Table *table);
 #define TABLE_FREE(T, Name)                                                    \
     void Name##Table_free(Name##Table *table) {                                \
-        free(table->entries);                                                  \
+        Name##Table_free_arrays(table->ctrl, table->entries, table->capacity); \
+        Name##Table_free_arrays(table->old_ctrl, table->old_entries,           \
+                                table->old_capacity);                          \
+        if (table->spare_capacity != 0)                                        \
+            reallocate_as(MEMORY_HASHTABLE, table->spare_ctrl,                 \
+                          table->spare_capacity + TABLE_GROUP_WIDTH, 0);       \
         *table = Name##Table_new();                                            \
     }
 
-static uint32_t fnv_1a_hash(String string) {
-    uint32_t hash = 2166136261u;
-    for (uint32_t i = 0; i < string.length; i++) {
-        hash ^= (uint8_t)string.buffer[i];
-        hash *= 16777619;
+// Finds the entry whose key equals 'key' in one set of arrays, or returns NULL
+// if there isn't one. The cached hashes are compared first, so keys rarely
+// need comparing unless they're equal.
+#define TABLE_PROBE(T, Name)                                                   \
+    static Name##Table_Entry *Name##Table_probe(                               \
+        const uint8_t *ctrl, Name##Table_Entry *entries, size_t capacity,      \
+        String key, uint32_t hash) {                                           \
+        if (capacity == 0)                                                     \
+            return NULL;                                                       \
+                                                                               \
+        size_t mask = capacity - 1;                                            \
+        size_t position = (hash >> 7) & mask;                                  \
+        for (size_t stride = TABLE_GROUP_WIDTH;;                               \
+             stride += TABLE_GROUP_WIDTH) {                                    \
+            TableGroup group = TableGroup_load(ctrl + position);               \
+            uint64_t match = TableGroup_match(group, table_ctrl_byte(hash));   \
+            for (; match != 0; match &= match - 1) {                           \
+                Name##Table_Entry *entry =                                     \
+                    &entries[(position + table_match_first(match)) & mask];    \
+                if (entry->hash == hash && table_key_eq(entry->key, key))      \
+                    return entry;                                              \
+            }                                                                  \
+            if (TableGroup_match_empty(group) != 0)                            \
+                return NULL;                                                   \
+            position = (position + stride) & mask;                             \
+        }                                                                      \
     }
-    return hash;
-}
 
-#define TABLE_ENTRY_FIND_SIG(T, Name)                                          \
-    static Name##Table_Entry *Name##Table_Entry_find(                          \
-        Name##Table_Entry *entries, size_t capacity, String key);
+// Finds the entry whose key equals 'key', which is in the old arrays if an
+// incremental resize hasn't got round to moving it yet
+#define TABLE_LOOKUP(T, Name)                                                  \
+    static Name##Table_Entry *Name##Table_lookup(Name##Table *table,           \
+                                                 String key, uint32_t hash) {  \
+        Name##Table_Entry *entry = Name##Table_probe(                          \
+            table->ctrl, table->entries, table->capacity, key, hash);          \
+        if (entry == NULL)                                                     \
+            entry = Name##Table_probe(table->old_ctrl, table->old_entries,     \
+                                      table->old_capacity, key, hash);         \
+        return entry;                                                          \
+    }
 
-// Pre-conditions:
-//
-// * `key` is an interned string
-//
-#define TABLE_ENTRY_FIND(T, Name)                                              \
-    static Name##Table_Entry *Name##Table_Entry_find(                          \
-        Name##Table_Entry *entries, size_t capacity, String key) {             \
-        uint32_t index = fnv_1a_hash(key) % capacity;                          \
-        Name##Table_Entry *tombstone = NULL;                                   \
-        while (true) {                                                         \
-            Name##Table_Entry *entry = &entries[index];                        \
-            if (entry->key.buffer == NULL) {                                   \
-                if (entry->key.length == 0) {                                  \
-                    return tombstone != NULL ? tombstone : entry;              \
-                } else {                                                       \
-                    if (tombstone == NULL)                                     \
-                        tombstone = entry;                                     \
-                }                                                              \
-            } else if (entry->key.buffer == key.buffer) {                      \
-                return entry;                                                  \
-            }                                                                  \
+// Moves the entries in the next 'slots' old slots into the current arrays,
+// finishing the resize once there are none left. There's always room for them
+// since it was set aside when the resize started.
+#define TABLE_MIGRATE(T, Name)                                                 \
+    static void Name##Table_migrate(Name##Table *table, size_t slots) {        \
+        size_t end = table->migrated + slots;                                  \
+        if (end > table->old_capacity)                                         \
+            end = table->old_capacity;                                         \
+        for (size_t i = table->migrated; i < end; i++) {                       \
+            if (table->old_ctrl[i] & TABLE_CTRL_EMPTY)                         \
+                continue;                                                      \
+            Name##Table_Entry *entry = &table->old_entries[i];                 \
+            size_t index =                                                     \
+                table_find_insert_slot(table->ctrl, table->capacity,           \
+                                       entry->hash);                           \
+            table_set_ctrl(table->ctrl, table->capacity, index,                \
+                           table_ctrl_byte(entry->hash));                      \
+            table->entries[index] = *entry;                                    \
+            /* A tombstone rather than an empty slot, so that probes for */    \
+            /* the entries that haven't moved yet don't stop here */           \
+            table_set_ctrl(table->old_ctrl, table->old_capacity, i,            \
+                           TABLE_CTRL_DELETED);                                \
+        }                                                                      \
                                                                                \
-            index = (index + 1) % capacity;                                    \
+        table->migrated = end;                                                 \
+        if (end == table->old_capacity) {                                      \
+            Name##Table_free_arrays(table->old_ctrl, table->old_entries,       \
+                                    table->old_capacity);                      \
+            table->old_ctrl = NULL;                                            \
+            table->old_entries = NULL;                                         \
+            table->old_capacity = 0;                                           \
+            table->migrated = 0;                                               \
         }                                                                      \
     }
 
-#define TABLE_ADJUST_CAPACITY_SIG(T, Name)                                     \
-    static void Name##Table_adjust_capacity(Name##Table *table,                \
-                                            size_t capacity);
+// Sets the spare control bytes before 'end' to empty, if they aren't already
+#define TABLE_CLEAR_SPARE(T, Name)                                             \
+    static void Name##Table_clear_spare(Name##Table *table, size_t end) {      \
+        if (end > table->spare_capacity + TABLE_GROUP_WIDTH)                   \
+            end = table->spare_capacity + TABLE_GROUP_WIDTH;                   \
+        if (end <= table->spare_cleared)                                       \
+            return;                                                            \
+        memset(table->spare_ctrl + table->spare_cleared, TABLE_CTRL_EMPTY,     \
+               end - table->spare_cleared);                                    \
+        table->spare_cleared = end;                                            \
+    }
 
-// Resizes a table by simply allocating a new array of entries and copying over
-// the old ones.
-#define TABLE_ADJUST_CAPACITY(T, Name)                                         \
-    static void Name##Table_adjust_capacity(Name##Table *table,                \
-                                            size_t capacity) {                 \
-        Name##Table_Entry *entries =                                           \
-            reallocate(NULL, sizeof(Name##Table_Entry) * capacity);            \
-        for (size_t i = 0; i < capacity; i++) {                                \
-            entries[i].key = (String){.buffer = NULL, .length = 0};            \
-        }                                                                      \
-        table->count = 0;                                                      \
-        for (size_t i = 0; i < table->capacity; i++) {                         \
-            Name##Table_Entry *entry = &table->entries[i];                     \
-            if (entry->key.buffer != NULL) {                                   \
-                Name##Table_Entry *dest =                                      \
-                    Name##Table_Entry_find(entries, capacity, entry->key);     \
+// The share of the work of resizing a big table that every operation does,
+// moving some entries out of the old arrays and clearing some of the spare
+// control bytes for the next resize
+#define TABLE_STEP(T, Name)                                                    \
+    static inline void Name##Table_step(Name##Table *table) {                  \
+        if (table->old_capacity != 0)                                          \
+            Name##Table_migrate(table, TABLE_MIGRATE_STEP);                    \
+        if (table->spare_capacity != 0)                                        \
+            Name##Table_clear_spare(table,                                     \
+                                    table->spare_cleared + TABLE_CLEAR_STEP);  \
+    }
+
+// Switches to new arrays with room for 'capacity' entries, leaving out the
+// tombstones. Small tables move their entries over straight away, and big
+// ones move them a few at a time in every operation that follows. Big tables
+// also take their control bytes from the spare, which was cleared ahead of
+// time, rather than clearing them all here, then set aside the next spare.
+//
+// Pre-condition: no resize is under way
+#define TABLE_RESIZE(T, Name)                                                  \
+    static void Name##Table_resize(Name##Table *table, size_t capacity) {      \
+        table->old_ctrl = table->ctrl;                                         \
+        table->old_entries = table->entries;                                   \
+        table->old_capacity = table->capacity;                                 \
+        table->migrated = 0;                                                   \
                                                                                \
-                dest->key = entry->key;                                        \
-                dest->value = entry->value;                                    \
-                table->count++;                                                \
-            }                                                                  \
+        if (table->spare_capacity != 0) {                                      \
+            /* The spare is twice the old capacity, so it's only too big */    \
+            /* when the resize just clears out tombstones */                   \
+            Name##Table_clear_spare(table, capacity + TABLE_GROUP_WIDTH);      \
+            table->ctrl = table->spare_ctrl;                                   \
+            if (capacity < table->spare_capacity)                              \
+                table->ctrl = reallocate_as(                                   \
+                    MEMORY_HASHTABLE, table->ctrl,                             \
+                    table->spare_capacity + TABLE_GROUP_WIDTH,                 \
+                    capacity + TABLE_GROUP_WIDTH);                             \
+        } else {                                                               \
+            table->ctrl = reallocate_as(MEMORY_HASHTABLE, NULL, 0,             \
+                                        capacity + TABLE_GROUP_WIDTH);         \
+            memset(table->ctrl, TABLE_CTRL_EMPTY,                              \
+                   capacity + TABLE_GROUP_WIDTH);                              \
+        }                                                                      \
+        table->spare_ctrl = NULL;                                              \
+        table->spare_capacity = 0;                                             \
+        table->spare_cleared = 0;                                              \
+        if (TABLE_INCREMENTAL_RESIZE &&                                        \
+            capacity * 2 >= TABLE_INCREMENTAL_MIN_CAPACITY) {                  \
+            table->spare_capacity = capacity * 2;                              \
+            table->spare_ctrl =                                                \
+                reallocate_as(MEMORY_HASHTABLE, NULL, 0,                       \
+                              table->spare_capacity + TABLE_GROUP_WIDTH);      \
         }                                                                      \
-        reallocate(table->entries, 0);                                         \
-        table->entries = entries;                                              \
+        table->entries =                                                       \
+            reallocate_as(MEMORY_HASHTABLE, NULL, 0,                           \
+                          sizeof(Name##Table_Entry) * capacity);               \
         table->capacity = capacity;                                            \
+        /* Room is set aside for the entries that haven't moved yet */         \
+        table->growth_left = table_max_load(capacity) - table->count;          \
+                                                                               \
+        if (table->old_capacity != 0 &&                                        \
+            (!TABLE_INCREMENTAL_RESIZE ||                                      \
+             capacity < TABLE_INCREMENTAL_MIN_CAPACITY))                       \
+            Name##Table_migrate(table, table->old_capacity);                   \
     }
 
 #define TABLE_SET_SIG(T, Name)                                                 \
-    bool Name##Table_set(Name##Table *table, String key, int value);
+    bool Name##Table_set(Name##Table *table, String key, T value);
 
 // Sets the value corresponding to `key` to `value`, overwriting an existing
 // value or creating a new entry. This function will return true if a new entry
 // was created.
 #define TABLE_SET(T, Name)                                                     \
-    bool Name##Table_set(Name##Table *table, String key, int value) {          \
-        if (table->count + 1 > table->capacity * TABLE_MAX_LOAD_FACTOR) {      \
-            size_t capacity = grow_allocation(table->capacity);                \
-            Name##Table_adjust_capacity(table, capacity);                      \
+    bool Name##Table_set(Name##Table *table, String key, T value) {            \
+        Name##Table_step(table);                                               \
+        uint32_t hash = hash_string(key);                                      \
+        Name##Table_Entry *existing = Name##Table_lookup(table, key, hash);    \
+        if (existing != NULL) {                                                \
+            existing->value = value;                                           \
+            return false;                                                      \
         }                                                                      \
-        Name##Table_Entry *entry =                                             \
-            Name##Table_Entry_find(table->entries, table->capacity, key);      \
-        bool key_is_new = entry->key.buffer == NULL;                           \
-        if (key_is_new && entry->key.length == 0)                              \
-            table->count++;                                                    \
                                                                                \
-        entry->key = key;                                                      \
-        entry->value = value;                                                  \
-        return key_is_new;                                                     \
+        size_t index = 0;                                                      \
+        if (table->capacity != 0)                                              \
+            index =                                                            \
+                table_find_insert_slot(table->ctrl, table->capacity, hash);    \
+        /* Reusing a tombstone doesn't use up an empty slot */                 \
+        if (table->capacity == 0 ||                                            \
+            (table->ctrl[index] == TABLE_CTRL_EMPTY &&                         \
+             table->growth_left == 0)) {                                       \
+            /* The last resize has to finish before another can start */       \
+            if (table->old_capacity != 0)                                      \
+                Name##Table_migrate(table, table->old_capacity);               \
+            /* If the table is mostly tombstones, clearing them out is */      \
+            /* enough, otherwise it needs to grow */                           \
+            size_t capacity = table->capacity == 0 ? TABLE_MIN_CAPACITY        \
+                              : table->count * 2 < table_max_load(             \
+                                                       table->capacity)        \
+                                  ? table->capacity                            \
+                                  : table->capacity * 2;                       \
+            Name##Table_resize(table, capacity);                               \
+            index =                                                            \
+                table_find_insert_slot(table->ctrl, table->capacity, hash);    \
+        }                                                                      \
+                                                                               \
+        if (table->ctrl[index] == TABLE_CTRL_EMPTY)                            \
+            table->growth_left--;                                              \
+        table_set_ctrl(table->ctrl, table->capacity, index,                    \
+                       table_ctrl_byte(hash));                                 \
+        table->entries[index] =                                                \
+            (Name##Table_Entry){.key = key, .hash = hash, .value = value};     \
+        table->count++;                                                        \
+        return true;                                                           \
+    }
+
+#define TABLE_FIND_SIG(T, Name)                                                \
+    T *Name##Table_find(Name##Table *table, String key);
+
+// Returns a pointer to the value corresponding to `key`, or NULL if there
+// isn't one. Since lookups also move entries during an incremental resize, the
+// pointer only stays valid until the table is next used.
+#define TABLE_FIND(T, Name)                                                    \
+    T *Name##Table_find(Name##Table *table, String key) {                      \
+        Name##Table_step(table);                                               \
+        Name##Table_Entry *entry =                                             \
+            Name##Table_lookup(table, key, hash_string(key));                  \
+        return entry != NULL ? &entry->value : NULL;                           \
     }
 
 #define TABLE_GET_SIG(T, Name)                                                 \
-    bool Name##Table_get(Name##Table *table, String key, /* out */ int *value);
+    bool Name##Table_get(Name##Table *table, String key, /* out */ T *value);
 
 // Attempts to find the entry identified by `key`, returning `false` if not
 // found, else, returning `true` and writing the corresponding value to `value`.
 #define TABLE_GET(T, Name)                                                     \
     bool Name##Table_get(Name##Table *table, String key,                       \
-                         /* out */ int *value) {                               \
-        if (table->count == 0)                                                 \
-            return false;                                                      \
-                                                                               \
-        Name##Table_Entry *entry =                                             \
-            Name##Table_Entry_find(table->entries, table->capacity, key);      \
-        if (entry->key.buffer != NULL) {                                       \
-            *value = entry->value;                                             \
-            return true;                                                       \
-        } else                                                                 \
+                         /* out */ T *value) {                                 \
+        T *found = Name##Table_find(table, key);                               \
+        if (found == NULL)                                                     \
             return false;                                                      \
+        *value = *found;                                                       \
+        return true;                                                           \
     }
 
 #define TABLE_DELETE_SIG(T, Name)                                              \
     bool Name##Table_delete(Name##Table *table, String key);
 
-// Attempts to delete an entry, replacing it with a tombstone entry. Returns
-// `false` if the entry does not exist, and `true` if it was deleted.
+// Attempts to delete an entry, replacing it with a tombstone. Returns `false`
+// if the entry does not exist, and `true` if it was deleted.
 #define TABLE_DELETE(T, Name)                                                  \
     bool Name##Table_delete(Name##Table *table, String key) {                  \
-        if (table->count == 0)                                                 \
-            return false;                                                      \
-                                                                               \
-        Name##Table_Entry *entry =                                             \
-            Name##Table_Entry_find(table->entries, table->capacity, key);      \
-        if (entry->key.buffer != NULL) {                                       \
-            entry->key = (String){.buffer = NULL, .length = 1};                \
-            return true;                                                       \
-        } else                                                                 \
-            return false;                                                      \
+        Name##Table_step(table);                                               \
+        uint32_t hash = hash_string(key);                                      \
+        Name##Table_Entry *entry = Name##Table_probe(                          \
+            table->ctrl, table->entries, table->capacity, key, hash);          \
+        if (entry != NULL) {                                                   \
+            table_set_ctrl(table->ctrl, table->capacity,                       \
+                           (size_t)(entry - table->entries),                   \
+                           TABLE_CTRL_DELETED);                                \
+        } else {                                                               \
+            entry = Name##Table_probe(table->old_ctrl, table->old_entries,     \
+                                      table->old_capacity, key, hash);         \
+            if (entry == NULL)                                                 \
+                return false;                                                  \
+            table_set_ctrl(table->old_ctrl, table->old_capacity,               \
+                           (size_t)(entry - table->old_entries),               \
+                           TABLE_CTRL_DELETED);                                \
+        }                                                                      \
+        table->count--;                                                        \
+        return true;                                                           \
     }
 
 #define DECL_TABLE(T, Name)                                                    \
-    CREATE_ENTRY(T, Name)                                                      \
     CREATE_TABLE(T, Name)                                                      \
     TABLE_NEW_SIG(T, Name)                                                     \
     TABLE_FREE_SIG(T, Name)                                                    \
-    TABLE_ENTRY_FIND_SIG(T, Name)                                              \
-    TABLE_ADJUST_CAPACITY_SIG(T, Name)                                         \
-    TABLE_SET_SIG(T, Name) TABLE_GET_SIG(T, Name) TABLE_DELETE_SIG(T, Name)
+    TABLE_SET_SIG(T, Name)                                                     \
+    TABLE_FIND_SIG(T, Name) TABLE_GET_SIG(T, Name) TABLE_DELETE_SIG(T, Name)
 
 #define DEF_TABLE(T, Name)                                                     \
     TABLE_NEW(T, Name)                                                         \
+    TABLE_FREE_ARRAYS(T, Name)                                                 \
     TABLE_FREE(T, Name)                                                        \
-    TABLE_ENTRY_FIND(T, Name)                                                  \
-    TABLE_ADJUST_CAPACITY(T, Name)                                             \
-    TABLE_SET(T, Name) TABLE_GET(T, Name) TABLE_DELETE(T, Name)
-
-CREATE_ENTRY(void *, String)
-CREATE_TABLE(void *, String)
+    TABLE_PROBE(T, Name)                                                       \
+    TABLE_LOOKUP(T, Name)                                                      \
+    TABLE_MIGRATE(T, Name)                                                     \
+    TABLE_CLEAR_SPARE(T, Name)                                                 \
+    TABLE_STEP(T, Name)                                                        \
+    TABLE_RESIZE(T, Name)                                                      \
+    TABLE_SET(T, Name)                                                         \
+    TABLE_FIND(T, Name) TABLE_GET(T, Name) TABLE_DELETE(T, Name)
 
-String StringTable_find(StringTable *table, String string, uint32_t hash);
+// The table behind the symbol interner (see "symbol.h"), which maps interned
+// names to their symbols
+DECL_TABLE(uint32_t, String)
 
 #endif /* CLAM_HASHTABLE_H */
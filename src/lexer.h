@@ -1,13 +1,14 @@
 #ifndef CLAM_LEXER_H
 #define CLAM_LEXER_H
 
+#include <stdint.h>
+
 #include "common.h"
-#include "maybe.h"
 #include "string.h"
 #include "vec.h"
 
 // An enumeration of the different kinds of tokens
-typedef enum {
+typedef enum TokenKind : uint8_t {
     /* KEYWORDS */
     TK_LET = 0,   // "let"
     TK_IN = 1,    // "in"
@@ -66,39 +67,95 @@ typedef enum {
     TK_EOF = 41,     // End Of File
 } TokenKind;
 
-// A singular token
+// A singular token. Only its start is stored, since the end is only needed
+// now and then and can be found by lexing the token again (see 'Token_span').
 typedef struct {
     TokenKind kind;
-    Span span;
+    uint32_t start;
 } Token;
 
-// Uninitialised if 'tag == MAYBE_NONE' and initialised if 'tag == MAYBE_SOME'
-typedef struct {
-    MaybeTag tag;
-    Token some;
-} MaybeToken;
-
 // Stores lexer state
 typedef struct {
     String source;
     size_t start;
     size_t current;
-    MaybeToken peeked;
 } Lexer;
 
 DECL_VEC_HEADER(Token, TokenVec)
+
+VEC_WITH_CAP_SIG(Token, TokenVec)
+VEC_BULK_SIG(Token, TokenVec)
 // clang-format off
 
-// Create a new lexer that operates on `source`
+// Create a new lexer that operates on `source`, which must be followed by a NUL
+// sentinel at `source.buffer[source.length]`
 Lexer Lexer_new(const String source);
 // clang-format on
 
-// Get the current peeked token
-Token *Lexer_peek_token(Lexer *lexer);
-
-// Scan the next token from `lexer->source`
+// Scan the next token from `lexer->source`, which ends at `lexer->current`
 Token Lexer_next_token(Lexer *lexer);
 
+// Scan all of `source` at once, ending with a `TK_EOF` token. Like with
+// `Lexer_new`, `source` must be followed by a NUL sentinel.
+TokenVec Lexer_tokenize(const String source);
+
+// Get the span of a token by lexing it again from its start
+Span Token_span(const String source, Token token);
+
+// An edit to a source, which replaced the bytes in `[start, old_end)` of the
+// old source with those in `[start, new_end)` of the new one
+typedef struct TextEdit {
+    size_t start;
+    size_t old_end;
+    size_t new_end;
+} TextEdit;
+
+// The tokens of a source that is being edited, kept in a gap buffer which
+// `Lexer_relex` moves to each edit, so that only the tokens between one edit
+// and the next are moved. The tokens after the gap store how far they start
+// from the end of the source instead of from its start, so that the tokens
+// after an edit don't change when it changes the source's length.
+typedef struct TokenGap {
+    Token *buffer;
+    size_t capacity;
+    // The number of tokens, not counting the gap
+    size_t length;
+    // The index of the first slot of the gap, which is also the index of the
+    // first token after it
+    size_t gap;
+    // The length of the source, which the tokens after the gap start from the
+    // end of
+    size_t source_length;
+} TokenGap;
+
+// Take over the tokens of `source`, as produced by `Lexer_tokenize`, with the
+// gap after the last one
+TokenGap TokenGap_new(TokenVec tokens, const String source);
+
+void TokenGap_free(TokenGap *tokens);
+
+// Get token `index`, counting the tokens before the gap but not the gap itself
+static inline Token TokenGap_get(const TokenGap *tokens, size_t index) {
+    if (index < tokens->gap)
+        return tokens->buffer[index];
+    Token token = tokens->buffer[index + tokens->capacity - tokens->length];
+    token.start = (uint32_t)(tokens->source_length - token.start);
+    return token;
+}
+
+// Which tokens `Lexer_relex` replaced: the `removed` old tokens from `first`
+// on, in place of which there are now `added` new ones
+typedef struct TokenSplice {
+    size_t first;
+    size_t removed;
+    size_t added;
+} TokenSplice;
+
+// Bring `tokens`, which were lexed from the source before `edit`, up to date
+// with `source`, the source after it. Only the tokens around the edit are lexed
+// again, and the ones after them are kept where they are, past the gap.
+TokenSplice Lexer_relex(TokenGap *tokens, const String source, TextEdit edit);
+
 // Convert a token kind to a string
 String TK_to_string(TokenKind kind);
 
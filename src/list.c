@@ -0,0 +1,311 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "hashtable.h"
+#include "list.h"
+
+// The most elements a chunk holds, so that every chunk in the tree apart from
+// ones left behind by a concatenation is this full
+constexpr uint32_t LIST_CHUNK = 32;
+// The capacity of a list's first tail, which doubles up to 'LIST_CHUNK' as it
+// is appended to so that short lists don't take up a whole chunk
+constexpr uint32_t LIST_TAIL_MIN = 4;
+// A tree of height h has at least fib(h + 2) - 1 chunks, so no tree that fits
+// in memory is this tall
+constexpr size_t LIST_MAX_HEIGHT = 96;
+
+// The capacity of a new tail that has to hold 'length' elements
+//
+// Pre-condition: `length <= LIST_CHUNK`
+static uint32_t tail_capacity(uint32_t length) {
+    uint32_t capacity = LIST_TAIL_MIN;
+    while (capacity < length)
+        capacity *= 2;
+    return capacity < LIST_CHUNK ? capacity : LIST_CHUNK;
+}
+
+static Obj *concat_node(Heap *heap, Obj *left, Obj *right) {
+    return &ObjListConcat_new(heap, left, right)->obj;
+}
+
+// Concatenates two subtrees whose heights differ by at most 2, rotating them
+// if they differ by 2 so that the result is balanced
+static Obj *balance(Heap *heap, Obj *left, Obj *right) {
+    uint8_t left_height = list_tree_height(left);
+    uint8_t right_height = list_tree_height(right);
+    if (left_height > right_height + 1) {
+        ObjListConcat *outer = (ObjListConcat *)left;
+        if (list_tree_height(outer->left) >= list_tree_height(outer->right)) {
+            return concat_node(heap, outer->left,
+                               concat_node(heap, outer->right, right));
+        }
+        ObjListConcat *inner = (ObjListConcat *)outer->right;
+        return concat_node(heap, concat_node(heap, outer->left, inner->left),
+                           concat_node(heap, inner->right, right));
+    }
+    if (right_height > left_height + 1) {
+        ObjListConcat *outer = (ObjListConcat *)right;
+        if (list_tree_height(outer->right) >= list_tree_height(outer->left)) {
+            return concat_node(heap, concat_node(heap, left, outer->left),
+                               outer->right);
+        }
+        ObjListConcat *inner = (ObjListConcat *)outer->left;
+        return concat_node(heap, concat_node(heap, left, inner->left),
+                           concat_node(heap, inner->right, outer->right));
+    }
+    return concat_node(heap, left, right);
+}
+
+// Concatenates two balanced subtrees, by walking down the side of the taller
+// one until the heights meet, so it takes time proportional to the difference
+// in their heights
+static Obj *join(Heap *heap, Obj *left, Obj *right) {
+    uint8_t left_height = list_tree_height(left);
+    uint8_t right_height = list_tree_height(right);
+    if (left_height > right_height + 1) {
+        ObjListConcat *concat = (ObjListConcat *)left;
+        return balance(heap, concat->left, join(heap, concat->right, right));
+    }
+    if (right_height > left_height + 1) {
+        ObjListConcat *concat = (ObjListConcat *)right;
+        return balance(heap, join(heap, left, concat->left), concat->right);
+    }
+    return concat_node(heap, left, right);
+}
+
+// A chunk holding exactly the elements of 'list's tail, which can go in a
+// tree since nothing can be appended to it in place
+//
+// Pre-condition: `list->tail_length > 0`
+static Obj *freeze_tail(Heap *heap, const ObjList *list) {
+    if (list->tail_length == list->tail->capacity)
+        return &list->tail->obj;
+
+    ObjListChunk *chunk = ObjListChunk_new(heap, list->tail_length);
+    memcpy(chunk->values, list->tail->values,
+           sizeof(Value) * list->tail_length);
+    chunk->length = list->tail_length;
+    return &chunk->obj;
+}
+
+// Returns a list of the elements of 'list' followed by the 'count' values in
+// 'values'
+static ObjList *append_values(Heap *heap, const ObjList *list,
+                              const Value *values, size_t count) {
+    Obj *tree = list->tree;
+    ObjListChunk *tail = list->tail;
+    uint32_t tail_length = list->tail_length;
+    size_t total = list->count + count;
+    while (count > 0) {
+        if (tail_length == LIST_CHUNK) {
+            tree = tree == NULL ? &tail->obj : join(heap, tree, &tail->obj);
+            tail = NULL;
+            tail_length = 0;
+        }
+
+        // Values can only go straight into the tail if no other list has
+        // already put values after this list's end, otherwise they would
+        // overwrite them
+        if (tail == NULL || tail_length != tail->length ||
+            tail->length == tail->capacity) {
+            size_t wanted = tail_length + count;
+            ObjListChunk *copy = ObjListChunk_new(
+                heap, tail_capacity(wanted < LIST_CHUNK ? (uint32_t)wanted
+                                                        : LIST_CHUNK));
+            if (tail_length > 0)
+                memcpy(copy->values, tail->values, sizeof(Value) * tail_length);
+            copy->length = tail_length;
+            tail = copy;
+        }
+
+        uint32_t room = tail->capacity - tail_length;
+        uint32_t taken = count < room ? (uint32_t)count : room;
+        memcpy(tail->values + tail_length, values, sizeof(Value) * taken);
+        tail->length += taken;
+        tail_length += taken;
+        values += taken;
+        count -= taken;
+    }
+    return ObjList_new(heap, total, tree, tail, tail_length);
+}
+
+ObjList *ObjList_of(Heap *heap, const Value *values, size_t count) {
+    ObjList empty = {.count = 0, .tree = NULL, .tail = NULL, .tail_length = 0};
+    return append_values(heap, &empty, values, count);
+}
+
+ObjList *ObjList_push(Heap *heap, ObjList *list, Value value) {
+    return append_values(heap, list, &value, 1);
+}
+
+static const ObjListChunk *first_chunk(const Obj *tree) {
+    while (tree->type == OBJ_LIST_CONCAT)
+        tree = ((const ObjListConcat *)tree)->left;
+    return (const ObjListChunk *)tree;
+}
+
+// Returns 'tree' with the 'count' values in 'values' added to the start of its
+// first chunk. The heights don't change, so nothing needs rebalancing.
+static Obj *prepend_to_first(Heap *heap, Obj *tree, const Value *values,
+                             uint32_t count) {
+    if (tree->type == OBJ_LIST_CONCAT) {
+        ObjListConcat *concat = (ObjListConcat *)tree;
+        return concat_node(
+            heap, prepend_to_first(heap, concat->left, values, count),
+            concat->right);
+    }
+
+    ObjListChunk *first = (ObjListChunk *)tree;
+    ObjListChunk *chunk = ObjListChunk_new(heap, count + first->length);
+    memcpy(chunk->values, values, sizeof(Value) * count);
+    memcpy(chunk->values + count, first->values, sizeof(Value) * first->length);
+    chunk->length = chunk->capacity;
+    return &chunk->obj;
+}
+
+ObjList *ObjList_concat(Heap *heap, ObjList *a, ObjList *b) {
+    if (a->count == 0)
+        return b;
+    if (b->count == 0)
+        return a;
+    // A short list is cheaper to append element by element than to graft on,
+    // and it doesn't leave a small chunk in the middle of the result
+    if (b->tree == NULL)
+        return append_values(heap, a, b->tail->values, b->tail_length);
+
+    // 'a's tail has to join the tree, so it's merged into 'b's first chunk if
+    // they fit in one, again to keep small chunks out of the middle
+    Obj *right = b->tree;
+    if (a->tail_length + first_chunk(right)->length <= LIST_CHUNK) {
+        right = prepend_to_first(heap, right, a->tail->values, a->tail_length);
+    } else {
+        right = join(heap, freeze_tail(heap, a), right);
+    }
+    Obj *tree = a->tree == NULL ? right : join(heap, a->tree, right);
+    return ObjList_new(heap, a->count + b->count, tree, b->tail,
+                       b->tail_length);
+}
+
+const Value *ObjList_get(const ObjList *list, size_t index) {
+    if (index >= list->count)
+        return NULL;
+
+    size_t tree_count = list->count - list->tail_length;
+    if (index >= tree_count)
+        return &list->tail->values[index - tree_count];
+
+    const Obj *node = list->tree;
+    while (node->type == OBJ_LIST_CONCAT) {
+        const ObjListConcat *concat = (const ObjListConcat *)node;
+        size_t left_count = list_tree_count(concat->left);
+        if (index < left_count) {
+            node = concat->left;
+        } else {
+            index -= left_count;
+            node = concat->right;
+        }
+    }
+    return &((const ObjListChunk *)node)->values[index];
+}
+
+// Visits the elements of a list in order, a chunk at a time
+typedef struct ListCursor {
+    const ObjList *list;
+    // The subtrees still to be visited, the next one last
+    const Obj *pending[LIST_MAX_HEIGHT];
+    size_t depth;
+    bool tail_visited;
+} ListCursor;
+
+static void ListCursor_init(ListCursor *self, const ObjList *list) {
+    self->list = list;
+    self->depth = 0;
+    if (list->tree != NULL)
+        self->pending[self->depth++] = list->tree;
+    self->tail_visited = list->tail_length == 0;
+}
+
+// Produces the next run of elements, or returns false if there are none left
+static bool ListCursor_next(ListCursor *self, /* out */ const Value **values,
+                            /* out */ size_t *length) {
+    if (self->depth > 0) {
+        const Obj *node = self->pending[--self->depth];
+        while (node->type == OBJ_LIST_CONCAT) {
+            const ObjListConcat *concat = (const ObjListConcat *)node;
+            self->pending[self->depth++] = concat->right;
+            node = concat->left;
+        }
+        const ObjListChunk *chunk = (const ObjListChunk *)node;
+        *values = chunk->values;
+        *length = chunk->length;
+        return true;
+    }
+    if (!self->tail_visited) {
+        self->tail_visited = true;
+        *values = self->list->tail->values;
+        *length = self->list->tail_length;
+        return true;
+    }
+    return false;
+}
+
+bool ObjList_eq(const ObjList *a, const ObjList *b) {
+    if (a->count != b->count)
+        return false;
+
+    // The lists can be chunked differently, so the runs of elements from each
+    // are consumed at their own pace
+    ListCursor a_cursor, b_cursor;
+    ListCursor_init(&a_cursor, a);
+    ListCursor_init(&b_cursor, b);
+    const Value *a_values = NULL, *b_values = NULL;
+    size_t a_length = 0, b_length = 0;
+    while (true) {
+        if (a_length == 0 && !ListCursor_next(&a_cursor, &a_values, &a_length))
+            return true;
+        // There are as many elements left in 'b' as in 'a'
+        if (b_length == 0)
+            ListCursor_next(&b_cursor, &b_values, &b_length);
+
+        size_t length = a_length < b_length ? a_length : b_length;
+        for (size_t i = 0; i < length; i++) {
+            if (!Value_eq(a_values[i], b_values[i]))
+                return false;
+        }
+        a_values += length;
+        b_values += length;
+        a_length -= length;
+        b_length -= length;
+    }
+}
+
+uint32_t ObjList_hash(const ObjList *list) {
+    uint32_t hash = hash_word(list->count);
+    ListCursor cursor;
+    ListCursor_init(&cursor, list);
+    const Value *values;
+    size_t length;
+    while (ListCursor_next(&cursor, &values, &length)) {
+        for (size_t i = 0; i < length; i++)
+            hash = hash_word((uint64_t)hash << 32 | Value_hash(values[i]));
+    }
+    return hash;
+}
+
+void ObjList_write(const ObjList *list, FILE *file) {
+    fputc('{', file);
+    ListCursor cursor;
+    ListCursor_init(&cursor, list);
+    const Value *values;
+    size_t length;
+    bool first = true;
+    while (ListCursor_next(&cursor, &values, &length)) {
+        for (size_t i = 0; i < length; i++) {
+            if (!first)
+                fputs(", ", file);
+            first = false;
+            Value_write(values[i], file);
+        }
+    }
+    fputc('}', file);
+}
@@ -0,0 +1,39 @@
+#ifndef CLAM_LIST_H
+#define CLAM_LIST_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "object.h"
+#include "value.h"
+
+// Immutable lists keep their elements in chunks of up to 32, which sit in a
+// height-balanced tree of concatenation nodes, apart from the last chunk (the
+// tail) which is kept out of the tree so that appending usually only touches
+// it. Appending is amortised O(1), concatenation and indexing are O(log n)
+// and iterating visits a chunk at a time rather than an element at a time.
+//
+// None of these collect garbage, so the lists passed in don't need to be
+// reachable from the roots for the duration of the call.
+
+// Returns a list of a copy of the 'count' values in 'values'
+ObjList *ObjList_of(Heap *heap, const Value *values, size_t count);
+
+// Returns 'list' with 'value' added to the end (`list :: value`)
+ObjList *ObjList_push(Heap *heap, ObjList *list, Value value);
+
+// Returns the elements of 'a' followed by those of 'b' (`a ++ b`)
+ObjList *ObjList_concat(Heap *heap, ObjList *a, ObjList *b);
+
+// Returns the element at 'index', or NULL if it is out of bounds
+const Value *ObjList_get(const ObjList *list, size_t index);
+
+// Whether both lists have equal elements in the same order
+bool ObjList_eq(const ObjList *a, const ObjList *b);
+
+// A hash of the elements, which doesn't depend on how they're chunked
+uint32_t ObjList_hash(const ObjList *list);
+
+void ObjList_write(const ObjList *list, FILE *file);
+
+#endif
@@ -1,15 +1,100 @@
+// mmap's anonymous mappings and madvise are outside of ISO C, so glibc hides
+// them under a strict -std=c23 unless they are asked for
+#define _DEFAULT_SOURCE
+
 #include <locale.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
 #include "ast.h"
+#include "compiler.h"
+#include "fold.h"
 #include "hashtable.h"
+#include "memory.h"
 #include "parser.h"
+#include "peephole.h"
+#include "register_compiler.h"
 #include "string.h"
+#include "symbol.h"
+#include "vm.h"
+
+// Scripts are memory-mapped where mmap can make anonymous mappings, and read
+// into a buffer everywhere else
+#if defined(__unix__) || defined(__APPLE__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#if !defined(MAP_ANONYMOUS) && defined(MAP_ANON)
+#define MAP_ANONYMOUS MAP_ANON
+#endif
+#ifdef MAP_ANONYMOUS
+#define CLAM_MMAP_SOURCES
+#endif
+#endif
 
 #define CLAM_VERSION_STRING "0.1.0"
 
+// Options set from the command line
+typedef struct Options {
+    // Which bytecode and VM loop to compile and run programs with
+    enum Backend {
+        BACKEND_STACK,
+        BACKEND_REGISTER,
+    } backend;
+    // Whether to report what the peephole optimiser did to stderr
+    bool opt_stats;
+    // Whether to report how much memory was used to stderr on exit
+    bool mem_stats;
+    // Whether to print a script's source before running it
+    bool echo;
+    // The script to run, or NULL to start the REPL
+    const char *path;
+} Options;
+
+void print_usage(void) {
+    puts("Usage: clam [options] [file]\n"
+         "Options:\n"
+         "  --backend=stack     Compile to stack bytecode (default)\n"
+         "  --backend=register  Compile to register bytecode (a prototype for\n"
+         "                      straight-line arithmetic: no functions,\n"
+         "                      calls, lists, ++ or ::)\n"
+         "  --opt-stats         Report how often each peephole fusion fired\n"
+         "  --mem-stats         Report memory usage by subsystem on exit\n"
+         "  --echo              Print the script's source before running it\n"
+         "  --help              Display this help message");
+}
+
+// Returns false if the arguments are invalid or help was requested
+bool parse_options(int argc, char **argv, /* out */ Options *options) {
+    *options = (Options){
+        .backend = BACKEND_STACK,
+        .opt_stats = false,
+        .mem_stats = false,
+        .echo = false,
+        .path = NULL,
+    };
+    for (int i = 1; i < argc; i++) {
+        const char *arg = argv[i];
+        if (strcmp(arg, "--backend=stack") == 0)
+            options->backend = BACKEND_STACK;
+        else if (strcmp(arg, "--backend=register") == 0)
+            options->backend = BACKEND_REGISTER;
+        else if (strcmp(arg, "--opt-stats") == 0)
+            options->opt_stats = true;
+        else if (strcmp(arg, "--mem-stats") == 0)
+            options->mem_stats = true;
+        else if (strcmp(arg, "--echo") == 0)
+            options->echo = true;
+        else if (strncmp(arg, "--", 2) == 0 || options->path != NULL)
+            return false;
+        else
+            options->path = arg;
+    }
+    return true;
+}
+
 // Ensure cmd.length > 2
 static inline bool match_rest(const String cmd, const char *rest) {
     // not using 'memcmp' because we want to stop at the null-terminator in
@@ -54,16 +139,69 @@ void run_cmd(const String cmd) {
     }
 }
 
-void run(const String source) {
-    Parser parser = Parser_new(STR("stdin"), source);
+void run(const Options *options, const String file_name,
+         const String source) {
+    // Memory is charged to whichever phase allocated it, so each phase's
+    // memory is also freed under its tag
+    set_memory_tag(MEMORY_PARSER);
+    Parser parser = Parser_new(file_name, source);
     ParseResult result = Parser_parse_expr(&parser);
     switch (result.tag) {
     case RESULT_OK: {
-        StringBuf sexpr = format_ast(&parser.ast_arena, result.value.ok);
+#ifdef DEBUG_MODE
+        StringBuf sexpr = format_ast(&parser.ast, result.value.ok);
         puts("Parser Output:");
         StringBuf_print(sexpr);
         putchar('\n');
         StringBuf_free(&sexpr);
+#endif
+        ASTIndex root = fold_constants(&parser.ast, result.value.ok);
+        Heap heap = Heap_new();
+        set_memory_tag(MEMORY_COMPILER);
+        CompileResult compiled =
+            options->backend == BACKEND_REGISTER
+                ? compile_registers(&parser.ast, root, &heap)
+                : compile(&parser.ast, root, &heap);
+        if (compiled.tag == RESULT_ERR) {
+            CompileError_print_diag(compiled.value.err, file_name, source,
+                                    stderr);
+            if (options->backend == BACKEND_REGISTER &&
+                compiled.value.err.tag == COMPILE_ERROR_UNSUPPORTED)
+                fputs("The register backend is a prototype for straight-line "
+                      "arithmetic; functions, calls, lists, ++ and :: need "
+                      "--backend=stack\n",
+                      stderr);
+            Heap_free(&heap);
+            break;
+        }
+
+        Chunk chunk = compiled.value.ok;
+        // Superinstructions only exist for the stack machine
+        if (options->backend == BACKEND_STACK) {
+            PeepholeStats stats = PeepholeStats_new();
+            peephole_optimise(&chunk, &stats);
+            if (options->opt_stats)
+                PeepholeStats_print(&stats, stderr);
+        }
+
+        set_memory_tag(MEMORY_VM);
+        VM vm = VM_new(&heap);
+        RunResult ran = options->backend == BACKEND_REGISTER
+                            ? VM_run_registers(&vm, &chunk)
+                            : VM_run(&vm, &chunk);
+        switch (ran.tag) {
+        case RESULT_OK:
+            Value_write(ran.value.ok, stdout);
+            putchar('\n');
+            break;
+        case RESULT_ERR:
+            RuntimeError_print(ran.value.err, stderr);
+            break;
+        }
+        VM_free(&vm);
+        Heap_free(&heap);
+        set_memory_tag(MEMORY_COMPILER);
+        Chunk_free(&chunk);
         break;
     }
     case RESULT_ERR: {
@@ -73,7 +211,9 @@ void run(const String source) {
     }
     }
 
+    set_memory_tag(MEMORY_PARSER);
     Parser_free(&parser);
+    set_memory_tag(MEMORY_OTHER);
 }
 
 StringBuf read_line(void) {
@@ -89,7 +229,7 @@ StringBuf read_line(void) {
     return str;
 }
 
-void repl(void) {
+void repl(const Options *options) {
     while (true) {
         fputs("\n$ ", stdout);
         fflush(stdout);
@@ -98,50 +238,164 @@ void repl(void) {
             run_cmd(
                 (String){.buffer = line.buffer + 1, .length = line.length - 1});
         } else {
-            run((String){.buffer = line.buffer, .length = line.length});
+            // The NUL that ends the line is left out of the source, since
+            // it's the lexer's sentinel
+            run(options, STR("stdin"),
+                (String){.buffer = line.buffer, .length = line.length - 1});
         }
         StringBuf_free(&line);
     }
 }
 
-void run_file(const char *path) {
-    FILE *file = fopen(path, "rb");
-    if (file == NULL) {
+// A script's source, followed by the NUL sentinel the lexer needs
+typedef struct SourceFile {
+    String source;
+    // How many bytes are mapped at 'source.buffer', or 0 if the source was
+    // read into 'buffer' instead
+    size_t mapped;
+    StringBuf buffer;
+} SourceFile;
+
+// Reads the file at 'path' into a buffer, followed by the sentinel. Used where
+// there's no mmap, and for files that can't be mapped.
+static bool SourceFile_read(const char *path, /* out */ SourceFile *file) {
+    FILE *stream = fopen(path, "rb");
+    if (stream == NULL)
+        return false;
+
+    StringBuf buffer = StringBuf_new();
+    char chunk[4096];
+    size_t bytes_read;
+    while ((bytes_read = fread(chunk, sizeof(char), sizeof(chunk), stream)) >
+           0)
+        StringBuf_push_string(
+            &buffer, (String){.buffer = chunk, .length = bytes_read});
+    fclose(stream);
+
+    StringBuf_push(&buffer, '\0');
+    *file = (SourceFile){
+        .source = {.buffer = buffer.buffer, .length = buffer.length - 1},
+        .mapped = 0,
+        .buffer = buffer,
+    };
+    return true;
+}
+
+#ifdef CLAM_MMAP_SOURCES
+// Maps the file at 'path' into memory instead of copying it. The tail of the
+// last page after the end of the file reads as zeroes, which is the sentinel,
+// except when the file fills its last page exactly, so the file is mapped over
+// a zeroed anonymous mapping with room for one more byte.
+static bool SourceFile_map(const char *path, /* out */ SourceFile *file) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode)) {
+        close(fd);
+        return SourceFile_read(path, file);
+    }
+
+    size_t size = (size_t)info.st_size;
+    size_t page_size = (size_t)sysconf(_SC_PAGESIZE);
+    size_t mapped = (size + page_size) / page_size * page_size;
+    char *buffer = mmap(NULL, mapped, PROT_READ, MAP_PRIVATE | MAP_ANONYMOUS,
+                        -1, 0);
+    if (buffer == MAP_FAILED) {
+        close(fd);
+        return SourceFile_read(path, file);
+    }
+
+    if (size > 0) {
+        int flags = MAP_PRIVATE | MAP_FIXED;
+#ifdef MAP_POPULATE
+        // The lexer is about to read every page, so fault them all in now
+        flags |= MAP_POPULATE;
+#endif
+        if (mmap(buffer, size, PROT_READ, flags, fd, 0) == MAP_FAILED) {
+            munmap(buffer, mapped);
+            close(fd);
+            return SourceFile_read(path, file);
+        }
+#ifdef MADV_SEQUENTIAL
+        madvise(buffer, size, MADV_SEQUENTIAL);
+#endif
+    }
+    close(fd);
+
+    *file = (SourceFile){
+        .source = {.buffer = buffer, .length = size},
+        .mapped = mapped,
+        .buffer = StringBuf_new(),
+    };
+    return true;
+}
+#endif
+
+static bool SourceFile_open(const char *path, /* out */ SourceFile *file) {
+#ifdef CLAM_MMAP_SOURCES
+    return SourceFile_map(path, file);
+#else
+    return SourceFile_read(path, file);
+#endif
+}
+
+static void SourceFile_close(SourceFile *file) {
+#ifdef CLAM_MMAP_SOURCES
+    if (file->mapped != 0) {
+        munmap((void *)file->source.buffer, file->mapped);
+        return;
+    }
+#endif
+    StringBuf_free(&file->buffer);
+}
+
+void run_file(const Options *options) {
+    const char *path = options->path;
+    SourceFile file;
+    if (!SourceFile_open(path, &file)) {
         fputs("Could not access file ", stdout);
         puts(path);
         return;
     }
 
-    fseek(file, 0L, SEEK_END);
-    size_t file_size = ftell(file);
-    rewind(file);
-
-    char *buffer = (char *)malloc(file_size + 1);
-    size_t bytes_read = fread(buffer, sizeof(char), file_size, file);
-    buffer[bytes_read] = '\0';
-
-    fclose(file);
-    String f = {.buffer = buffer, .length = file_size};
-    String_print(f);
-    run(f);
-    free(buffer);
+    if (options->echo)
+        String_print(file.source);
+    run(options, (String){.buffer = path, .length = strlen(path)},
+        file.source);
+    SourceFile_close(&file);
 }
 
 DECL_TABLE(int, Int)
 DEF_TABLE(int, Int)
 
+static void print_mem_stats(void) {
+    MemoryStats_print(memory_stats(), stderr);
+}
+
 int main(int argc, char **argv) {
     // Windows doesn't print the table-building characters correctly from my
     // testing, in both Windows Terminal and Wezterm, so I have to manually set
     // the locale to a UTF-8 one.
     setlocale(LC_ALL, ".UTF-8");
-    if (argc > 1) {
-        const char *path = argv[1];
-        run_file(path);
+    Options options;
+    if (!parse_options(argc, argv, &options)) {
+        print_usage();
+        return 1;
+    }
+    // The REPL exits from wherever the user quits it, so the report is
+    // printed on the way out
+    if (options.mem_stats)
+        atexit(print_mem_stats);
+
+    if (options.path != NULL) {
+        run_file(&options);
+        Symbol_free_all();
     } else {
         puts("Clam REPL v" CLAM_VERSION_STRING "\n"
              "Type ':help' for more information");
-        repl();
+        repl(&options);
     }
 
     // Some hashtable testing lol
@@ -0,0 +1,363 @@
+#include <string.h>
+
+#include "hashtable.h"
+#include "map.h"
+
+// How many bits of a key's hash each level of the trie branches on
+constexpr unsigned MAP_LEVEL_BITS = 5;
+constexpr uint32_t MAP_LEVEL_MASK = (1 << MAP_LEVEL_BITS) - 1;
+// Nodes this many bits down have run out of hash, so they're collision nodes
+constexpr unsigned MAP_HASH_BITS = 32;
+
+static inline uint32_t popcount(uint32_t bits) {
+#if defined(__GNUC__)
+    return (uint32_t)__builtin_popcount(bits);
+#else
+    uint32_t count = 0;
+    for (; bits != 0; bits &= bits - 1)
+        count++;
+    return count;
+#endif
+}
+
+// The bit for the branch that 'hash' takes at the level 'shift' bits down
+static inline uint32_t branch_bit(uint32_t hash, unsigned shift) {
+    return (uint32_t)1 << ((hash >> shift) & MAP_LEVEL_MASK);
+}
+
+// The number of branches in 'bitmap' before the one for 'bit'
+static inline uint32_t branch_index(uint32_t bitmap, uint32_t bit) {
+    return popcount(bitmap & (bit - 1));
+}
+
+// The slot holding the child on the branch for 'bit'
+//
+// Pre-condition: `node->nodemap & bit`
+static inline uint32_t child_slot(const ObjMapNode *node, uint32_t bit) {
+    return 2 * popcount(node->datamap) + branch_index(node->nodemap, bit);
+}
+
+static inline ObjMapNode *child_at(const ObjMapNode *node, uint32_t slot) {
+    return (ObjMapNode *)Value_as_obj(node->slots[slot]);
+}
+
+// The number of slots holding entries, which come before the children
+static inline uint32_t entry_slots(const ObjMapNode *node) {
+    // Collision nodes have neither bitmap set but are all entries
+    if (node->datamap == 0 && node->nodemap == 0)
+        return node->length;
+    return 2 * popcount(node->datamap);
+}
+
+// Whether 'node' holds a single entry, which its parent can hold instead
+static inline bool is_singleton(const ObjMapNode *node) {
+    return node->nodemap == 0 && node->length == 2;
+}
+
+static ObjMapNode *copy_node(Heap *heap, const ObjMapNode *node) {
+    ObjMapNode *result =
+        ObjMapNode_new(heap, node->datamap, node->nodemap, node->length);
+    memcpy(result->slots, node->slots, sizeof(Value) * node->length);
+    return result;
+}
+
+// Copies 'node' with the 'count' slots from 'at' onwards taken out
+static ObjMapNode *copy_without(Heap *heap, const ObjMapNode *node,
+                                uint32_t datamap, uint32_t nodemap,
+                                uint32_t at, uint32_t count) {
+    ObjMapNode *result =
+        ObjMapNode_new(heap, datamap, nodemap, node->length - count);
+    memcpy(result->slots, node->slots, sizeof(Value) * at);
+    memcpy(result->slots + at, node->slots + at + count,
+           sizeof(Value) * (node->length - at - count));
+    return result;
+}
+
+// Copies 'node' with a gap of 'count' slots at 'at', for the caller to fill in
+static ObjMapNode *copy_with_gap(Heap *heap, const ObjMapNode *node,
+                                 uint32_t datamap, uint32_t nodemap,
+                                 uint32_t at, uint32_t count) {
+    ObjMapNode *result =
+        ObjMapNode_new(heap, datamap, nodemap, node->length + count);
+    memcpy(result->slots, node->slots, sizeof(Value) * at);
+    memcpy(result->slots + at + count, node->slots + at,
+           sizeof(Value) * (node->length - at));
+    return result;
+}
+
+// Builds the subtrie 'shift' bits down which holds both entries, which have
+// different keys whose hashes agree above that
+static ObjMapNode *merge_entries(Heap *heap, unsigned shift, Value key1,
+                                 Value value1, uint32_t hash1, Value key2,
+                                 Value value2, uint32_t hash2) {
+    if (shift >= MAP_HASH_BITS) {
+        ObjMapNode *node = ObjMapNode_new(heap, 0, 0, 4);
+        node->slots[0] = key1;
+        node->slots[1] = value1;
+        node->slots[2] = key2;
+        node->slots[3] = value2;
+        return node;
+    }
+
+    uint32_t bit1 = branch_bit(hash1, shift);
+    uint32_t bit2 = branch_bit(hash2, shift);
+    if (bit1 == bit2) {
+        ObjMapNode *child =
+            merge_entries(heap, shift + MAP_LEVEL_BITS, key1, value1, hash1,
+                          key2, value2, hash2);
+        ObjMapNode *node = ObjMapNode_new(heap, 0, bit1, 1);
+        node->slots[0] = Value_obj(&child->obj);
+        return node;
+    }
+
+    ObjMapNode *node = ObjMapNode_new(heap, bit1 | bit2, 0, 4);
+    uint32_t first = bit1 < bit2 ? 0 : 2;
+    node->slots[first] = key1;
+    node->slots[first + 1] = value1;
+    node->slots[2 - first] = key2;
+    node->slots[3 - first] = value2;
+    return node;
+}
+
+// Returns a copy of 'node', which is 'shift' bits down, with 'key' bound to
+// 'value', setting 'added' if it wasn't bound before
+static ObjMapNode *insert_into(Heap *heap, const ObjMapNode *node,
+                               unsigned shift, Value key, Value value,
+                               uint32_t hash, /* out */ bool *added) {
+    if (shift >= MAP_HASH_BITS) {
+        for (uint32_t i = 0; i < node->length; i += 2) {
+            if (Value_eq(node->slots[i], key)) {
+                ObjMapNode *result = copy_node(heap, node);
+                result->slots[i + 1] = value;
+                *added = false;
+                return result;
+            }
+        }
+        ObjMapNode *result = copy_with_gap(heap, node, 0, 0, node->length, 2);
+        result->slots[node->length] = key;
+        result->slots[node->length + 1] = value;
+        *added = true;
+        return result;
+    }
+
+    uint32_t bit = branch_bit(hash, shift);
+    if (node->datamap & bit) {
+        uint32_t slot = 2 * branch_index(node->datamap, bit);
+        Value existing = node->slots[slot];
+        if (Value_eq(existing, key)) {
+            ObjMapNode *result = copy_node(heap, node);
+            result->slots[slot + 1] = value;
+            *added = false;
+            return result;
+        }
+
+        // Both entries move down into a new child on this branch
+        ObjMapNode *child = merge_entries(
+            heap, shift + MAP_LEVEL_BITS, existing, node->slots[slot + 1],
+            Value_hash(existing), key, value, hash);
+        // The entry's slots are taken out and the child's slot is put in
+        // among the other children, which moves everything in between down
+        uint32_t at = 2 * popcount(node->datamap) - 2 +
+                      branch_index(node->nodemap, bit);
+        ObjMapNode *result = ObjMapNode_new(heap, node->datamap ^ bit,
+                                            node->nodemap | bit,
+                                            node->length - 1);
+        memcpy(result->slots, node->slots, sizeof(Value) * slot);
+        memcpy(result->slots + slot, node->slots + slot + 2,
+               sizeof(Value) * (at - slot));
+        result->slots[at] = Value_obj(&child->obj);
+        memcpy(result->slots + at + 1, node->slots + at + 2,
+               sizeof(Value) * (node->length - at - 2));
+        *added = true;
+        return result;
+    }
+
+    if (node->nodemap & bit) {
+        uint32_t slot = child_slot(node, bit);
+        ObjMapNode *child = insert_into(heap, child_at(node, slot),
+                                        shift + MAP_LEVEL_BITS, key, value,
+                                        hash, added);
+        ObjMapNode *result = copy_node(heap, node);
+        result->slots[slot] = Value_obj(&child->obj);
+        return result;
+    }
+
+    uint32_t slot = 2 * branch_index(node->datamap, bit);
+    ObjMapNode *result = copy_with_gap(heap, node, node->datamap | bit,
+                                       node->nodemap, slot, 2);
+    result->slots[slot] = key;
+    result->slots[slot + 1] = value;
+    *added = true;
+    return result;
+}
+
+// Returns a copy of 'node', which is 'shift' bits down, without 'key', or
+// 'node' itself if it doesn't contain it. NULL is returned instead of an empty
+// node, and a child left with a single entry is replaced by that entry, so
+// that a trie has the same shape no matter which order it was built in.
+static ObjMapNode *remove_from(Heap *heap, ObjMapNode *node, unsigned shift,
+                               Value key, uint32_t hash) {
+    if (shift >= MAP_HASH_BITS) {
+        for (uint32_t i = 0; i < node->length; i += 2) {
+            if (Value_eq(node->slots[i], key))
+                return node->length == 2
+                           ? NULL
+                           : copy_without(heap, node, 0, 0, i, 2);
+        }
+        return node;
+    }
+
+    uint32_t bit = branch_bit(hash, shift);
+    if (node->datamap & bit) {
+        uint32_t slot = 2 * branch_index(node->datamap, bit);
+        if (!Value_eq(node->slots[slot], key))
+            return node;
+        if (node->length == 2)
+            return NULL;
+        return copy_without(heap, node, node->datamap ^ bit, node->nodemap,
+                            slot, 2);
+    }
+    if (!(node->nodemap & bit))
+        return node;
+
+    uint32_t slot = child_slot(node, bit);
+    ObjMapNode *child = child_at(node, slot);
+    ObjMapNode *new_child =
+        remove_from(heap, child, shift + MAP_LEVEL_BITS, key, hash);
+    if (new_child == child)
+        return node;
+    if (new_child == NULL) {
+        return node->length == 1 ? NULL
+                                 : copy_without(heap, node, node->datamap,
+                                                node->nodemap ^ bit, slot, 1);
+    }
+    if (!is_singleton(new_child)) {
+        ObjMapNode *result = copy_node(heap, node);
+        result->slots[slot] = Value_obj(&new_child->obj);
+        return result;
+    }
+
+    // The child's last entry moves up into this node, which moves the slots
+    // between where it goes and where the child was up
+    uint32_t at = 2 * branch_index(node->datamap, bit);
+    ObjMapNode *result = ObjMapNode_new(heap, node->datamap | bit,
+                                        node->nodemap ^ bit, node->length + 1);
+    memcpy(result->slots, node->slots, sizeof(Value) * at);
+    result->slots[at] = new_child->slots[0];
+    result->slots[at + 1] = new_child->slots[1];
+    memcpy(result->slots + at + 2, node->slots + at,
+           sizeof(Value) * (slot - at));
+    memcpy(result->slots + slot + 2, node->slots + slot + 1,
+           sizeof(Value) * (node->length - slot - 1));
+    return result;
+}
+
+ObjMap *ObjMap_insert(Heap *heap, ObjMap *map, Value key, Value value) {
+    uint32_t hash = Value_hash(key);
+    if (map->root == NULL) {
+        ObjMapNode *root = ObjMapNode_new(heap, branch_bit(hash, 0), 0, 2);
+        root->slots[0] = key;
+        root->slots[1] = value;
+        return ObjMap_new(heap, 1, root);
+    }
+
+    bool added;
+    ObjMapNode *root = insert_into(heap, map->root, 0, key, value, hash, &added);
+    return ObjMap_new(heap, map->count + (added ? 1 : 0), root);
+}
+
+ObjMap *ObjMap_remove(Heap *heap, ObjMap *map, Value key) {
+    if (map->root == NULL)
+        return map;
+
+    ObjMapNode *root = remove_from(heap, map->root, 0, key, Value_hash(key));
+    if (root == map->root)
+        return map;
+    return ObjMap_new(heap, map->count - 1, root);
+}
+
+const Value *ObjMap_get(const ObjMap *map, Value key) {
+    uint32_t hash = Value_hash(key);
+    const ObjMapNode *node = map->root;
+    for (unsigned shift = 0; node != NULL; shift += MAP_LEVEL_BITS) {
+        if (shift >= MAP_HASH_BITS) {
+            for (uint32_t i = 0; i < node->length; i += 2) {
+                if (Value_eq(node->slots[i], key))
+                    return &node->slots[i + 1];
+            }
+            return NULL;
+        }
+
+        uint32_t bit = branch_bit(hash, shift);
+        if (node->datamap & bit) {
+            uint32_t slot = 2 * branch_index(node->datamap, bit);
+            return Value_eq(node->slots[slot], key) ? &node->slots[slot + 1]
+                                                    : NULL;
+        }
+        if (!(node->nodemap & bit))
+            return NULL;
+        node = child_at(node, child_slot(node, bit));
+    }
+    return NULL;
+}
+
+// Whether every entry under 'node' is also in 'map', with an equal value
+static bool entries_in(const ObjMapNode *node, const ObjMap *map) {
+    uint32_t entries = entry_slots(node);
+    for (uint32_t i = 0; i < entries; i += 2) {
+        const Value *value = ObjMap_get(map, node->slots[i]);
+        if (value == NULL || !Value_eq(*value, node->slots[i + 1]))
+            return false;
+    }
+    for (uint32_t i = entries; i < node->length; i++) {
+        if (!entries_in(child_at(node, i), map))
+            return false;
+    }
+    return true;
+}
+
+bool ObjMap_eq(const ObjMap *a, const ObjMap *b) {
+    return a->count == b->count && (a->root == NULL || entries_in(a->root, b));
+}
+
+// Sums the hashes of the entries under 'node', so that the order they're
+// visited in doesn't matter
+static uint32_t hash_entries(const ObjMapNode *node) {
+    uint32_t hash = 0;
+    uint32_t entries = entry_slots(node);
+    for (uint32_t i = 0; i < entries; i += 2) {
+        hash += hash_word((uint64_t)Value_hash(node->slots[i]) << 32 |
+                          Value_hash(node->slots[i + 1]));
+    }
+    for (uint32_t i = entries; i < node->length; i++)
+        hash += hash_entries(child_at(node, i));
+    return hash;
+}
+
+uint32_t ObjMap_hash(const ObjMap *map) {
+    uint32_t entries = map->root == NULL ? 0 : hash_entries(map->root);
+    return hash_word((uint64_t)map->count << 32 | entries);
+}
+
+static void write_entries(const ObjMapNode *node, FILE *file,
+                          bool *first) {
+    uint32_t entries = entry_slots(node);
+    for (uint32_t i = 0; i < entries; i += 2) {
+        if (!*first)
+            fputs(", ", file);
+        *first = false;
+        Value_write(node->slots[i], file);
+        fputs(": ", file);
+        Value_write(node->slots[i + 1], file);
+    }
+    for (uint32_t i = entries; i < node->length; i++)
+        write_entries(child_at(node, i), file, first);
+}
+
+void ObjMap_write(const ObjMap *map, FILE *file) {
+    fputc('{', file);
+    bool first = true;
+    if (map->root != NULL)
+        write_entries(map->root, file, &first);
+    fputc('}', file);
+}
@@ -0,0 +1,35 @@
+#ifndef CLAM_MAP_H
+#define CLAM_MAP_H
+
+#include <stdint.h>
+#include <stdio.h>
+
+#include "object.h"
+#include "value.h"
+
+// Immutable maps are hash array mapped tries: each level of the trie branches
+// on the next 5 bits of the key's hash, so a lookup visits at most 7 nodes and
+// an update only copies those nodes, sharing the rest with the original map.
+// Keys are compared with 'Value_eq' and hashed with 'Value_hash'.
+//
+// None of these collect garbage, so the maps passed in don't need to be
+// reachable from the roots for the duration of the call.
+
+// Returns a map with 'key' bound to 'value', replacing any existing binding
+ObjMap *ObjMap_insert(Heap *heap, ObjMap *map, Value key, Value value);
+
+// Returns a map without 'key', which is 'map' itself if it doesn't contain it
+ObjMap *ObjMap_remove(Heap *heap, ObjMap *map, Value key);
+
+// Returns the value bound to 'key', or NULL if there isn't one
+const Value *ObjMap_get(const ObjMap *map, Value key);
+
+// Whether both maps have the same keys, bound to equal values
+bool ObjMap_eq(const ObjMap *a, const ObjMap *b);
+
+// A hash of the entries, which doesn't depend on the shape of the trie
+uint32_t ObjMap_hash(const ObjMap *map);
+
+void ObjMap_write(const ObjMap *map, FILE *file);
+
+#endif
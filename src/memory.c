@@ -1,7 +1,35 @@
 #include "memory.h"
 #include <stdio.h>
 
-void *reallocate(void *pointer, size_t new_size) {
+static size_t allocated = 0;
+
+static MemoryTag current_tag = MEMORY_OTHER;
+
+static MemoryStats stats = {0};
+
+static size_t size_class(size_t size) {
+    size_t class = 0;
+    while (class < MEMORY_SIZE_CLASSES - 1 &&
+           size > MEMORY_SMALLEST_CLASS << class)
+        class++;
+    return class;
+}
+
+void *reallocate_as(MemoryTag tag, void *pointer, size_t old_size,
+                    size_t new_size) {
+    allocated += new_size - old_size;
+    if (new_size > old_size) {
+        stats.allocated[tag] += new_size - old_size;
+        stats.size_classes[size_class(new_size)]++;
+        size_t live = stats.allocated[tag] - stats.freed[tag];
+        if (live > stats.peak[tag])
+            stats.peak[tag] = live;
+        if (allocated > stats.peak_total)
+            stats.peak_total = allocated;
+    } else {
+        stats.freed[tag] += old_size - new_size;
+    }
+
     // `realloc` isn't guaranteed to free the pointer if the supplied size is 0
     if (new_size == 0) {
         free(pointer);
@@ -16,6 +44,75 @@ void *reallocate(void *pointer, size_t new_size) {
     return result;
 }
 
+void *reallocate(void *pointer, size_t old_size, size_t new_size) {
+    return reallocate_as(current_tag, pointer, old_size, new_size);
+}
+
+MemoryTag set_memory_tag(MemoryTag tag) {
+    MemoryTag previous = current_tag;
+    current_tag = tag;
+    return previous;
+}
+
+size_t bytes_allocated_as(MemoryTag tag) {
+    return stats.allocated[tag] - stats.freed[tag];
+}
+
+const MemoryStats *memory_stats(void) { return &stats; }
+
+static const char *tag_name(MemoryTag tag) {
+    switch (tag) {
+    case MEMORY_OTHER:
+        return "other";
+    case MEMORY_LEXER:
+        return "lexer";
+    case MEMORY_PARSER:
+        return "parser";
+    case MEMORY_SYMBOLS:
+        return "symbols";
+    case MEMORY_COMPILER:
+        return "compiler";
+    case MEMORY_VM:
+        return "vm";
+    case MEMORY_HEAP:
+        return "heap";
+    case MEMORY_STRINGS:
+        return "strings";
+    case MEMORY_HASHTABLE:
+        return "hashtable";
+    case MEMORY_ARENA:
+        return "arena";
+    }
+    return "?";
+}
+
+void MemoryStats_print(const MemoryStats *self, FILE *stream) {
+    fputs("Memory (bytes):\n", stream);
+    fprintf(stream, "  %-10s %12s %12s %12s %12s\n", "", "allocated", "freed",
+            "live", "peak");
+    size_t allocated_total = 0, freed_total = 0;
+    for (size_t i = 0; i < MEMORY_TAGS; i++) {
+        allocated_total += self->allocated[i];
+        freed_total += self->freed[i];
+        fprintf(stream, "  %-10s %12zu %12zu %12zu %12zu\n",
+                tag_name((MemoryTag)i), self->allocated[i], self->freed[i],
+                self->allocated[i] - self->freed[i], self->peak[i]);
+    }
+    fprintf(stream, "  %-10s %12zu %12zu %12zu %12zu\n", "total",
+            allocated_total, freed_total, allocated_total - freed_total,
+            self->peak_total);
+
+    fputs("Allocation sizes:\n", stream);
+    for (size_t i = 0; i < MEMORY_SIZE_CLASSES; i++) {
+        if (i == MEMORY_SIZE_CLASSES - 1)
+            fprintf(stream, "  >  %-10zu %12zu\n",
+                    MEMORY_SMALLEST_CLASS << (i - 1), self->size_classes[i]);
+        else
+            fprintf(stream, "  <= %-10zu %12zu\n", MEMORY_SMALLEST_CLASS << i,
+                    self->size_classes[i]);
+    }
+}
+
 // Hopefully this will be inlined
 size_t grow_allocation(size_t old_capacity) {
     return old_capacity < 8 ? 8 : old_capacity * 2;
@@ -1,9 +1,75 @@
 #ifndef CLAM_MEMORY_H
 #define CLAM_MEMORY_H
 
+#include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 
-void *reallocate(void *pointer, size_t new_size);
+// What the bytes going through 'reallocate' are charged to in the memory
+// statistics
+typedef enum MemoryTag : uint8_t {
+    MEMORY_OTHER,
+    MEMORY_LEXER,
+    MEMORY_PARSER,
+    // The interner's symbol to name mapping, which outlives the parser
+    MEMORY_SYMBOLS,
+    MEMORY_COMPILER,
+    // The VM's stacks and the garbage collector's bookkeeping
+    MEMORY_VM,
+    // Objects on the VM's heap other than strings
+    MEMORY_HEAP,
+    // String and rope objects, and flattened ropes
+    MEMORY_STRINGS,
+    MEMORY_HASHTABLE,
+    MEMORY_ARENA,
+} MemoryTag;
+
+constexpr size_t MEMORY_TAGS = MEMORY_ARENA + 1;
+
+// Allocations are counted in size classes by the power of two they fit in,
+// starting from this many bytes, with anything bigger than the last class
+// counted in it too
+constexpr size_t MEMORY_SMALLEST_CLASS = 16;
+constexpr size_t MEMORY_SIZE_CLASSES = 16;
+
+typedef struct MemoryStats {
+    // Bytes allocated and freed, where growing an allocation counts the bytes
+    // it grew by as allocated and shrinking it counts them as freed
+    size_t allocated[MEMORY_TAGS];
+    size_t freed[MEMORY_TAGS];
+    // The most bytes that were live at once
+    size_t peak[MEMORY_TAGS];
+    size_t peak_total;
+    // The number of allocations (including ones that grew) in each size class
+    size_t size_classes[MEMORY_SIZE_CLASSES];
+} MemoryStats;
+
+// Resize the allocation at 'pointer' from 'old_size' to 'new_size' bytes,
+// where a NULL 'pointer' (with an 'old_size' of 0) allocates and a 'new_size'
+// of 0 frees
+//
+// All heap memory goes through here so that it can be accounted for, and the
+// bytes charged to the VM heap's tags decide when the garbage collector runs
+// (see 'Heap_bytes'). The bytes are charged to the current memory tag (see
+// 'set_memory_tag').
+void *reallocate(void *pointer, size_t old_size, size_t new_size);
+
+// Like 'reallocate', but charges the bytes to 'tag', for memory that always
+// belongs to the same subsystem whichever one is running
+void *reallocate_as(MemoryTag tag, void *pointer, size_t old_size,
+                    size_t new_size);
+
+// Set what 'reallocate' charges bytes to, returning the previous tag so that
+// it can be restored. Memory should be freed under the tag it was allocated
+// under, or the per-tag figures won't add up.
+MemoryTag set_memory_tag(MemoryTag tag);
+
+// The number of bytes currently allocated under 'tag'
+size_t bytes_allocated_as(MemoryTag tag);
+
+const MemoryStats *memory_stats(void);
+
+void MemoryStats_print(const MemoryStats *self, FILE *stream);
 
 size_t grow_allocation(size_t old_capacity);
 
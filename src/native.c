@@ -0,0 +1,118 @@
+#include "list.h"
+#include "map.h"
+#include "native.h"
+#include "rope.h"
+#include "vm_ops.h"
+
+#define OK(result) ((RunResult){.tag = RESULT_OK, .value = {.ok = (result)}})
+
+// `map_empty`, the map with no entries
+static RunResult map_empty(Heap *heap, const Value *) {
+    return OK(Value_obj(&ObjMap_new(heap, 0, NULL)->obj));
+}
+
+// `map_insert map key value`
+static RunResult map_insert(Heap *heap, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_map, "map", arguments[0]);
+    ObjMap *map = ObjMap_insert(heap, Value_as_map(arguments[0]), arguments[1],
+                                arguments[2]);
+    return OK(Value_obj(&map->obj));
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `map_remove map key`
+static RunResult map_remove(Heap *heap, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_map, "map", arguments[0]);
+    ObjMap *map = ObjMap_remove(heap, Value_as_map(arguments[0]), arguments[1]);
+    return OK(Value_obj(&map->obj));
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `map_get map key default`, which is 'default' if 'key' isn't in the map
+static RunResult map_get(Heap *, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_map, "map", arguments[0]);
+    const Value *value = ObjMap_get(Value_as_map(arguments[0]), arguments[1]);
+    return OK(value != NULL ? *value : arguments[2]);
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `map_has map key`
+static RunResult map_has(Heap *, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_map, "map", arguments[0]);
+    const Value *value = ObjMap_get(Value_as_map(arguments[0]), arguments[1]);
+    return OK(Value_bool(value != NULL));
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `map_size map`, saturating at the largest int
+static RunResult map_size(Heap *, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_map, "map", arguments[0]);
+    size_t count = Value_as_map(arguments[0])->count;
+    return OK(Value_int(count > INT32_MAX ? INT32_MAX : (int32_t)count));
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `list_get list index default`, which is 'default' if 'index' is out of bounds
+static RunResult list_get(Heap *, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_list, "list", arguments[0]);
+    EXPECT(Value_is_int, "int", arguments[1]);
+    int32_t index = Value_as_int(arguments[1]);
+    const Value *value =
+        index < 0 ? NULL : ObjList_get(Value_as_list(arguments[0]), index);
+    return OK(value != NULL ? *value : arguments[2]);
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `list_length list`, saturating at the largest int
+static RunResult list_length(Heap *, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_list, "list", arguments[0]);
+    size_t count = Value_as_list(arguments[0])->count;
+    return OK(Value_int(count > INT32_MAX ? INT32_MAX : (int32_t)count));
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// `string_length string`, in bytes, saturating at the largest int
+static RunResult string_length(Heap *, const Value *arguments) {
+    RuntimeError error;
+    EXPECT(Value_is_string, "string", arguments[0]);
+    size_t length = Value_string_length(arguments[0]);
+    return OK(Value_int(length > INT32_MAX ? INT32_MAX : (int32_t)length));
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// The names are spelt out since `STR` isn't a constant expression
+static const Native NATIVES[] = {
+    {.name = {"map_empty", 9}, .arity = 0, .function = map_empty},
+    {.name = {"map_insert", 10}, .arity = 3, .function = map_insert},
+    {.name = {"map_remove", 10}, .arity = 2, .function = map_remove},
+    {.name = {"map_get", 7}, .arity = 3, .function = map_get},
+    {.name = {"map_has", 7}, .arity = 2, .function = map_has},
+    {.name = {"map_size", 8}, .arity = 1, .function = map_size},
+    {.name = {"list_get", 8}, .arity = 3, .function = list_get},
+    {.name = {"list_length", 11}, .arity = 1, .function = list_length},
+    {.name = {"string_length", 13}, .arity = 1, .function = string_length},
+};
+
+const Native *Native_lookup(Symbol name) {
+    String string = Symbol_name(name);
+    for (size_t i = 0; i < sizeof(NATIVES) / sizeof(NATIVES[0]); i++) {
+        if (String_eq(NATIVES[i].name, string))
+            return &NATIVES[i];
+    }
+    return NULL;
+}
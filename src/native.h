@@ -0,0 +1,27 @@
+#ifndef CLAM_NATIVE_H
+#define CLAM_NATIVE_H
+
+#include <stdint.h>
+
+#include "object.h"
+#include "string.h"
+#include "symbol.h"
+#include "value.h"
+#include "vm.h"
+
+// A function built into the interpreter, which is bound to its name unless the
+// program shadows it, and is applied like any other function
+typedef struct Native {
+    String name;
+    // Natives which take no arguments are constants instead, which are
+    // evaluated once when they are compiled
+    uint16_t arity;
+    // Called with the 'arity' arguments once they have all been applied. It
+    // may allocate from 'heap', but garbage isn't collected until it returns.
+    RunResult (*function)(Heap *heap, const Value *arguments);
+} Native;
+
+// Returns the native called 'name', or NULL if there isn't one
+const Native *Native_lookup(Symbol name);
+
+#endif
@@ -0,0 +1,306 @@
+#include <string.h>
+
+#include "common.h"
+#include "hashtable.h"
+#include "memory.h"
+#include "object.h"
+
+DEF_VEC(Capture, Captures)
+DEF_VEC(Obj *, Objs)
+
+Heap Heap_new(void) {
+    return (Heap){
+        .objects = NULL,
+        .gray = Objs_new(),
+        .next_gc = HEAP_MIN_NEXT_GC,
+    };
+}
+
+// Strings are told apart from the rest of the heap in the memory statistics
+static inline MemoryTag object_tag(ObjType type) {
+    return type == OBJ_STRING || type == OBJ_ROPE ? MEMORY_STRINGS
+                                                  : MEMORY_HEAP;
+}
+
+static Obj *allocate_object(Heap *heap, size_t size, ObjType type) {
+    Obj *obj = (Obj *)reallocate_as(object_tag(type), NULL, 0, size);
+    obj->type = type;
+    obj->marked = false;
+    obj->next = heap->objects;
+    heap->objects = obj;
+    return obj;
+}
+
+static void free_object(Obj *obj) {
+    size_t size;
+    switch (obj->type) {
+    case OBJ_STRING:
+        size = sizeof(ObjString) + ((ObjString *)obj)->length;
+        break;
+    case OBJ_ROPE: {
+        ObjRope *rope = (ObjRope *)obj;
+        if (rope->flat != NULL)
+            reallocate_as(MEMORY_STRINGS, rope->flat, rope->length, 0);
+        size = sizeof(ObjRope);
+        break;
+    }
+    case OBJ_FUNCTION: {
+        ObjFunction *function = (ObjFunction *)obj;
+        // These were allocated by the compiler
+        MemoryTag saved = set_memory_tag(MEMORY_COMPILER);
+        Chunk_free(&function->chunk);
+        Captures_free(&function->captures);
+        set_memory_tag(saved);
+        size = sizeof(ObjFunction);
+        break;
+    }
+    case OBJ_CLOSURE:
+        size = sizeof(ObjClosure) +
+               sizeof(Value) * ((ObjClosure *)obj)->upvalue_count;
+        break;
+    case OBJ_PARTIAL:
+        size = sizeof(ObjPartial) + sizeof(Value) * ((ObjPartial *)obj)->count;
+        break;
+    case OBJ_NATIVE:
+        size = sizeof(ObjNative);
+        break;
+    case OBJ_MAP:
+        size = sizeof(ObjMap);
+        break;
+    case OBJ_MAP_NODE:
+        size = sizeof(ObjMapNode) + sizeof(Value) * ((ObjMapNode *)obj)->length;
+        break;
+    case OBJ_LIST:
+        size = sizeof(ObjList);
+        break;
+    case OBJ_LIST_CHUNK:
+        size = sizeof(ObjListChunk) +
+               sizeof(Value) * ((ObjListChunk *)obj)->capacity;
+        break;
+    case OBJ_LIST_CONCAT:
+        size = sizeof(ObjListConcat);
+        break;
+    default:
+        UNREACHABLE;
+    }
+    reallocate_as(object_tag(obj->type), obj, size, 0);
+}
+
+void Heap_free(Heap *self) {
+    Obj *obj = self->objects;
+    while (obj != NULL) {
+        Obj *next = obj->next;
+        free_object(obj);
+        obj = next;
+    }
+    self->objects = NULL;
+    Objs_free(&self->gray);
+}
+
+void Heap_mark_value(Heap *self, Value value) {
+    if (Value_is_obj(value))
+        Heap_mark_object(self, Value_as_obj(value));
+}
+
+void Heap_mark_object(Heap *self, Obj *obj) {
+    if (obj == NULL || obj->marked)
+        return;
+
+    obj->marked = true;
+    // Strings and natives don't reference anything, so there's no point
+    // tracing them
+    if (obj->type != OBJ_STRING && obj->type != OBJ_NATIVE)
+        Objs_push(&self->gray, obj);
+}
+
+// Mark everything that 'obj' references
+static void blacken_object(Heap *self, Obj *obj) {
+    switch (obj->type) {
+    case OBJ_STRING:
+    case OBJ_NATIVE:
+        break;
+    case OBJ_ROPE: {
+        ObjRope *rope = (ObjRope *)obj;
+        Heap_mark_value(self, rope->left);
+        Heap_mark_value(self, rope->right);
+        break;
+    }
+    case OBJ_FUNCTION: {
+        Values *constants = &((ObjFunction *)obj)->chunk.constants;
+        for (size_t i = 0; i < constants->length; i++)
+            Heap_mark_value(self, constants->buffer[i]);
+        break;
+    }
+    case OBJ_CLOSURE: {
+        ObjClosure *closure = (ObjClosure *)obj;
+        Heap_mark_object(self, &closure->function->obj);
+        for (size_t i = 0; i < closure->upvalue_count; i++)
+            Heap_mark_value(self, closure->upvalues[i]);
+        break;
+    }
+    case OBJ_PARTIAL: {
+        ObjPartial *partial = (ObjPartial *)obj;
+        Heap_mark_object(self, partial->callee);
+        for (size_t i = 0; i < partial->count; i++)
+            Heap_mark_value(self, partial->arguments[i]);
+        break;
+    }
+    case OBJ_MAP:
+        Heap_mark_object(self, (Obj *)((ObjMap *)obj)->root);
+        break;
+    case OBJ_MAP_NODE: {
+        ObjMapNode *node = (ObjMapNode *)obj;
+        for (size_t i = 0; i < node->length; i++)
+            Heap_mark_value(self, node->slots[i]);
+        break;
+    }
+    case OBJ_LIST: {
+        ObjList *list = (ObjList *)obj;
+        Heap_mark_object(self, list->tree);
+        Heap_mark_object(self, (Obj *)list->tail);
+        break;
+    }
+    case OBJ_LIST_CHUNK: {
+        ObjListChunk *chunk = (ObjListChunk *)obj;
+        for (size_t i = 0; i < chunk->length; i++)
+            Heap_mark_value(self, chunk->values[i]);
+        break;
+    }
+    case OBJ_LIST_CONCAT: {
+        ObjListConcat *concat = (ObjListConcat *)obj;
+        Heap_mark_object(self, concat->left);
+        Heap_mark_object(self, concat->right);
+        break;
+    }
+    }
+}
+
+static void sweep(Heap *self) {
+    Obj **link = &self->objects;
+    while (*link != NULL) {
+        Obj *obj = *link;
+        if (obj->marked) {
+            obj->marked = false;
+            link = &obj->next;
+        } else {
+            *link = obj->next;
+            free_object(obj);
+        }
+    }
+}
+
+void Heap_collect(Heap *self) {
+    while (self->gray.length > 0)
+        blacken_object(self, self->gray.buffer[--self->gray.length]);
+    sweep(self);
+
+    size_t next_gc = Heap_bytes() * HEAP_GROWTH_FACTOR;
+    self->next_gc = next_gc > HEAP_MIN_NEXT_GC ? next_gc : HEAP_MIN_NEXT_GC;
+}
+
+ObjString *ObjString_copy(Heap *heap, String string) {
+    ObjString *result = (ObjString *)allocate_object(
+        heap, sizeof(ObjString) + string.length, OBJ_STRING);
+    result->length = string.length;
+    result->hash = hash_string(string);
+    memcpy(result->chars, string.buffer, string.length);
+    return result;
+}
+
+ObjRope *ObjRope_new(Heap *heap, Value left, Value right, size_t length) {
+    ObjRope *result =
+        (ObjRope *)allocate_object(heap, sizeof(ObjRope), OBJ_ROPE);
+    result->length = length;
+    result->hash = 0;
+    result->hashed = false;
+    result->left = left;
+    result->right = right;
+    result->flat = NULL;
+    return result;
+}
+
+ObjFunction *ObjFunction_new(Heap *heap, Chunk chunk, uint16_t arity,
+                             Captures captures, String name) {
+    ObjFunction *result = (ObjFunction *)allocate_object(
+        heap, sizeof(ObjFunction), OBJ_FUNCTION);
+    result->chunk = chunk;
+    result->arity = arity;
+    result->captures = captures;
+    result->name = name;
+    return result;
+}
+
+ObjClosure *ObjClosure_new(Heap *heap, ObjFunction *function) {
+    ObjClosure *result = (ObjClosure *)allocate_object(
+        heap, sizeof(ObjClosure) + sizeof(Value) * function->captures.length,
+        OBJ_CLOSURE);
+    result->function = function;
+    result->upvalue_count = (uint16_t)function->captures.length;
+    return result;
+}
+
+ObjPartial *ObjPartial_new(Heap *heap, Obj *callee, uint16_t count,
+                           const Value *arguments) {
+    ObjPartial *result = (ObjPartial *)allocate_object(
+        heap, sizeof(ObjPartial) + sizeof(Value) * count, OBJ_PARTIAL);
+    result->callee = callee;
+    result->count = count;
+    memcpy(result->arguments, arguments, sizeof(Value) * count);
+    return result;
+}
+
+ObjNative *ObjNative_new(Heap *heap, const struct Native *native) {
+    ObjNative *result =
+        (ObjNative *)allocate_object(heap, sizeof(ObjNative), OBJ_NATIVE);
+    result->native = native;
+    return result;
+}
+
+ObjMapNode *ObjMapNode_new(Heap *heap, uint32_t datamap, uint32_t nodemap,
+                           uint32_t length) {
+    ObjMapNode *result = (ObjMapNode *)allocate_object(
+        heap, sizeof(ObjMapNode) + sizeof(Value) * length, OBJ_MAP_NODE);
+    result->datamap = datamap;
+    result->nodemap = nodemap;
+    result->length = length;
+    return result;
+}
+
+ObjMap *ObjMap_new(Heap *heap, size_t count, ObjMapNode *root) {
+    ObjMap *result = (ObjMap *)allocate_object(heap, sizeof(ObjMap), OBJ_MAP);
+    result->count = count;
+    result->root = root;
+    return result;
+}
+
+ObjListChunk *ObjListChunk_new(Heap *heap, uint32_t capacity) {
+    ObjListChunk *result = (ObjListChunk *)allocate_object(
+        heap, sizeof(ObjListChunk) + sizeof(Value) * capacity, OBJ_LIST_CHUNK);
+    result->capacity = capacity;
+    result->length = 0;
+    return result;
+}
+
+ObjListConcat *ObjListConcat_new(Heap *heap, Obj *left, Obj *right) {
+    ObjListConcat *result = (ObjListConcat *)allocate_object(
+        heap, sizeof(ObjListConcat), OBJ_LIST_CONCAT);
+    uint8_t left_height = list_tree_height(left);
+    uint8_t right_height = list_tree_height(right);
+    result->count = list_tree_count(left) + list_tree_count(right);
+    result->height =
+        (uint8_t)(1 + (left_height > right_height ? left_height : right_height));
+    result->left = left;
+    result->right = right;
+    return result;
+}
+
+ObjList *ObjList_new(Heap *heap, size_t count, Obj *tree, ObjListChunk *tail,
+                     uint32_t tail_length) {
+    ObjList *result =
+        (ObjList *)allocate_object(heap, sizeof(ObjList), OBJ_LIST);
+    result->count = count;
+    result->tree = tree;
+    result->tail = tail;
+    result->tail_length = tail_length;
+    return result;
+}
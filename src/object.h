@@ -0,0 +1,293 @@
+#ifndef CLAM_OBJECT_H
+#define CLAM_OBJECT_H
+
+#include <stddef.h>
+
+#include "chunk.h"
+#include "memory.h"
+#include "string.h"
+#include "value.h"
+#include "vec.h"
+
+// An immutable string, whose characters are stored inline after the header
+typedef struct ObjString {
+    Obj obj;
+    size_t length;
+    // Worked out up front, since the characters are all there anyway
+    uint32_t hash;
+    char chars[];
+} ObjString;
+
+// The concatenation of two strings, whose characters are only copied into a
+// single buffer once something needs them (see "rope.h")
+typedef struct ObjRope {
+    Obj obj;
+    size_t length;
+    uint32_t hash;
+    bool hashed;
+    // The halves of the rope, both strings, until it is flattened, after which
+    // they're unit so that they can be collected
+    Value left;
+    Value right;
+    // NULL until the rope is flattened, isn't null-terminated
+    char *flat;
+} ObjRope;
+
+static inline ObjString *Value_as_string(Value value) {
+    return (ObjString *)Value_as_obj(value);
+}
+
+static inline ObjRope *Value_as_rope(Value value) {
+    return (ObjRope *)Value_as_obj(value);
+}
+
+static inline String ObjString_as_string(ObjString *string) {
+    return (String){.buffer = string->chars, .length = string->length};
+}
+
+// Where a closure gets one of its upvalues from when it is created
+typedef struct Capture {
+    enum CaptureKind : uint8_t {
+        CAPTURE_LOCAL,   // The local in stack slot 'index' of the creator
+        CAPTURE_UPVALUE, // The upvalue at 'index' of the creator's closure
+    } kind;
+    uint16_t index;
+} Capture;
+
+DECL_VEC_HEADER(Capture, Captures)
+
+// A compiled `fun`, which is only ever a constant used to create closures
+typedef struct ObjFunction {
+    Obj obj;
+    Chunk chunk;
+    uint16_t arity;
+    // One for each of the function's free variables, in upvalue order
+    Captures captures;
+    // The name of the `let` binding that the function was defined by, or an
+    // empty string for an anonymous function
+    String name;
+} ObjFunction;
+
+// A function along with the values of its free variables, which are copied
+// into a flat array when the closure is created, since values are immutable
+typedef struct ObjClosure {
+    Obj obj;
+    ObjFunction *function;
+    // The same as the number of the function's captures, which is kept here
+    // so that freeing the closure doesn't depend on its function still
+    // existing
+    uint16_t upvalue_count;
+    Value upvalues[];
+} ObjClosure;
+
+// A function built into the interpreter, which is described by a 'Native'
+// (see "native.h")
+typedef struct ObjNative {
+    Obj obj;
+    const struct Native *native;
+} ObjNative;
+
+// A closure or native applied to fewer arguments than it takes, which holds on
+// to them until it is called with the rest
+typedef struct ObjPartial {
+    Obj obj;
+    // Either an ObjClosure or an ObjNative
+    Obj *callee;
+    // Always less than the arity of the callee
+    uint16_t count;
+    Value arguments[];
+} ObjPartial;
+
+// A node of the hash array mapped trie behind an immutable map (see "map.h").
+// Each of a node's 32 branches is either empty, a single entry or a child node,
+// and only the branches in use take up any slots: first the entries as key,
+// value pairs, then the children, each in branch order. So the slot a branch
+// is in comes from the number of bits below it in 'datamap' or 'nodemap'.
+//
+// Keys whose hashes are equal all the way down end up in a collision node,
+// which has neither bitmap set and holds its entries in no particular order.
+typedef struct ObjMapNode {
+    Obj obj;
+    uint32_t datamap;
+    uint32_t nodemap;
+    // The number of slots, where children are stored as values too
+    uint32_t length;
+    Value slots[];
+} ObjMapNode;
+
+// An immutable map from values to values, where updates share every node
+// except the ones on the path to the key that changed
+typedef struct ObjMap {
+    Obj obj;
+    size_t count;
+    // NULL for an empty map
+    ObjMapNode *root;
+} ObjMap;
+
+// A run of consecutive elements of a list (see "list.h"). Chunks can be shared
+// by many lists, each of which uses some prefix of the elements.
+//
+// A list's last chunk can be appended to in place, by the first list to use
+// the slot after 'length', so chunks in the middle of a list are always full
+// (i.e. 'length' is 'capacity') so that nothing else can be appended to them.
+typedef struct ObjListChunk {
+    Obj obj;
+    uint32_t capacity;
+    // The number of elements that are in use by any list
+    uint32_t length;
+    Value values[];
+} ObjListChunk;
+
+// A node of the balanced tree of chunks behind a list, whose elements are its
+// left subtree's followed by its right subtree's. The subtrees are either
+// chunks or other concatenation nodes.
+typedef struct ObjListConcat {
+    Obj obj;
+    // The number of elements in the subtree
+    size_t count;
+    // The longest path to a chunk, where chunks have a height of 0
+    uint8_t height;
+    Obj *left;
+    Obj *right;
+} ObjListConcat;
+
+// An immutable list, made of a tree of full chunks followed by a tail chunk
+// which appends go into, so that only every so many appends touch the tree
+typedef struct ObjList {
+    Obj obj;
+    size_t count;
+    // NULL if every element fits in the tail
+    Obj *tree;
+    // NULL for an empty list
+    ObjListChunk *tail;
+    // The number of elements the list uses from the start of 'tail'
+    uint32_t tail_length;
+} ObjList;
+
+// The number of elements in a subtree of a list
+static inline size_t list_tree_count(const Obj *tree) {
+    return tree->type == OBJ_LIST_CHUNK ? ((const ObjListChunk *)tree)->length
+                                        : ((const ObjListConcat *)tree)->count;
+}
+
+static inline uint8_t list_tree_height(const Obj *tree) {
+    return tree->type == OBJ_LIST_CHUNK ? 0
+                                        : ((const ObjListConcat *)tree)->height;
+}
+
+static inline ObjFunction *Value_as_function(Value value) {
+    return (ObjFunction *)Value_as_obj(value);
+}
+
+static inline ObjClosure *Value_as_closure(Value value) {
+    return (ObjClosure *)Value_as_obj(value);
+}
+
+static inline ObjPartial *Value_as_partial(Value value) {
+    return (ObjPartial *)Value_as_obj(value);
+}
+
+static inline ObjNative *Value_as_native(Value value) {
+    return (ObjNative *)Value_as_obj(value);
+}
+
+static inline ObjMap *Value_as_map(Value value) {
+    return (ObjMap *)Value_as_obj(value);
+}
+
+static inline ObjList *Value_as_list(Value value) {
+    return (ObjList *)Value_as_obj(value);
+}
+
+DECL_VEC_HEADER(Obj *, Objs)
+
+// Once the garbage collector has run, it runs again when this many times as
+// many bytes are allocated as were left after it
+constexpr size_t HEAP_GROWTH_FACTOR = 2;
+constexpr size_t HEAP_MIN_NEXT_GC = 1 << 20;
+
+// Owns every object allocated while compiling and running a program, which
+// are kept in an intrusive linked list so they can all be freed at once, or
+// swept by the mark-sweep garbage collector
+//
+// The heap doesn't know what its roots are, so collecting garbage is driven by
+// whoever does (i.e. the VM), which marks the roots then calls 'Heap_collect'
+typedef struct Heap {
+    Obj *objects;
+    // Objects which have been marked but whose references haven't been yet
+    Objs gray;
+    // The value of 'Heap_bytes' past which garbage should be collected
+    size_t next_gc;
+} Heap;
+
+// The bytes taken up by objects and the buffers they own. The rest of the
+// process (the VM's stacks, tokens, the AST, chunks) can't be collected, so it
+// doesn't count towards when to collect.
+static inline size_t Heap_bytes(void) {
+    return bytes_allocated_as(MEMORY_HEAP) + bytes_allocated_as(MEMORY_STRINGS);
+}
+
+Heap Heap_new(void);
+
+// Free every object in the heap
+void Heap_free(Heap *self);
+
+static inline bool Heap_should_collect(const Heap *self) {
+#ifdef DEBUG_STRESS_GC
+    (void)self;
+    return true;
+#else
+    return Heap_bytes() > self->next_gc;
+#endif
+}
+
+// Mark an object as live, if 'value' is one
+void Heap_mark_value(Heap *self, Value value);
+
+void Heap_mark_object(Heap *self, Obj *obj);
+
+// Trace everything reachable from the objects marked so far (the roots), free
+// every object which isn't, and pick the threshold for the next collection
+// based on how much memory is still in use
+void Heap_collect(Heap *self);
+
+// Allocate a string object containing a copy of 'string'
+ObjString *ObjString_copy(Heap *heap, String string);
+
+// Allocate a rope of two strings, which are 'length' characters long between
+// them
+ObjRope *ObjRope_new(Heap *heap, Value left, Value right, size_t length);
+
+// Allocate a function object, taking ownership of 'chunk' and 'captures'
+ObjFunction *ObjFunction_new(Heap *heap, Chunk chunk, uint16_t arity,
+                             Captures captures, String name);
+
+// Allocate a closure over 'function', whose upvalues are left for the caller
+// to fill in
+ObjClosure *ObjClosure_new(Heap *heap, ObjFunction *function);
+
+// Allocate a partial application of 'callee' (a closure or native) to a copy
+// of the 'count' values in 'arguments'
+ObjPartial *ObjPartial_new(Heap *heap, Obj *callee, uint16_t count,
+                           const Value *arguments);
+
+ObjNative *ObjNative_new(Heap *heap, const struct Native *native);
+
+// Allocate a map node with room for 'length' slots, which are left for the
+// caller to fill in
+ObjMapNode *ObjMapNode_new(Heap *heap, uint32_t datamap, uint32_t nodemap,
+                           uint32_t length);
+
+ObjMap *ObjMap_new(Heap *heap, size_t count, ObjMapNode *root);
+
+// Allocate a list chunk with room for 'capacity' elements, none of which are
+// in use yet
+ObjListChunk *ObjListChunk_new(Heap *heap, uint32_t capacity);
+
+// Allocate a node concatenating two subtrees of a list
+ObjListConcat *ObjListConcat_new(Heap *heap, Obj *left, Obj *right);
+
+ObjList *ObjList_new(Heap *heap, size_t count, Obj *tree, ObjListChunk *tail,
+                     uint32_t tail_length);
+
+#endif
@@ -1,56 +1,184 @@
 #include "string.h"
 #include <locale.h>
-#define _USE_MATH_DEFINES
-#include <math.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
 
 #include "ast.h"
 #include "common.h"
+#include "diagnostic.h"
 #include "lexer.h"
+#include "memory.h"
 #include "parser.h"
 #include "result.h"
 #include "vec.h"
 
-DEF_VEC_T(String, StringVec)
+DEF_VEC(Symbol, Symbols)
 
-DEF_VEC(AST_LetBind, AST_LetBindVec)
-DEF_VEC(ASTIndex, AST_List)
+DEF_VEC(uint32_t, Indices)
 
-DEF_RESULT(StringBuf, SyntaxError, ParseString);
+DEF_SMALLVEC(ASTIndex, AST_List, 4)
+
+DEF_RESULT(String, SyntaxError, ParseString);
 DEF_RESULT(Token, SyntaxError, Token);
-DEF_RESULT(AST, SyntaxError, AST);
 
 Parser Parser_new(const String file_name, const String source) {
     return (Parser){
         .file_name = file_name,
         .source = source,
-        .lexer = Lexer_new(source),
-        .ast_arena = ASTVec_new(),
+        .tokens = TokenGap_new(Lexer_tokenize(source), source),
+        .current = 0,
+        .ast = AST_new(source),
+        .string = StringBuf_new(),
+        .items = AST_List_new(),
+        .bindings = AST_LetBindVec_new(),
+        .params = Symbols_new(),
+        .binding_tokens = Indices_new(),
+        .binding_nodes = Indices_new(),
+        .node_tokens = Indices_new(),
+        .incremental = false,
+        .parsed = {0},
+        .fresh_length = 0,
+        .fresh_extra = 0,
+        .fresh_strings = 0,
     };
 }
 
-static inline Token *peek(Parser *self) {
-    return Lexer_peek_token(&self->lexer);
+static inline uint32_t later(uint32_t end, uint32_t other) {
+    return end > other ? end : other;
+}
+
+// Work out every parent in the tree of ends from the leaves
+static void build_ends(ParsedExprs *parsed) {
+    uint32_t *ends = parsed->ends;
+    for (size_t i = 0; i < parsed->leaves; i++)
+        ends[parsed->leaves + i] = i < parsed->gap ? parsed->buffer[i].end : 0;
+    for (size_t node = parsed->leaves; node-- > 1;)
+        ends[node] = later(ends[2 * node], ends[2 * node + 1]);
+}
+
+// Bring the leaves of entries 'low' to 'high' (exclusive) and their parents up
+// to date, a level at a time
+static void update_ends(ParsedExprs *parsed, size_t low, size_t high) {
+    if (low >= high)
+        return;
+    uint32_t *ends = parsed->ends;
+    for (size_t i = low; i < high; i++)
+        ends[parsed->leaves + i] = i < parsed->gap ? parsed->buffer[i].end : 0;
+    low += parsed->leaves;
+    high += parsed->leaves - 1;
+    while (low > 1) {
+        low /= 2;
+        high /= 2;
+        for (size_t node = low; node <= high; node++)
+            ends[node] = later(ends[2 * node], ends[2 * node + 1]);
+    }
 }
 
+// Make room for 'capacity' entries, keeping the ones after the gap at the end
+static void grow_parsed(ParsedExprs *parsed, size_t capacity) {
+    size_t old_capacity = parsed->capacity;
+    size_t after = parsed->length - parsed->gap;
+    parsed->buffer =
+        reallocate(parsed->buffer, sizeof(ParsedExpr) * old_capacity,
+                   sizeof(ParsedExpr) * capacity);
+    memmove(parsed->buffer + capacity - after,
+            parsed->buffer + old_capacity - after, sizeof(ParsedExpr) * after);
+    parsed->capacity = capacity;
+
+    size_t leaves = parsed->leaves == 0 ? 1 : parsed->leaves;
+    while (leaves < capacity)
+        leaves *= 2;
+    if (leaves != parsed->leaves) {
+        parsed->ends =
+            reallocate(parsed->ends, sizeof(uint32_t) * 2 * parsed->leaves,
+                       sizeof(uint32_t) * 2 * leaves);
+        parsed->leaves = leaves;
+    }
+    build_ends(parsed);
+}
+
+// Forget every expression, leaving an empty entry for each token
+static void reset_parsed(Parser *self) {
+    ParsedExprs *parsed = &self->parsed;
+    parsed->length = parsed->gap = 0;
+    if (parsed->capacity < self->tokens.length)
+        grow_parsed(parsed, self->tokens.length);
+    memset(parsed->buffer, 0, sizeof(ParsedExpr) * parsed->capacity);
+    parsed->length = parsed->gap = self->tokens.length;
+    build_ends(parsed);
+}
+
+// The entry for the expression parsed from token 'index'
+static inline ParsedExpr get_parsed(const Parser *self, size_t index) {
+    const ParsedExprs *parsed = &self->parsed;
+    if (index < parsed->gap)
+        return parsed->buffer[index];
+    ParsedExpr entry =
+        parsed->buffer[index + parsed->capacity - parsed->length];
+    if (entry.end != 0)
+        entry.end = (uint32_t)(parsed->length - entry.end);
+    return entry;
+}
+
+static void set_parsed(Parser *self, size_t index, ParsedExpr entry) {
+    ParsedExprs *parsed = &self->parsed;
+    if (index >= parsed->gap) {
+        if (entry.end != 0)
+            entry.end = (uint32_t)(parsed->length - entry.end);
+        parsed->buffer[index + parsed->capacity - parsed->length] = entry;
+        return;
+    }
+    parsed->buffer[index] = entry;
+    uint32_t *ends = parsed->ends;
+    size_t node = parsed->leaves + index;
+    ends[node] = entry.end;
+    // The parents only change up to the first one that doesn't
+    for (node /= 2; node > 0; node /= 2) {
+        uint32_t end = later(ends[2 * node], ends[2 * node + 1]);
+        if (ends[node] == end)
+            break;
+        ends[node] = end;
+    }
+}
+
+Parser Parser_new_incremental(const String file_name, const String source) {
+    Parser parser = Parser_new(file_name, source);
+    parser.incremental = true;
+    reset_parsed(&parser);
+    return parser;
+}
+
+static inline Token peek(Parser *self) {
+    return TokenGap_get(&self->tokens, self->current);
+}
+
+// Once the `TK_EOF` at the end is reached, it is produced forever
 static inline Token next(Parser *self) {
-    return Lexer_next_token(&self->lexer);
+    Token token = TokenGap_get(&self->tokens, self->current);
+    if (token.kind != TK_EOF)
+        self->current++;
+    return token;
+}
+
+static inline Span token_span(Parser *self, Token token) {
+    return Token_span(self->source, token);
 }
 
-static int32_t parse_int(Parser *self, Span span) {
-    const char *num_str = self->lexer.source.buffer + span.start;
+// An integer token is a run of digits, so it ends at the first non-digit
+static int32_t parse_int(Parser *self, size_t start) {
+    const char *num_str = self->source.buffer + start;
 
     int32_t value = 0;
-    while (num_str < self->source.buffer + span.end && *num_str >= 0 &&
-           *num_str <= '9')
+    while (*num_str >= '0' && *num_str <= '9')
         value = value * 10 + (*num_str++ - '0');
 
     return value;
 }
 
-static double parse_float(Parser *self, Span span) {
-    const char *num_str = self->lexer.source.buffer + span.start;
+static double parse_float(Parser *self, size_t start) {
+    const char *num_str = self->source.buffer + start;
 
     double value = 0.0;
     while (num_str < self->source.buffer + self->source.length &&
@@ -70,12 +198,18 @@ static double parse_float(Parser *self, Span span) {
     return value / power;
 }
 
+// Produces the contents of the string literal at 'span', which stays valid
+// until the next string literal is parsed
 static ParseStringResult parse_string(Parser *self, Span span) {
     SyntaxError error;
-    const char *str = self->lexer.source.buffer + span.start;
+    const char *str = self->source.buffer + span.start;
     // The parsed string will always be less than or equal to the length - 2
-    // (for the quotes)
-    StringBuf buffer = StringBuf_with_capacity((span.end - span.start) - 2);
+    // (for the quotes), so room is made for it all up front
+    StringBuf *buffer = &self->string;
+    StringBuf_truncate(buffer, 0);
+    StringBuf_reserve(buffer, (span.end - span.start) - 2);
+
+#define PUSH_CHAR(c) (buffer->buffer[buffer->length++] = (c))
 
     size_t index = 0;
     bool escaped = false;
@@ -83,23 +217,23 @@ static ParseStringResult parse_string(Parser *self, Span span) {
         if (escaped) {
             switch (str[index]) {
             case 'n':
-                StringBuf_push(&buffer, '\n');
+                PUSH_CHAR('\n');
                 break;
             case 'r':
-                StringBuf_push(&buffer, '\r');
+                PUSH_CHAR('\r');
                 break;
             case 't':
-                StringBuf_push(&buffer, '\t');
+                PUSH_CHAR('\t');
                 break;
             case '0':
-                StringBuf_push(&buffer, '\0');
+                PUSH_CHAR('\0');
                 break;
             case '"':
             case '\\':
-                StringBuf_push(&buffer, str[index]);
+                PUSH_CHAR(str[index]);
                 break;
             default: {
-                size_t start = str + index - self->lexer.source.buffer - 1;
+                size_t start = str + index - self->source.buffer - 1;
                 size_t end = start + 2;
                 error = (SyntaxError){
                     ERROR_INVALID_ESC_SEQ,
@@ -118,22 +252,23 @@ static ParseStringResult parse_string(Parser *self, Span span) {
         } else if (str[index] == '\\') {
             escaped = true;
         } else {
-            StringBuf_push(&buffer, str[index]);
+            PUSH_CHAR(str[index]);
         }
     }
     return (ParseStringResult){
         .tag = RESULT_OK,
-        .value = {.ok = buffer},
+        .value = {.ok = BUF_TO_STR(*buffer)},
     };
 FAILURE:
-    StringBuf_free(&buffer);
     return (ParseStringResult){
         .tag = RESULT_ERR,
         .value = {.err = error},
     };
 }
 
-static ASTResult parse_literal(Parser *self) {
+#undef PUSH_CHAR
+
+static ParseResult parse_literal(Parser *self) {
     SyntaxError error;
     Token current = next(self);
     AST_Literal lit;
@@ -151,16 +286,17 @@ static ASTResult parse_literal(Parser *self) {
     case TK_INT:
         lit =
             (AST_Literal){.tag = LITERAL_INT,
-                          .value = {.integer = parse_int(self, current.span)}};
+                          .value = {.integer = parse_int(self, current.start)}};
         break;
     case TK_FLOAT:
-        lit = (AST_Literal){.tag = LITERAL_FLOAT,
-                            .value = {.real = parse_float(self, current.span)}};
+        lit =
+            (AST_Literal){.tag = LITERAL_FLOAT,
+                          .value = {.real = parse_float(self, current.start)}};
         break;
     case TK_STRING: {
-        StringBuf string;
+        String string;
         RET_ERR_ASSIGN(string, ParseStringResult,
-                       parse_string(self, current.span));
+                       parse_string(self, token_span(self, current)));
         lit = (AST_Literal){
             .tag = LITERAL_STRING,
             .value = {.string = string},
@@ -172,43 +308,23 @@ static ASTResult parse_literal(Parser *self) {
         UNREACHABLE;
     }
 
-    return (ASTResult){
-        .tag = RESULT_OK,
-        .value =
-            {
-                .ok =
-                    (AST){
-                        .tag = AST_LITERAL,
-                        .value = {.literal = lit},
-                        .span = current.span,
-                    },
-            },
-    };
+    ASTIndex literal = AST_push(&self->ast, AST_LITERAL,
+                                AST_literal_data(&self->ast, lit),
+                                current.start);
+    return (ParseResult){.tag = RESULT_OK, .value = {.ok = literal}};
 FAILURE:
-    return (ASTResult){.tag = RESULT_ERR, .value = {.err = error}};
+    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
-static AST parse_ident(Parser *self) {
-    Span curr_span = next(self).span;
-
-    return (AST){
-        .tag = AST_IDENT,
-        .value =
-            {
-                .ident =
-                    {
-                        .buffer = self->lexer.source.buffer + curr_span.start,
-                        .length = curr_span.end - curr_span.start,
-                    },
-            },
-        .span = curr_span};
+static inline Symbol intern_token(Parser *self, Token token) {
+    return Symbol_intern(Token_to_string(self->source, token));
 }
 
-static inline Span current_span(Parser *self) {
-    return (Span){
-        .start = self->lexer.start,
-        .end = self->lexer.current,
-    };
+static ASTIndex parse_ident(Parser *self) {
+    Token token = next(self);
+    return AST_push(&self->ast, AST_IDENT,
+                    (ASTData){.ident = intern_token(self, token)},
+                    token.start);
 }
 
 static TokenResult expect(Parser *self, TokenKind kind) {
@@ -222,7 +338,8 @@ static TokenResult expect(Parser *self, TokenKind kind) {
                               .error = {.unexpected_token =
                                             {.expected = kind_string,
                                              .got = token,
-                                             .span = current_span(self)}}}},
+                                             .span = token_span(
+                                                 self, token)}}}},
         };
     } else {
         return (TokenResult){
@@ -233,14 +350,14 @@ static TokenResult expect(Parser *self, TokenKind kind) {
 }
 
 static inline bool at(Parser *self, TokenKind kind) {
-    return peek(self)->kind == kind;
+    return peek(self).kind == kind;
 }
 
 static bool at_any(Parser *self, const TokenKind list[], size_t length) {
-    Token *current = peek(self);
+    Token current = peek(self);
 
     for (size_t i = 0; i < length; i++)
-        if (current->kind == list[i])
+        if (current.kind == list[i])
             return true;
 
     return false;
@@ -250,40 +367,30 @@ static ParseResult parse_expr_bp(Parser *self, uint8_t binding_power);
 
 static ParseResult parse_expr(Parser *self);
 
-static inline size_t get_end(Parser *self, ASTIndex node) {
-    return self->ast_arena.buffer[node].span.end;
-}
-
 static ParseResult parse_abstraction(Parser *self) {
     SyntaxError error;
     Token fun_token = next(self);
-    StringVec args = StringVec_new();
+    size_t first_param = self->params.length;
     Token first_param_token;
     RET_ERR_ASSIGN(first_param_token, TokenResult, expect(self, TK_IDENT));
-    StringVec_push(&args, Token_to_string(self->source, first_param_token));
+    Symbols_push(&self->params, intern_token(self, first_param_token));
 
     while (at(self, TK_IDENT)) {
         Token arg_token = next(self);
-        StringVec_push(&args, Token_to_string(self->source, arg_token));
+        Symbols_push(&self->params, intern_token(self, arg_token));
     }
     RET_ERR(TokenResult, expect(self, TK_ARROW));
 
     ASTIndex abs;
     RET_ERR_ASSIGN(abs, ParseResult, parse_expr(self));
-    Span abs_span = {.start = fun_token.span.start, .end = get_end(self, abs)};
-    for (size_t i = args.length; i > 0; i--) {
-        AST body_ast = {
-            .tag = AST_ABSTRACTION,
-            .value = {.abstraction =
-                          {
-                              .argument = args.buffer[i - 1],
-                              .body = abs,
-                          }},
-            .span = abs_span,
-        };
-        abs = ASTVec_push(&self->ast_arena, body_ast);
+    for (size_t i = self->params.length; i > first_param; i--) {
+        ASTData data = {.abstraction = {
+                            .argument = self->params.buffer[i - 1],
+                            .body = abs,
+                        }};
+        abs = AST_push(&self->ast, AST_ABSTRACTION, data, fun_token.start);
     }
-    StringVec_free(&args);
+    self->params.length = first_param;
     return (ParseResult){
         .tag = RESULT_OK,
         .value =
@@ -292,32 +399,25 @@ static ParseResult parse_abstraction(Parser *self) {
             },
     };
 FAILURE:
-    StringVec_free(&args);
+    self->params.length = first_param;
     return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
-static ASTResult parse_print(Parser *self) {
+static ParseResult parse_print(Parser *self) {
     SyntaxError error;
-    Span span = {.start = next(self).span.start};
+    size_t start = next(self).start;
     ASTIndex expr;
     RET_ERR_ASSIGN(expr, ParseResult, parse_expr(self));
-    span.end = get_end(self, expr);
-    AST print = {
-        .tag = AST_PRINT,
-        .value = {.print =
-                      {
-                          .expr = expr,
-                      }},
-        .span = span,
-    };
-    return (ASTResult){.tag = RESULT_OK, .value = {.ok = print}};
+    ASTIndex print = AST_push(&self->ast, AST_PRINT,
+                              (ASTData){.print = {.expr = expr}}, start);
+    return (ParseResult){.tag = RESULT_OK, .value = {.ok = print}};
 FAILURE:
-    return (ASTResult){.tag = RESULT_ERR, .value = {.err = error}};
+    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
-static ASTResult parse_if_then(Parser *self) {
+static ParseResult parse_if_then(Parser *self) {
     SyntaxError error;
-    Span span = (Span){.start = next(self).span.start};
+    size_t start = next(self).start;
     ASTIndex cond;
     RET_ERR_ASSIGN(cond, ParseResult, parse_expr(self));
     RET_ERR(TokenResult, expect(self, TK_THEN));
@@ -326,52 +426,259 @@ static ASTResult parse_if_then(Parser *self) {
     RET_ERR(TokenResult, expect(self, TK_ELSE));
     ASTIndex else_;
     RET_ERR_ASSIGN(else_, ParseResult, parse_expr(self));
-    span.end = get_end(self, else_);
-    AST if_then = {
-        .tag = AST_IF_ELSE,
-        .value = {.if_else =
-                      {
-                          .condition = cond,
-                          .then = then,
-                          .else_ = else_,
-                      }},
-        .span = span,
-    };
-    return (ASTResult){.tag = RESULT_OK, .value = {.ok = if_then}};
+    ASTIndex branches =
+        AST_push_extra(&self->ast, (ASTIndex[]){then, else_}, 2);
+    ASTData data = {.if_else = {.condition = cond, .branches = branches}};
+    ASTIndex if_then = AST_push(&self->ast, AST_IF_ELSE, data, start);
+    return (ParseResult){.tag = RESULT_OK, .value = {.ok = if_then}};
 FAILURE:
-    return (ASTResult){.tag = RESULT_ERR, .value = {.err = error}};
+    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+// An incremental parser gathers the bindings of a `let` into runs of
+// 'BINDING_RUN' to twice as many bindings, and those into nodes of as many
+// runs, and so on, so that reparsing a `let` reuses every run and node the edit
+// isn't inside of. Only the last run or node on each level can have fewer.
+constexpr size_t BINDING_RUN = 16;
+
+// Where the bindings and nodes of the `let` being parsed start on the stacks
+typedef struct BindingFrame {
+    size_t bindings;
+    size_t nodes;
+} BindingFrame;
+
+static inline uint32_t binding_height(Parser *self, ASTIndex node) {
+    return AST_bindings_header(&self->ast, node).height;
+}
+
+// Where the nodes of the same height as the one below 'top' on the stack start
+static size_t level_start(Parser *self, BindingFrame frame, size_t top) {
+    uint32_t height = binding_height(self, self->binding_nodes.buffer[top - 1]);
+    size_t first = top - 1;
+    while (first > frame.nodes &&
+           binding_height(self, self->binding_nodes.buffer[first - 1]) ==
+               height)
+        first--;
+    return first;
+}
+
+// The first token of the binding or node after the bindings or nodes which are
+// about to be gathered, ending at 'after' on the stack of bindings or nodes
+static size_t gathered_end(Parser *self, BindingFrame frame, bool nodes,
+                           size_t after) {
+    if (nodes && after < self->binding_nodes.length)
+        return self->node_tokens.buffer[after];
+    if (!nodes && after < self->bindings.length)
+        return self->binding_tokens.buffer[after];
+    if (nodes && frame.bindings < self->bindings.length)
+        return self->binding_tokens.buffer[frame.bindings];
+    return self->current;
+}
+
+// The tokens from 'token' to 'end' have to stay the same for the node to be
+// reused, including the one at 'end' where the `let` carried on from
+static void remember_bindings(Parser *self, size_t token, ASTIndex node,
+                              size_t end) {
+    set_parsed(self, token,
+               (ParsedExpr){.node = node,
+                            .end = (uint32_t)end,
+                            .binding_power = PARSED_BINDINGS});
+}
+
+// Gather the first 'count' bindings into a run, which goes on top of the nodes
+static void gather_run(Parser *self, BindingFrame frame, size_t count) {
+    size_t first = frame.bindings;
+    size_t after = first + count;
+    size_t token = self->binding_tokens.buffer[first];
+    size_t end = gathered_end(self, frame, false, after);
+    ASTIndex run = AST_push_run(&self->ast, self->bindings.buffer + first,
+                                count, end - token);
+    remember_bindings(self, token, run, end);
+
+    size_t rest = self->bindings.length - after;
+    memmove(self->bindings.buffer + first, self->bindings.buffer + after,
+            sizeof(AST_LetBind) * rest);
+    memmove(self->binding_tokens.buffer + first,
+            self->binding_tokens.buffer + after, sizeof(uint32_t) * rest);
+    self->bindings.length -= count;
+    self->binding_tokens.length -= count;
+    Indices_push(&self->binding_nodes, run);
+    Indices_push(&self->node_tokens, (uint32_t)token);
+}
+
+// Gather 'count' nodes of the same height from 'first' on the stack into a
+// node, which takes their place
+static void gather_nodes(Parser *self, BindingFrame frame, size_t first,
+                         size_t count) {
+    size_t after = first + count;
+    size_t token = self->node_tokens.buffer[first];
+    size_t end = gathered_end(self, frame, true, after);
+    ASTIndex node =
+        AST_push_binding_node(&self->ast, self->binding_nodes.buffer + first,
+                              count, end - token);
+    remember_bindings(self, token, node, end);
+
+    size_t rest = self->binding_nodes.length - after;
+    self->binding_nodes.buffer[first] = node;
+    memmove(self->binding_nodes.buffer + first + 1,
+            self->binding_nodes.buffer + after, sizeof(uint32_t) * rest);
+    memmove(self->node_tokens.buffer + first + 1,
+            self->node_tokens.buffer + after, sizeof(uint32_t) * rest);
+    self->binding_nodes.length -= count - 1;
+    self->node_tokens.length -= count - 1;
+}
+
+// Gather the first run's worth of bindings or nodes on any level which has
+// more than two runs' worth into a node on the level above. Adding one binding
+// or node at a time never leaves more than that.
+static void balance(Parser *self, BindingFrame frame) {
+    if (self->bindings.length - frame.bindings > 2 * BINDING_RUN)
+        gather_run(self, frame, BINDING_RUN);
+    size_t top = self->binding_nodes.length;
+    while (top > frame.nodes) {
+        size_t first = level_start(self, frame, top);
+        if (top - first > 2 * BINDING_RUN) {
+            gather_nodes(self, frame, first, BINDING_RUN);
+            top = first + 1;
+        } else {
+            top = first;
+        }
+    }
+}
+
+// Whether gathering everything below 'height' into nodes of that height only
+// makes full ones, so that an old node of 'height' can go after them
+static bool can_gather_below(Parser *self, BindingFrame frame,
+                             uint32_t height) {
+    size_t carried = self->bindings.length - frame.bindings;
+    if (carried != 0 && carried < BINDING_RUN)
+        return false;
+    carried = carried == 0 ? 0 : carried > 2 * BINDING_RUN ? 2 : 1;
+    size_t top = self->binding_nodes.length;
+    // Each level gets the nodes the one below it was gathered into
+    for (uint32_t level = 0; level < height; level++) {
+        size_t first = top;
+        while (first > frame.nodes &&
+               binding_height(self, self->binding_nodes.buffer[first - 1]) ==
+                   level)
+            first--;
+        size_t count = top - first + carried;
+        if (count != 0 && count < BINDING_RUN)
+            return false;
+        carried = count == 0 ? 0 : count > 2 * BINDING_RUN ? 2 : 1;
+        top = first;
+    }
+    return true;
+}
+
+// Gather everything on the stacks below 'height' into nodes of that height
+static void gather_below(Parser *self, BindingFrame frame, uint32_t height) {
+    size_t pending = self->bindings.length - frame.bindings;
+    if (pending != 0) {
+        gather_run(self, frame, pending);
+        balance(self, frame);
+    }
+    while (self->binding_nodes.length > frame.nodes) {
+        size_t top = self->binding_nodes.length;
+        if (binding_height(self, self->binding_nodes.buffer[top - 1]) >= height)
+            break;
+        size_t first = level_start(self, frame, top);
+        gather_nodes(self, frame, first, top - first);
+        balance(self, frame);
+    }
+}
+
+// Leave the stacks as they were before the `let`
+static void drop_bindings(Parser *self, BindingFrame frame) {
+    self->bindings.length = frame.bindings;
+    if (self->incremental) {
+        self->binding_tokens.length = frame.bindings;
+        self->binding_nodes.length = self->node_tokens.length = frame.nodes;
+    }
 }
 
-static ASTResult parse_let_binding(Parser *self) {
+// Reuse the highest node of bindings which was parsed from the current token
+// and can go after what is on the stacks without leaving a node that isn't full
+static bool reuse_bindings(Parser *self, BindingFrame frame) {
+    size_t token = self->current;
+    ParsedExpr parsed = get_parsed(self, token);
+    if (parsed.end == 0 || parsed.binding_power != PARSED_BINDINGS)
+        return false;
+
+    ASTIndex node = parsed.node;
+    uint32_t height = binding_height(self, node);
+    while (!can_gather_below(self, frame, height)) {
+        if (height == 0)
+            return false;
+        node = AST_bindings_child(&self->ast, node, 0);
+        height--;
+    }
+    gather_below(self, frame, height);
+    Indices_push(&self->binding_nodes, node);
+    Indices_push(&self->node_tokens, (uint32_t)token);
+    balance(self, frame);
+    self->current = token + AST_bindings_header(&self->ast, node).tokens;
+    return true;
+}
+
+// Gather the rest of the bindings and nodes into the root of the tree, with the
+// current token being the `in` after them
+static ASTIndex finish_bindings(Parser *self, BindingFrame frame) {
+    gather_below(self, frame, 0);
+    while (self->binding_nodes.length - frame.nodes > 1) {
+        size_t top = self->binding_nodes.length;
+        size_t first = level_start(self, frame, top);
+        gather_nodes(self, frame, first, top - first);
+        balance(self, frame);
+    }
+    if (self->binding_nodes.length == frame.nodes)
+        return AST_push_run(&self->ast, NULL, 0, 0);
+    return self->binding_nodes.buffer[frame.nodes];
+}
+
+static ParseResult parse_let_binding(Parser *self) {
     SyntaxError error;
-    Span span = (Span){.start = next(self).span.start};
-    AST_LetBindVec binds = AST_LetBindVec_new();
+    size_t start = next(self).start;
+    BindingFrame frame = {.bindings = self->bindings.length,
+                          .nodes = self->binding_nodes.length};
     while (at(self, TK_IDENT)) {
-        Span ident_span = next(self).span;
-        String ident = {.buffer = self->source.buffer + ident_span.start,
-                        .length = ident_span.end - ident_span.start};
+        if (self->incremental && reuse_bindings(self, frame))
+            continue;
+        size_t token = self->current;
+        Token ident_token = next(self);
+        Symbol ident = intern_token(self, ident_token);
         RET_ERR(TokenResult, expect(self, TK_ASSIGN));
         ASTIndex value;
         RET_ERR_ASSIGN(value, ParseResult, parse_expr(self));
-        AST_LetBindVec_push(&binds, (AST_LetBind){ident_span, ident, value});
-        Token *peeked = peek(self);
-        if (peeked->kind == TK_COMMA) {
+        AST_LetBindVec_push(&self->bindings,
+                            (AST_LetBind){.ident = ident,
+                                          .value = value,
+                                          .start = ident_token.start});
+        if (peek(self).kind == TK_COMMA) {
             next(self);
         }
+        if (self->incremental) {
+            Indices_push(&self->binding_tokens, (uint32_t)token);
+            balance(self, frame);
+        }
+    }
+    ASTIndex bindings;
+    if (self->incremental) {
+        bindings = finish_bindings(self, frame);
+    } else {
+        bindings =
+            AST_push_run(&self->ast, self->bindings.buffer + frame.bindings,
+                         self->bindings.length - frame.bindings, 0);
     }
+    drop_bindings(self, frame);
     RET_ERR(TokenResult, expect(self, TK_IN));
     ASTIndex body;
     RET_ERR_ASSIGN(body, ParseResult, parse_expr(self));
-    span.end = get_end(self, body);
-    AST let_in = (AST){
-        .tag = AST_LET_IN,
-        .value = {.let_in = (AST_LetIn){binds, body}},
-        .span = span,
-    };
-    return (ASTResult){.tag = RESULT_OK, .value = {.ok = let_in}};
+    ASTIndex let_in = AST_push_let_in(&self->ast, bindings, body, start);
+    return (ParseResult){.tag = RESULT_OK, .value = {.ok = let_in}};
 FAILURE:
-    AST_LetBindVec_free(&binds);
-    return (ASTResult){.tag = RESULT_ERR, .value = {.err = error}};
+    drop_bindings(self, frame);
+    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
 static ParseResult parse_term(Parser *self);
@@ -430,8 +737,8 @@ static bool infix_binding_power(TokenKind op, uint8_t *left, uint8_t *right) {
     case TK_APPEND: {
         // Left associative because it constructs a Snoc and not a Cons list.
         // Not entirely sure if this logic is sound but I guess we will see.
-        *left = 9;
-        *right = 8;
+        *left = 8;
+        *right = 9;
         break;
     }
     case TK_ADD:
@@ -450,6 +757,7 @@ static bool infix_binding_power(TokenKind op, uint8_t *left, uint8_t *right) {
     case TK_CONCAT: {
         *left = 14;
         *right = 15;
+        break;
     }
         // clang-format off
 	/* For completeness' sake:
@@ -465,10 +773,9 @@ static bool infix_binding_power(TokenKind op, uint8_t *left, uint8_t *right) {
     return true;
 }
 
-static ASTResult parse_prefix_op(Parser *self) {
+static ParseResult parse_prefix_op(Parser *self) {
     SyntaxError error;
     Token op_token = next(self);
-    Span op_span = op_token.span;
     AST_UnOp op = op_token.kind == TK_NOT ? UNOP_NOT : UNOP_NEGATE;
 
     uint8_t right_binding_power = prefix_binding_power(op);
@@ -477,66 +784,64 @@ static ASTResult parse_prefix_op(Parser *self) {
     RET_ERR_ASSIGN(operand, ParseResult,
                    parse_expr_bp(self, right_binding_power));
 
-    AST unop =
-        (AST){.tag = AST_UNARY_OP,
-              .value = {.unary_op = (AST_UnaryOp){op_span, op, operand}},
-              .span = {.start = op_span.start, .end = get_end(self, operand)}};
-    return (ASTResult){.tag = RESULT_OK, .value = {.ok = unop}};
+    ASTData data = {.unary_op = {.op = op, .operand = operand}};
+    ASTIndex unop =
+        AST_push(&self->ast, AST_UNARY_OP, data, op_token.start);
+    return (ParseResult){.tag = RESULT_OK, .value = {.ok = unop}};
 FAILURE:
-    return (ASTResult){.tag = RESULT_ERR, .value = {.err = error}};
+    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
-static ASTResult parse_list(Parser *self) {
+static ParseResult parse_list(Parser *self) {
     SyntaxError error;
-    Span list_span = (Span){.start = next(self).span.start};
-    AST_List items = AST_List_new();
+    size_t start = next(self).start;
+    size_t first_item = self->items.length;
     while (!at_any(self, (TokenKind[]){TK_COMMA, TK_RCURLY}, 2)) {
         ASTIndex item;
         RET_ERR_ASSIGN(item, ParseResult, parse_expr(self));
-        AST_List_push(&items, item);
+        AST_List_push(&self->items, item);
         if (at(self, TK_COMMA)) {
             next(self);
         } else if (at(self, TK_RCURLY)) {
             break;
         } else {
+            Token token = next(self);
             error = (SyntaxError){
                 .tag = ERROR_UNEXPECTED_TOKEN,
-                .error = {.unexpected_token = {.expected = STR("',' or '}'"),
-                                               .got = next(self),
-                                               .span = current_span(self)}}};
+                .error = {.unexpected_token = {
+                              .expected = STR("',' or '}'"),
+                              .got = token,
+                              .span = token_span(self, token),
+                          }}};
             goto FAILURE;
         }
     }
-    list_span.end = next(self).span.end;
-    return (ASTResult){.tag = RESULT_OK,
-                       .value = {.ok = (AST){.tag = AST_LIST,
-                                             .value = {.list = items},
-                                             .span = list_span}}};
+    size_t end = token_span(self, next(self)).end;
+    ASTIndex list = AST_push_list(
+        &self->ast, AST_List_items(&self->items) + first_item,
+        self->items.length - first_item, start, end);
+    AST_List_truncate(&self->items, first_item);
+    return (ParseResult){.tag = RESULT_OK, .value = {.ok = list}};
 FAILURE:
-    AST_List_free(&items);
-    return (ASTResult){.tag = RESULT_ERR, .value = {.err = error}};
+    AST_List_truncate(&self->items, first_item);
+    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
+// The parentheses aren't part of the grouped expression's span, since spans
+// are worked out from where nodes start (see 'AST_span')
 static ParseResult parse_grouping(Parser *self) {
     SyntaxError error;
-    size_t span_start = next(self).span.start;
+    next(self);
     ASTIndex grouped;
     RET_ERR_ASSIGN(grouped, ParseResult, parse_expr(self));
-    Token rparen;
-    RET_ERR_ASSIGN(rparen, TokenResult, expect(self, TK_RPAREN));
-    size_t span_end = rparen.span.end;
-    // Icky but I want to keep `parse_expr` as it is
-    self->ast_arena.buffer[grouped].span =
-        (Span){.start = span_start, .end = span_end};
+    RET_ERR(TokenResult, expect(self, TK_RPAREN));
     return (ParseResult){.tag = RESULT_OK, .value = {.ok = grouped}};
 FAILURE:
     return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
 static ParseResult parse_term(Parser *self) {
-    SyntaxError error;
-    AST term_ast;
-    TokenKind peeked = peek(self)->kind;
+    TokenKind peeked = peek(self).kind;
     switch (peeked) {
     case TK_UNIT:
     case TK_TRUE:
@@ -544,52 +849,43 @@ static ParseResult parse_term(Parser *self) {
     case TK_INT:
     case TK_FLOAT:
     case TK_STRING:
-        RET_ERR_ASSIGN(term_ast, ASTResult, parse_literal(self));
-        break;
+        return parse_literal(self);
     case TK_LCURLY:
-        RET_ERR_ASSIGN(term_ast, ASTResult, parse_list(self));
-        break;
+        return parse_list(self);
     case TK_PRINT:
-        RET_ERR_ASSIGN(term_ast, ASTResult, parse_print(self));
-        break;
+        return parse_print(self);
     case TK_FUN:
         return parse_abstraction(self);
     case TK_IF:
-        RET_ERR_ASSIGN(term_ast, ASTResult, parse_if_then(self));
-        break;
+        return parse_if_then(self);
     case TK_LET:
-        RET_ERR_ASSIGN(term_ast, ASTResult, parse_let_binding(self));
-        break;
+        return parse_let_binding(self);
     case TK_IDENT:
-        term_ast = parse_ident(self);
-        break;
+        return (ParseResult){.tag = RESULT_OK,
+                             .value = {.ok = parse_ident(self)}};
     case TK_SUB:
     case TK_NOT:
-        RET_ERR_ASSIGN(term_ast, ASTResult, parse_prefix_op(self));
-        break;
+        return parse_prefix_op(self);
     case TK_LPAREN:
         return parse_grouping(self);
     default: {
         Token err_tok = next(self);
-        error = (SyntaxError){
-            .tag = ERROR_UNEXPECTED_TOKEN,
-            .error = {.unexpected_token = {.expected = STR("expression"),
-                                           .got = err_tok,
-                                           .span = err_tok.span}}};
-        goto FAILURE;
+        return (ParseResult){
+            .tag = RESULT_ERR,
+            .value = {.err = {.tag = ERROR_UNEXPECTED_TOKEN,
+                              .error = {.unexpected_token =
+                                            {.expected = STR("expression"),
+                                             .got = err_tok,
+                                             .span = token_span(
+                                                 self, err_tok)}}}}};
     }
     }
-    ASTIndex term = ASTVec_push(&self->ast_arena, term_ast);
-    return (ParseResult){.tag = RESULT_OK, .value = {.ok = term}};
-FAILURE:
-    return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
-#define BINOP_TOKENS_LEN 17
+#define BINOP_TOKENS_LEN 16
 static const TokenKind BINOP_TOKENS[BINOP_TOKENS_LEN] = {
-    TK_FNPIPE, TK_APPEND, TK_CONCAT, TK_ADD, TK_SUB, TK_MUL,
-    TK_DIV,    TK_MOD,    TK_NOT,    TK_AND, TK_OR,  TK_LT,
-    TK_LEQ,    TK_GT,     TK_GEQ,    TK_EQ,  TK_NEQ,
+    TK_FNPIPE, TK_APPEND, TK_CONCAT, TK_ADD, TK_SUB, TK_MUL, TK_DIV, TK_MOD,
+    TK_AND,    TK_OR,     TK_LT,     TK_LEQ, TK_GT,  TK_GEQ, TK_EQ,  TK_NEQ,
 };
 
 #define EXPR_TERMINATORS_LEN 8
@@ -602,13 +898,25 @@ static const TokenKind TERM_TOKENS[TERM_TOKENS_LEN] = {
     TK_UNIT,   TK_TRUE,   TK_FALSE, TK_INT,   TK_FLOAT,
     TK_STRING, TK_LCURLY, TK_IDENT, TK_LPAREN};
 
-static ParseResult parse_expr_bp(Parser *self, uint8_t binding_power) {
+// Where the expression from the current token starts, which for a grouping is
+// where the expression inside it starts (see 'parse_grouping'). Working it out
+// from the tokens spares looking up the offset of the left hand side's node,
+// which might have to be moved along by every edit since it was parsed.
+static size_t expr_start(Parser *self) {
+    size_t index = self->current;
+    while (TokenGap_get(&self->tokens, index).kind == TK_LPAREN)
+        index++;
+    return TokenGap_get(&self->tokens, index).start;
+}
+
+static ParseResult parse_new_expr_bp(Parser *self, uint8_t binding_power) {
     SyntaxError error;
+    size_t start = expr_start(self);
     ASTIndex lhs;
     RET_ERR_ASSIGN(lhs, ParseResult, parse_term(self));
 
     while (true) {
-        TokenKind op = peek(self)->kind;
+        TokenKind op = peek(self).kind;
         if (at_any(self, BINOP_TOKENS, BINOP_TOKENS_LEN) ||
             at_any(self, TERM_TOKENS, TERM_TOKENS_LEN)) {
             // noop
@@ -625,7 +933,7 @@ static ParseResult parse_expr_bp(Parser *self, uint8_t binding_power) {
                                       .expected = STR(
                                           "operator or expression terminator"),
                                       .got = tok,
-                                      .span = tok.span,
+                                      .span = token_span(self, tok),
                                   }}}}};
         }
 
@@ -641,17 +949,8 @@ static ParseResult parse_expr_bp(Parser *self, uint8_t binding_power) {
             RET_ERR_ASSIGN(rhs, ParseResult,
                            parse_expr_bp(self, right_binding_power));
 
-            AST ast = {.tag = AST_BINARY_OP,
-                       .value = {.binary_op =
-                                     {
-                                         .op = (AST_BinOp)op_token.kind,
-                                         .op_span = op_token.span,
-                                         .lhs = lhs,
-                                         .rhs = rhs,
-                                     }},
-                       .span = {.start = self->ast_arena.buffer[lhs].span.start,
-                                .end = get_end(self, rhs)}};
-            lhs = ASTVec_push(&self->ast_arena, ast);
+            ASTData data = {.binary_op = {.lhs = lhs, .rhs = rhs}};
+            lhs = AST_push(&self->ast, (AST_BinOp)op_token.kind, data, start);
         }
         if (at_any(self, TERM_TOKENS, TERM_TOKENS_LEN)) {
             if (16 < binding_power)
@@ -660,12 +959,8 @@ static ParseResult parse_expr_bp(Parser *self, uint8_t binding_power) {
             ASTIndex arg;
             RET_ERR_ASSIGN(arg, ParseResult, parse_expr_bp(self, 17));
 
-            AST ast = {
-                .tag = AST_APPLICATION,
-                .value = {.application = {.function = lhs, .argument = arg}},
-                .span = {.start = self->ast_arena.buffer[lhs].span.start,
-                         .end = get_end(self, arg)}};
-            lhs = ASTVec_push(&self->ast_arena, ast);
+            ASTData data = {.application = {.function = lhs, .argument = arg}};
+            lhs = AST_push(&self->ast, AST_APPLICATION, data, start);
         }
     }
 
@@ -677,11 +972,37 @@ FAILURE:
     return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
+// Parsing an expression only depends on the binding power and the tokens up to
+// and including the one after it, so an incremental parser reuses the
+// expression it parsed from the same token last time whenever those haven't
+// changed (see 'splice_parsed')
+static ParseResult parse_expr_bp(Parser *self, uint8_t binding_power) {
+    if (!self->incremental)
+        return parse_new_expr_bp(self, binding_power);
+
+    size_t first = self->current;
+    ParsedExpr parsed = get_parsed(self, first);
+    if (parsed.end != 0 && parsed.binding_power == binding_power) {
+        self->current = parsed.end;
+        return (ParseResult){.tag = RESULT_OK, .value = {.ok = parsed.node}};
+    }
+
+    ParseResult result = parse_new_expr_bp(self, binding_power);
+    if (result.tag == RESULT_OK)
+        set_parsed(self, first,
+                   (ParsedExpr){
+                       .node = result.value.ok,
+                       .end = (uint32_t)self->current,
+                       .binding_power = binding_power,
+                   });
+    return result;
+}
+
 static inline ParseResult parse_expr(Parser *self) {
     return parse_expr_bp(self, 0);
 }
 
-ParseResult Parser_parse_expr(Parser *self) {
+static ParseResult parse_root(Parser *self) {
     SyntaxError error;
     ASTIndex ast;
     RET_ERR_ASSIGN(ast, ParseResult, parse_expr(self));
@@ -691,79 +1012,151 @@ FAILURE:
     return (ParseResult){.tag = RESULT_ERR, .value = {.err = error}};
 }
 
-void Parser_free(Parser *self) {
-    for (size_t index = 0; index < self->ast_arena.length; index++) {
-        AST item = self->ast_arena.buffer[index];
-        switch (item.tag) {
-        case AST_LIST:
-            AST_List_free(&item.value.list);
-            break;
-        case AST_LET_IN:
-            AST_LetBindVec_free(&item.value.let_in.bindings);
-            break;
-        case AST_LITERAL: {
-            AST_Literal lit = item.value.literal;
-            switch (lit.tag) {
-            case LITERAL_STRING:
-                StringBuf_free(&lit.value.string);
-            default:
-                (void)0;
+ParseResult Parser_parse_expr(Parser *self) {
+    ParseResult result = parse_root(self);
+    self->fresh_length = self->ast.length;
+    self->fresh_extra = self->ast.extra.length;
+    self->fresh_strings = self->ast.strings.length;
+    return result;
+}
+
+// Narrow the entry at 'index' before the gap, which looked at token 'first' or
+// past it, to the first node of bindings under it which didn't, if it has one
+static void forget_entry(Parser *self, size_t index, size_t first) {
+    ParsedExpr entry = self->parsed.buffer[index];
+    if (entry.binding_power == PARSED_BINDINGS) {
+        ASTIndex node = entry.node;
+        while (AST_bindings_header(&self->ast, node).height != 0) {
+            node = AST_bindings_child(&self->ast, node, 0);
+            size_t end = index + AST_bindings_header(&self->ast, node).tokens;
+            if (end < first) {
+                set_parsed(self, index,
+                           (ParsedExpr){.node = node,
+                                        .end = (uint32_t)end,
+                                        .binding_power = PARSED_BINDINGS});
+                return;
             }
-            break;
-        }
-        case AST_IDENT:
-        case AST_ABSTRACTION:
-        case AST_APPLICATION:
-        case AST_PRINT:
-        case AST_IF_ELSE:
-        case AST_UNARY_OP:
-        case AST_BINARY_OP:
-            break;
         }
     }
-
-    ASTVec_free(&self->ast_arena);
+    set_parsed(self, index, (ParsedExpr){0});
 }
 
-typedef struct {
-    size_t line_num;
-    size_t line_start;
-    size_t line_end;
-} LineInfo;
+// Go down the tree of ends from 'node' to the entries which looked at token
+// 'first' or past it
+static void forget_from(Parser *self, size_t node, size_t first) {
+    ParsedExprs *parsed = &self->parsed;
+    if (parsed->ends[node] < first)
+        return;
+    if (node >= parsed->leaves) {
+        forget_entry(self, node - parsed->leaves, first);
+        return;
+    }
+    forget_from(self, 2 * node, first);
+    forget_from(self, 2 * node + 1, first);
+}
 
-static LineInfo get_line_nums(String source, size_t span_start) {
-    LineInfo result = {.line_num = 1, .line_start = 0};
+// Move the gap to entry 'index', switching how the 'end' of the entries it
+// passes is stored
+static void move_parsed_gap(ParsedExprs *parsed, size_t index) {
+    size_t gap_length = parsed->capacity - parsed->length;
+    size_t low = parsed->gap < index ? parsed->gap : index;
+    size_t high = parsed->gap < index ? index : parsed->gap;
+    // Going backwards, since the gap might be shorter than the distance
+    for (size_t i = parsed->gap; i-- > index;) {
+        ParsedExpr entry = parsed->buffer[i];
+        if (entry.end != 0)
+            entry.end = (uint32_t)(parsed->length - entry.end);
+        parsed->buffer[i + gap_length] = entry;
+    }
+    for (size_t i = parsed->gap; i < index; i++) {
+        ParsedExpr entry = parsed->buffer[i + gap_length];
+        if (entry.end != 0)
+            entry.end = (uint32_t)(parsed->length - entry.end);
+        parsed->buffer[i] = entry;
+    }
+    parsed->gap = index;
+    update_ends(parsed, low, high);
+}
 
-    bool on_line = false;
-    for (size_t i = 0; i < source.length; i++) {
-        char c = source.buffer[i];
-        if (i == span_start)
-            on_line = true;
-        else if (c == '\n') {
-            if (on_line) {
-                result.line_end = i;
-                break;
-            }
-            result.line_num++;
-            result.line_start = i + 1;
-        } else if (c == '\0') {
-            if (on_line)
-                result.line_end = i;
-        }
+// Line the remembered expressions up with the tokens again after 'splice'. The
+// ones parsed from the replaced tokens are dropped, and so are the ones from
+// before them which the parser looked past the end of, apart from the first few
+// bindings of those which are `let` bindings. The ones after them are after the
+// gap, so they move along with their tokens without being touched.
+static void splice_parsed(Parser *self, TokenSplice splice) {
+    ParsedExprs *parsed = &self->parsed;
+    move_parsed_gap(parsed, splice.first);
+    if (splice.first > 0)
+        forget_from(self, 1, splice.first);
+
+    parsed->length -= splice.removed;
+    if (parsed->capacity < parsed->length + splice.added) {
+        size_t capacity = parsed->capacity * 2;
+        if (capacity < parsed->length + splice.added)
+            capacity = parsed->length + splice.added;
+        grow_parsed(parsed, capacity);
     }
+    memset(parsed->buffer + parsed->gap, 0, sizeof(ParsedExpr) * splice.added);
+    parsed->gap += splice.added;
+    parsed->length += splice.added;
+    update_ends(parsed, splice.first, parsed->gap);
+    ASSERT(parsed->length == self->tokens.length,
+           "There is an entry for each token");
+}
 
-    return result;
+// How much of each of the AST's arrays can go unused on top of what the last
+// parse from scratch used, so that tiny ASTs aren't parsed from scratch on
+// every other edit, and how many shifts can pile up
+constexpr size_t REPARSE_SLACK = 1024;
+
+// Whether reparsing has left more unused than used in one of the AST's arrays
+static inline bool outgrown(size_t length, size_t fresh) {
+    return length > 2 * fresh + REPARSE_SLACK;
 }
 
-static inline void write_repeat(char c, size_t n, FILE *stream) {
-    for (size_t i = 0; i < n; i++)
-        fputc(c, stream);
+ParseResult Parser_reparse(Parser *self, const String source, TextEdit edit) {
+    ASSERT(self->incremental, "Only incremental parsers can reparse");
+    TokenSplice splice = Lexer_relex(&self->tokens, source, edit);
+    self->source = source;
+    self->ast.source = source;
+    self->current = 0;
+
+    // Every reparse leaves behind the nodes, bindings and strings of the
+    // expressions the edit was inside of, and a shift which reading an offset
+    // from before it has to go through
+    if (outgrown(self->ast.length, self->fresh_length) ||
+        outgrown(self->ast.extra.length, self->fresh_extra) ||
+        outgrown(self->ast.strings.length, self->fresh_strings) ||
+        self->ast.shifts.length >= REPARSE_SLACK) {
+        AST_clear(&self->ast);
+        reset_parsed(self);
+        return Parser_parse_expr(self);
+    }
+
+    splice_parsed(self, splice);
+    AST_shift(&self->ast, edit.old_end,
+              (ptrdiff_t)edit.new_end - (ptrdiff_t)edit.old_end);
+    return parse_root(self);
 }
 
-static inline void write_num(size_t n, FILE *stream) {
-    if (n / 10)
-        write_num(n / 10, stream);
-    fputc((int)n % 10 + '0', stream);
+void Parser_free(Parser *self) {
+    MemoryTag saved_tag = set_memory_tag(MEMORY_LEXER);
+    TokenGap_free(&self->tokens);
+    set_memory_tag(saved_tag);
+    AST_free(&self->ast);
+    StringBuf_free(&self->string);
+    AST_List_free(&self->items);
+    AST_LetBindVec_free(&self->bindings);
+    Symbols_free(&self->params);
+    Indices_free(&self->binding_tokens);
+    Indices_free(&self->binding_nodes);
+    Indices_free(&self->node_tokens);
+    ParsedExprs *parsed = &self->parsed;
+    parsed->buffer = reallocate(parsed->buffer,
+                                sizeof(ParsedExpr) * parsed->capacity, 0);
+    parsed->ends =
+        reallocate(parsed->ends, sizeof(uint32_t) * 2 * parsed->leaves, 0);
+    *parsed = (ParsedExprs){0};
 }
 
 void Parser_print_diag(Parser *self, SyntaxError error, FILE *stream) {
@@ -782,40 +1175,7 @@ void Parser_print_diag(Parser *self, SyntaxError error, FILE *stream) {
         // To get MSVC to stfu
         UNREACHABLE;
     }
-    LineInfo line_info = get_line_nums(
-        (String){.buffer = self->source.buffer, .length = self->source.length},
-        span.start);
-    size_t num_digits = (size_t)(log10((double)line_info.line_num) + 1.0);
-    write_repeat(' ', num_digits + 2, stream);
-    fputs("┌─[", stream);
-    String_write(self->file_name, stream);
-    fputc(':', stream);
-    write_num(line_info.line_num, stream);
-    fputc(':', stream);
-    write_num(span.start - line_info.line_start, stream);
-    fputs("]\n", stream);
-    write_repeat(' ', num_digits + 2, stream);
-    fputs("│\n", stream);
-    fputc(' ', stream);
-    write_num(line_info.line_num, stream);
-    fputs(" │ ", stream);
-    String_write((String){.buffer = self->source.buffer + line_info.line_start,
-                          .length = span.start - line_info.line_start},
-                 stream);
-    String_write((String){.buffer = self->source.buffer + span.start,
-                          .length = span.end - span.start},
-                 stream);
-    String_write((String){.buffer = self->source.buffer + span.end,
-                          .length = line_info.line_end - span.end},
-                 stream);
-    fputc('\n', stream);
-    write_repeat(' ', num_digits + 2, stream);
-    fputs("│", stream);
-    write_repeat(' ', span.start - line_info.line_start + 1, stream);
-    write_repeat('^', span.end - span.start, stream);
-    fputc('\n', stream);
-    write_repeat(' ', num_digits + 4 + span.start - line_info.line_start,
-                 stream);
+    Diagnostic_print_snippet(self->file_name, self->source, span, stream);
     switch (error.tag) {
     case ERROR_INVALID_ESC_SEQ: {
         SyntaxError_InvalidEscSeq ies = error.error.invalid_esc_seq;
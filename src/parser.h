@@ -6,17 +6,90 @@
 #include "result.h"
 #include <stdio.h>
 
+DECL_VEC_HEADER(Symbol, Symbols)
+
+// Indices of tokens, or of the extra words of nodes of trees of bindings
+DECL_VEC_HEADER(uint32_t, Indices)
+
+// What parsing an expression from a token produced, which is kept so that
+// 'Parser_reparse' can reuse it
+typedef struct ParsedExpr {
+    // The expression's node, or the extra index of a node of a tree of bindings
+    // (see 'AST_push_binding_node') that starts at the token
+    ASTIndex node;
+    // The index of the token after the expression, which the parser looked at
+    // to see that the expression had ended, or 0 if no expression was parsed
+    // from this token
+    uint32_t end;
+    // The same tokens can make a different expression with a different binding
+    // power, or 'PARSED_BINDINGS' for bindings
+    uint8_t binding_power;
+} ParsedExpr;
+
+constexpr uint8_t PARSED_BINDINGS = UINT8_MAX;
+
+// The expressions parsed from each token, in a gap buffer like 'TokenGap'. The
+// entries before the gap store the index of their 'end', and the ones after it
+// how far it is from the end of the tokens, so neither moves when tokens are
+// added or removed at the gap.
+typedef struct ParsedExprs {
+    ParsedExpr *buffer;
+    size_t capacity;
+    size_t length;
+    size_t gap;
+    // A tree over the entries before the gap, where each of the 'leaves' is the
+    // 'end' of an entry and each parent is the largest of its two children, so
+    // that the entries which looked past an edit can be found without going
+    // through all of them
+    uint32_t *ends;
+    size_t leaves;
+} ParsedExprs;
+
 // Stores parser state
 typedef struct {
     const String file_name;
-    const String source;
-    Lexer lexer;
-    ASTVec ast_arena;
+    // Replaced by the edited source on each 'Parser_reparse'
+    String source;
+    // The whole source is lexed up front, and the parser walks through the
+    // tokens by index
+    TokenGap tokens;
+    // The index of the next token in 'tokens'
+    size_t current;
+    AST ast;
+    // The contents of the string literal being parsed, before they're copied
+    // into 'ast'
+    StringBuf string;
+    // Lists, let bindings and parameters are collected on these stacks while
+    // they are being parsed (nested ones above the ones they're nested in),
+    // then copied into 'ast' once their length is known
+    AST_List items;
+    AST_LetBindVec bindings;
+    Symbols params;
+    // An incremental parser gathers bindings into trees as it goes, which needs
+    // the first token of each binding, and a stack of the nodes of the trees
+    // which don't have a parent yet, with the first token of each (see
+    // 'parse_let_binding')
+    Indices binding_tokens;
+    Indices binding_nodes;
+    Indices node_tokens;
+    // Whether 'parsed' is kept up to date, with an entry for each token
+    bool incremental;
+    ParsedExprs parsed;
+    // How many nodes, extra words and string bytes 'ast' had after it was last
+    // parsed from scratch
+    size_t fresh_length;
+    size_t fresh_extra;
+    size_t fresh_strings;
 } Parser;
 
 // Creates a new parser that operates on 'source'
 Parser Parser_new(const String file_name, const String source);
 
+// Creates a parser like 'Parser_new', which also remembers every expression it
+// parses, so that after 'Parser_parse_expr' the source can be edited and
+// parsed again with 'Parser_reparse'
+Parser Parser_new_incremental(const String file_name, const String source);
+
 typedef struct SyntaxError_InvalidEscSeq {
     Span string;
     Span escape_sequence;
@@ -47,12 +120,25 @@ void Parser_print_diag(Parser *self, SyntaxError error, FILE *stream);
 
 DEF_RESULT(ASTIndex, SyntaxError, Parse);
 
-// Parse the source as an expression, pushing the AST nodes to 'self.ast_arena'
-// and returning the index of the parent expression
+// Parse the source as an expression, pushing the AST nodes to 'self.ast' and
+// returning the index of the parent expression
 ParseResult Parser_parse_expr(Parser *self);
 
-// Free all the allocations within each AST node and then free the AST arena
-// itself
+// Parse 'source', the parser's source after 'edit', again. Only the tokens
+// around the edit are lexed again, and any expression which was parsed from
+// tokens that haven't changed (including the one after it) is reused rather
+// than parsed again, so only the expressions the edit is inside of get new
+// nodes. The bindings of a `let` are reused a run at a time, so a `let` the
+// edit is inside of only gets a few new runs. The offsets of the nodes that are
+// kept are moved to match 'source' as they are read (see 'AST_start').
+//
+// The nodes, extra words and strings that are no longer used stay in 'self.ast'
+// until any of them outgrows what was used, when the source is parsed from
+// scratch instead. The AST must not have been changed since it was parsed (e.g.
+// by 'fold_constants').
+ParseResult Parser_reparse(Parser *self, const String source, TextEdit edit);
+
+// Free the AST, and everything the nodes in it refer to, at once
 void Parser_free(Parser *self);
 
 #endif
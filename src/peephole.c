@@ -0,0 +1,188 @@
+#include <stdint.h>
+#include <string.h>
+
+#include "common.h"
+#include "memory.h"
+#include "object.h"
+#include "peephole.h"
+
+// A jump in the optimised code whose offset still needs to be filled in, once
+// the new location of its target is known
+typedef struct JumpFixup {
+    // Where the offset lives in the optimised code
+    size_t operand;
+    // The offset of the target in the original code
+    size_t target;
+} JumpFixup;
+
+DEF_VEC_T(JumpFixup, JumpFixups)
+
+PeepholeStats PeepholeStats_new(void) { return (PeepholeStats){0}; }
+
+static const char *fused_op_name(OpCode op) {
+    switch (op) {
+    case VM_OP_ADD_CONST:
+        return "ADD_CONST";
+    case VM_OP_SUB_CONST:
+        return "SUB_CONST";
+    case VM_OP_ADD_LOCALS:
+        return "ADD_LOCALS";
+    case VM_OP_SUB_LOCALS:
+        return "SUB_LOCALS";
+    case VM_OP_JUMP_IF_NOT_LT:
+        return "JUMP_IF_NOT_LT";
+    case VM_OP_JUMP_IF_NOT_LEQ:
+        return "JUMP_IF_NOT_LEQ";
+    case VM_OP_JUMP_IF_NOT_GT:
+        return "JUMP_IF_NOT_GT";
+    case VM_OP_JUMP_IF_NOT_GEQ:
+        return "JUMP_IF_NOT_GEQ";
+    case VM_OP_JUMP_IF_NOT_EQ:
+        return "JUMP_IF_NOT_EQ";
+    case VM_OP_JUMP_IF_NOT_NEQ:
+        return "JUMP_IF_NOT_NEQ";
+    default:
+        UNREACHABLE;
+    }
+}
+
+void PeepholeStats_print(const PeepholeStats *self, FILE *stream) {
+    fputs("Peephole optimiser:\n", stream);
+    for (size_t i = 0; i < PEEPHOLE_FUSED_OPS; i++)
+        fprintf(stream, "  %-16s %8zu\n",
+                fused_op_name((OpCode)(VM_OP_ADD_CONST + i)), self->fused[i]);
+    fprintf(stream, "  %-16s %8zu -> %zu\n", "instructions",
+            self->instructions_before, self->instructions_after);
+}
+
+static inline bool is_jump(OpCode op) {
+    return op == VM_OP_JUMP || op == VM_OP_JUMP_IF_FALSE ||
+           (op >= VM_OP_JUMP_IF_NOT_LT && op <= VM_OP_JUMP_IF_NOT_NEQ);
+}
+
+static inline bool is_comparison(OpCode op) {
+    return op >= VM_OP_LT && op <= VM_OP_NEQ;
+}
+
+// Get the opcode of the instruction at 'offset', or 0 (which isn't a valid
+// opcode) if it is past the end of the code or is the target of a jump, since
+// fusing it with whatever precedes it would skip part of the fused instruction
+static inline OpCode fusable_op(const Code *code, const bool *is_target,
+                                size_t offset) {
+    if (offset >= code->length || is_target[offset])
+        return 0;
+    return (OpCode)code->buffer[offset];
+}
+
+void peephole_optimise(Chunk *chunk, PeepholeStats *stats) {
+    // Functions are compiled into chunks of their own
+    for (size_t i = 0; i < chunk->constants.length; i++) {
+        Value constant = chunk->constants.buffer[i];
+        if (Value_is_obj_type(constant, OBJ_FUNCTION))
+            peephole_optimise(&Value_as_function(constant)->chunk, stats);
+    }
+
+    const Code *code = &chunk->code;
+    // Both of these have an extra element for jumps to the end of the code
+    bool *is_target = reallocate(NULL, 0, sizeof(bool) * (code->length + 1));
+    memset(is_target, 0, sizeof(bool) * (code->length + 1));
+    size_t *new_offsets =
+        reallocate(NULL, 0, sizeof(size_t) * (code->length + 1));
+
+    size_t instructions_before = 0;
+    for (size_t i = 0; i < code->length; instructions_before++) {
+        OpCode op = (OpCode)code->buffer[i];
+        if (is_jump(op))
+            is_target[i + 2 + code->buffer[i + 1]] = true;
+        i += 1 + OpCode_operand_count(op);
+    }
+
+    Code optimised = Code_new();
+    JumpFixups fixups = JumpFixups_new();
+    size_t instructions_after = 0;
+    for (size_t i = 0; i < code->length; instructions_after++) {
+        const uint16_t *words = &code->buffer[i];
+        OpCode op = (OpCode)words[0];
+        size_t start = Code_push(&optimised, op);
+        // The length in the original code of the instruction(s) just emitted
+        size_t length = 1 + OpCode_operand_count(op);
+        OpCode fused = 0;
+
+        switch (op) {
+        case VM_OP_LOAD_LOCAL: {
+            OpCode next = fusable_op(code, is_target, i + 2);
+            OpCode last = fusable_op(code, is_target, i + 4);
+            if (next == VM_OP_LOAD_LOCAL &&
+                (last == VM_OP_ADD || last == VM_OP_SUB)) {
+                fused = last == VM_OP_ADD ? VM_OP_ADD_LOCALS : VM_OP_SUB_LOCALS;
+                Code_push(&optimised, words[1]);
+                Code_push(&optimised, words[3]);
+                length = 5;
+            } else {
+                Code_push(&optimised, words[1]);
+            }
+            break;
+        }
+        case VM_OP_LOAD_CONST: {
+            OpCode next = fusable_op(code, is_target, i + 2);
+            if (next == VM_OP_ADD || next == VM_OP_SUB) {
+                fused = next == VM_OP_ADD ? VM_OP_ADD_CONST : VM_OP_SUB_CONST;
+                length = 3;
+            }
+            Code_push(&optimised, words[1]);
+            break;
+        }
+        case VM_OP_JUMP:
+        case VM_OP_JUMP_IF_FALSE: {
+            size_t operand = Code_push(&optimised, UINT16_MAX);
+            JumpFixups_push(&fixups, (JumpFixup){.operand = operand,
+                                                 .target = i + 2 + words[1]});
+            break;
+        }
+        default:
+            if (is_comparison(op) &&
+                fusable_op(code, is_target, i + 1) == VM_OP_JUMP_IF_FALSE) {
+                fused = VM_OP_JUMP_IF_NOT_LT + (op - VM_OP_LT);
+                size_t operand = Code_push(&optimised, UINT16_MAX);
+                JumpFixups_push(&fixups,
+                                (JumpFixup){.operand = operand,
+                                            .target = i + 3 + words[2]});
+                length = 3;
+            } else {
+                for (size_t j = 1; j < length; j++)
+                    Code_push(&optimised, words[j]);
+            }
+            break;
+        }
+
+        if (fused != 0) {
+            optimised.buffer[start] = fused;
+            if (stats != NULL)
+                stats->fused[fused - VM_OP_ADD_CONST]++;
+        }
+        // Nothing can jump into the middle of a fused instruction, so only the
+        // first of the original offsets really matters
+        for (size_t j = 0; j < length; j++)
+            new_offsets[i + j] = start;
+        i += length;
+    }
+    new_offsets[code->length] = optimised.length;
+
+    // Fusing only ever shrinks the code, so the new offsets always fit
+    for (size_t i = 0; i < fixups.length; i++) {
+        JumpFixup *fixup = &fixups.buffer[i];
+        optimised.buffer[fixup->operand] =
+            (uint16_t)(new_offsets[fixup->target] - (fixup->operand + 1));
+    }
+
+    if (stats != NULL) {
+        stats->instructions_before += instructions_before;
+        stats->instructions_after += instructions_after;
+    }
+
+    JumpFixups_free(&fixups);
+    reallocate(new_offsets, sizeof(size_t) * (code->length + 1), 0);
+    reallocate(is_target, sizeof(bool) * (code->length + 1), 0);
+    Code_free(&chunk->code);
+    chunk->code = optimised;
+}
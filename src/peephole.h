@@ -0,0 +1,30 @@
+#ifndef CLAM_PEEPHOLE_H
+#define CLAM_PEEPHOLE_H
+
+#include <stddef.h>
+#include <stdio.h>
+
+#include "chunk.h"
+
+constexpr size_t PEEPHOLE_FUSED_OPS =
+    VM_OP_JUMP_IF_NOT_NEQ - VM_OP_ADD_CONST + 1;
+
+// How much the peephole optimiser managed to do, accumulated over every chunk
+// it is run on
+typedef struct PeepholeStats {
+    // Indexed by the fused opcode minus 'VM_OP_ADD_CONST'
+    size_t fused[PEEPHOLE_FUSED_OPS];
+    size_t instructions_before;
+    size_t instructions_after;
+} PeepholeStats;
+
+PeepholeStats PeepholeStats_new(void);
+
+void PeepholeStats_print(const PeepholeStats *self, FILE *stream);
+
+// Rewrite common instruction sequences in the stack bytecode 'chunk' into
+// superinstructions, along with the chunks of any functions it contains,
+// recording what happened in 'stats' (which may be NULL)
+void peephole_optimise(Chunk *chunk, PeepholeStats *stats);
+
+#endif
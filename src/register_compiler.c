@@ -0,0 +1,307 @@
+#include <stdint.h>
+
+#include "register_compiler.h"
+#include "rope.h"
+
+// A variable bound by a `let`, which lives in a register for the duration of
+// the `let`'s body
+typedef struct RegLocal {
+    Symbol name;
+    uint16_t reg;
+} RegLocal;
+
+DEF_VEC_T(RegLocal, RegLocals)
+
+// Stores register compiler state
+//
+// Registers are allocated like a stack: every expression is compiled into a
+// destination register chosen by its parent, and any temporaries it needs are
+// allocated above the ones in use and released as soon as it is done with them
+typedef struct RegisterCompiler {
+    AST *ast;
+    // Where constant objects (e.g. strings) are allocated
+    Heap *heap;
+    Chunk chunk;
+    // The locals currently in scope, innermost last
+    RegLocals locals;
+    // The lowest register that isn't in use
+    size_t next_reg;
+} RegisterCompiler;
+
+#define NO_ERROR ((MaybeCompileError){.tag = MAYBE_NONE})
+
+static inline MaybeCompileError compile_error(enum CompileErrorTag tag,
+                                              Span span) {
+    return (MaybeCompileError){
+        .tag = MAYBE_SOME,
+        .some = {.tag = tag, .span = span},
+    };
+}
+
+// An error pointing at the node at 'index', whose span is only worked out now
+// that it is needed
+static inline MaybeCompileError node_error(RegisterCompiler *self,
+                                           enum CompileErrorTag tag,
+                                           ASTIndex index) {
+    return compile_error(tag, AST_span(self->ast, index));
+}
+
+// Return early if 'maybe_error' contains an error
+#define TRY(maybe_error)                                                       \
+    do {                                                                       \
+        MaybeCompileError maybe = maybe_error;                                 \
+        if (maybe.tag == MAYBE_SOME)                                           \
+            return maybe;                                                      \
+    } while (0)
+
+static inline ASTData *get_node(RegisterCompiler *self, ASTIndex index) {
+    return &self->ast->data[index];
+}
+
+static inline size_t emit(RegisterCompiler *self, uint16_t word) {
+    return Chunk_write(&self->chunk, word);
+}
+
+// Returns false if every register is in use, leaving the caller to report it
+static bool alloc_reg(RegisterCompiler *self, /* out */ uint16_t *reg) {
+    if (self->next_reg > UINT16_MAX)
+        return false;
+
+    *reg = (uint16_t)self->next_reg++;
+    if (self->next_reg > self->chunk.max_stack)
+        self->chunk.max_stack = self->next_reg;
+    return true;
+}
+
+// Returns the register of the innermost local called 'name', or -1 if it
+// isn't bound
+static int32_t lookup_local(RegisterCompiler *self, Symbol name) {
+    for (size_t i = self->locals.length; i > 0; i--) {
+        RegLocal *local = &self->locals.buffer[i - 1];
+        if (local->name == name)
+            return local->reg;
+    }
+    return -1;
+}
+
+// Emit a jump instruction with a placeholder offset, returning the location of
+// the offset so it can be patched later
+static size_t emit_jump(RegisterCompiler *self, RegOpCode op) {
+    emit(self, op);
+    return emit(self, UINT16_MAX);
+}
+
+// Point the jump whose offset is at 'location' to the end of the code
+static MaybeCompileError patch_jump(RegisterCompiler *self, size_t location,
+                                    ASTIndex node) {
+    size_t offset = self->chunk.code.length - (location + 1);
+    if (offset > UINT16_MAX)
+        return node_error(self, COMPILE_ERROR_JUMP_TOO_LONG, node);
+
+    self->chunk.code.buffer[location] = (uint16_t)offset;
+    return NO_ERROR;
+}
+
+static MaybeCompileError compile_into(RegisterCompiler *self, ASTIndex index,
+                                      uint16_t dst);
+
+// Get a register containing the value of the node at 'index'. Locals are used
+// in place, anything else is compiled into a fresh temporary, which the caller
+// is responsible for releasing.
+static MaybeCompileError compile_operand(RegisterCompiler *self,
+                                         ASTIndex index,
+                                         /* out */ uint16_t *reg) {
+    if (AST_tag(self->ast, index) == AST_IDENT) {
+        int32_t local = lookup_local(self, get_node(self, index)->ident);
+        if (local < 0)
+            return node_error(self, COMPILE_ERROR_UNBOUND_NAME, index);
+
+        *reg = (uint16_t)local;
+        return NO_ERROR;
+    }
+
+    if (!alloc_reg(self, reg))
+        return node_error(self, COMPILE_ERROR_TOO_MANY_LOCALS, index);
+    return compile_into(self, index, *reg);
+}
+
+// 'node' is what any error points at
+static MaybeCompileError emit_constant(RegisterCompiler *self, Value value,
+                                       ASTIndex node, uint16_t dst) {
+    size_t index = Chunk_add_constant(&self->chunk, value);
+    if (index > UINT16_MAX)
+        return node_error(self, COMPILE_ERROR_TOO_MANY_CONSTANTS, node);
+
+    emit(self, REG_OP_LOAD_CONST);
+    emit(self, dst);
+    emit(self, (uint16_t)index);
+    return NO_ERROR;
+}
+
+static MaybeCompileError compile_literal(RegisterCompiler *self,
+                                         ASTIndex index, uint16_t dst) {
+    AST_Literal literal = AST_literal(self->ast, index);
+    switch (literal.tag) {
+    case LITERAL_UNIT:
+        return emit_constant(self, Value_unit(), index, dst);
+    case LITERAL_BOOL:
+        return emit_constant(self, Value_bool(literal.value.boolean), index,
+                             dst);
+    case LITERAL_INT:
+        return emit_constant(self, Value_int(literal.value.integer), index,
+                             dst);
+    case LITERAL_FLOAT:
+        return emit_constant(self, Value_float(literal.value.real), index,
+                             dst);
+    case LITERAL_STRING: {
+        Value string = Value_string(self->heap, literal.value.string);
+        return emit_constant(self, string, index, dst);
+    }
+    }
+    UNREACHABLE;
+}
+
+static MaybeCompileError compile_let_in(RegisterCompiler *self,
+                                        ASTIndex index, uint16_t dst) {
+    size_t saved_reg = self->next_reg;
+    size_t saved_locals = self->locals.length;
+    AST_BindingIter bindings = AST_bindings(self->ast, index);
+    AST_LetBind binding;
+    while (AST_next_binding(&bindings, &binding)) {
+        uint16_t reg;
+        // Values are immutable, so binding one local to another can just
+        // share its register instead of copying it
+        if (AST_tag(self->ast, binding.value) == AST_IDENT) {
+            TRY(compile_operand(self, binding.value, &reg));
+        } else {
+            if (!alloc_reg(self, &reg))
+                return compile_error(COMPILE_ERROR_TOO_MANY_LOCALS,
+                                     AST_LetBind_span(binding));
+            TRY(compile_into(self, binding.value, reg));
+        }
+        RegLocals_push(&self->locals,
+                       (RegLocal){.name = binding.ident, .reg = reg});
+    }
+
+    TRY(compile_into(self, get_node(self, index)->let_in.body, dst));
+    self->next_reg = saved_reg;
+    self->locals.length = saved_locals;
+    return NO_ERROR;
+}
+
+static MaybeCompileError compile_if_else(RegisterCompiler *self,
+                                         ASTIndex index, uint16_t dst) {
+    size_t saved_reg = self->next_reg;
+    uint16_t condition;
+    TRY(compile_operand(self, get_node(self, index)->if_else.condition,
+                        &condition));
+    self->next_reg = saved_reg;
+    ASTIndex *branches = AST_branches(self->ast, index);
+    ASTIndex then = branches[0], else_ = branches[1];
+
+    emit(self, REG_OP_JUMP_IF_FALSE);
+    emit(self, condition);
+    size_t else_jump = emit(self, UINT16_MAX);
+    TRY(compile_into(self, then, dst));
+    size_t end_jump = emit_jump(self, REG_OP_JUMP);
+
+    TRY(patch_jump(self, else_jump, index));
+    TRY(compile_into(self, else_, dst));
+    return patch_jump(self, end_jump, index);
+}
+
+static MaybeCompileError compile_unary(RegisterCompiler *self, RegOpCode op,
+                                       ASTIndex operand, uint16_t dst) {
+    size_t saved_reg = self->next_reg;
+    uint16_t src;
+    TRY(compile_operand(self, operand, &src));
+    self->next_reg = saved_reg;
+
+    emit(self, op);
+    emit(self, dst);
+    emit(self, src);
+    return NO_ERROR;
+}
+
+static MaybeCompileError compile_binary_op(RegisterCompiler *self,
+                                           ASTIndex index, uint16_t dst) {
+    struct AST_BinaryOp *binop = &get_node(self, index)->binary_op;
+    AST_BinOp op = AST_binop(self->ast, index);
+    switch (op) {
+    case BINOP_FNPIPE:
+    case BINOP_APPEND:
+    case BINOP_CONCAT:
+        return node_error(self, COMPILE_ERROR_UNSUPPORTED, index);
+    default: {
+        size_t saved_reg = self->next_reg;
+        uint16_t lhs, rhs;
+        TRY(compile_operand(self, binop->lhs, &lhs));
+        TRY(compile_operand(self, binop->rhs, &rhs));
+        self->next_reg = saved_reg;
+
+        emit(self, (RegOpCode)op);
+        emit(self, dst);
+        emit(self, lhs);
+        emit(self, rhs);
+        return NO_ERROR;
+    }
+    }
+}
+
+static MaybeCompileError compile_into(RegisterCompiler *self, ASTIndex index,
+                                      uint16_t dst) {
+    ASTData *node = get_node(self, index);
+    switch (AST_tag(self->ast, index)) {
+    case AST_LITERAL:
+        return compile_literal(self, index, dst);
+    case AST_IDENT: {
+        uint16_t src;
+        TRY(compile_operand(self, index, &src));
+        emit(self, REG_OP_MOVE);
+        emit(self, dst);
+        emit(self, src);
+        return NO_ERROR;
+    }
+    case AST_LET_IN:
+        return compile_let_in(self, index, dst);
+    case AST_PRINT:
+        return compile_unary(self, REG_OP_PRINT, node->print.expr, dst);
+    case AST_IF_ELSE:
+        return compile_if_else(self, index, dst);
+    case AST_UNARY_OP:
+        return compile_unary(self, (RegOpCode)node->unary_op.op,
+                             node->unary_op.operand, dst);
+    case AST_BINARY_OP:
+        return compile_binary_op(self, index, dst);
+    case AST_LIST:
+    case AST_ABSTRACTION:
+    case AST_APPLICATION:
+        return node_error(self, COMPILE_ERROR_UNSUPPORTED, index);
+    }
+    UNREACHABLE;
+}
+
+CompileResult compile_registers(AST *ast, ASTIndex root, Heap *heap) {
+    RegisterCompiler compiler = {
+        .ast = ast,
+        .heap = heap,
+        .chunk = Chunk_new(),
+        .locals = RegLocals_new(),
+        .next_reg = 0,
+    };
+
+    // There are no registers in use yet, so this can't fail
+    uint16_t result;
+    alloc_reg(&compiler, &result);
+    MaybeCompileError maybe_error = compile_into(&compiler, root, result);
+    RegLocals_free(&compiler.locals);
+    if (maybe_error.tag == MAYBE_SOME) {
+        Chunk_free(&compiler.chunk);
+        return (CompileResult){.tag = RESULT_ERR,
+                               .value = {.err = maybe_error.some}};
+    }
+
+    emit(&compiler, REG_OP_RETURN);
+    emit(&compiler, result);
+    return (CompileResult){.tag = RESULT_OK, .value = {.ok = compiler.chunk}};
+}
@@ -0,0 +1,17 @@
+#ifndef CLAM_REGISTER_COMPILER_H
+#define CLAM_REGISTER_COMPILER_H
+
+#include "ast.h"
+#include "compiler.h"
+#include "object.h"
+
+// Compile the expression at 'root' into a chunk of three-address register
+// bytecode which returns the value of the expression, allocating any constant
+// objects in 'heap'
+//
+// This is a prototype for straight-line arithmetic: functions, calls, lists,
+// `++` and `::` are reported as 'COMPILE_ERROR_UNSUPPORTED', as is `|>`, which
+// the stack backend doesn't support either.
+CompileResult compile_registers(AST *ast, ASTIndex root, Heap *heap);
+
+#endif
@@ -0,0 +1,191 @@
+#include <stdint.h>
+#include <stdio.h>
+
+#include "common.h"
+#include "vm.h"
+#include "vm_ops.h"
+
+// Labels as values are a GNU extension, which is exactly what we're after here
+#ifdef VM_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+RunResult VM_run_registers(VM *self, Chunk *chunk) {
+    RuntimeError error;
+    if (chunk->max_stack > VM_STACK_MAX) {
+        error = (RuntimeError){.tag = RUNTIME_ERROR_STACK_OVERFLOW};
+        goto FAILURE;
+    }
+
+    const uint16_t *ip = chunk->code.buffer;
+    const Value *constants = chunk->constants.buffer;
+    // The registers live in the same memory as the stack machine's stack
+    Value *const regs = self->stack;
+
+#define READ() (*ip++)
+#define REG() (regs[READ()])
+
+// Reads the destination and both operand registers, in that order
+#define REGISTER_OP(operation, ...)                                            \
+    do {                                                                       \
+        Value *dst = &REG();                                                   \
+        Value lhs = REG();                                                     \
+        Value rhs = REG();                                                     \
+        operation(*dst, lhs, rhs, __VA_ARGS__);                                \
+    } while (0)
+
+#ifdef VM_THREADED_DISPATCH
+    static void *const dispatch_table[] = {
+        [REG_OP_LOAD_CONST] = &&REG_OP_LOAD_CONST_LABEL,
+        [REG_OP_MOVE] = &&REG_OP_MOVE_LABEL,
+        [REG_OP_PRINT] = &&REG_OP_PRINT_LABEL,
+        [REG_OP_JUMP] = &&REG_OP_JUMP_LABEL,
+        [REG_OP_JUMP_IF_FALSE] = &&REG_OP_JUMP_IF_FALSE_LABEL,
+        [REG_OP_RETURN] = &&REG_OP_RETURN_LABEL,
+        [REG_OP_ADD] = &&REG_OP_ADD_LABEL,
+        [REG_OP_SUB] = &&REG_OP_SUB_LABEL,
+        [REG_OP_MUL] = &&REG_OP_MUL_LABEL,
+        [REG_OP_DIV] = &&REG_OP_DIV_LABEL,
+        [REG_OP_MOD] = &&REG_OP_MOD_LABEL,
+        [REG_OP_NOT] = &&REG_OP_NOT_LABEL,
+        [REG_OP_AND] = &&REG_OP_AND_LABEL,
+        [REG_OP_OR] = &&REG_OP_OR_LABEL,
+        [REG_OP_LT] = &&REG_OP_LT_LABEL,
+        [REG_OP_LEQ] = &&REG_OP_LEQ_LABEL,
+        [REG_OP_GT] = &&REG_OP_GT_LABEL,
+        [REG_OP_GEQ] = &&REG_OP_GEQ_LABEL,
+        [REG_OP_EQ] = &&REG_OP_EQ_LABEL,
+        [REG_OP_NEQ] = &&REG_OP_NEQ_LABEL,
+        [REG_OP_NEGATE] = &&REG_OP_NEGATE_LABEL,
+    };
+#define TARGET(op) op##_LABEL
+#define DISPATCH() goto *dispatch_table[READ()]
+
+    DISPATCH();
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+
+    while (true) {
+        switch ((RegOpCode)READ()) {
+#endif
+    TARGET(REG_OP_LOAD_CONST) : {
+        Value *dst = &REG();
+        *dst = constants[READ()];
+        DISPATCH();
+    }
+    TARGET(REG_OP_MOVE) : {
+        Value *dst = &REG();
+        *dst = REG();
+        DISPATCH();
+    }
+    TARGET(REG_OP_PRINT) : {
+        Value *dst = &REG();
+        Value_write(REG(), stdout);
+        putchar('\n');
+        *dst = Value_unit();
+        DISPATCH();
+    }
+    TARGET(REG_OP_JUMP) : {
+        uint16_t offset = READ();
+        ip += offset;
+        DISPATCH();
+    }
+    TARGET(REG_OP_JUMP_IF_FALSE) : {
+        Value condition = REG();
+        uint16_t offset = READ();
+        EXPECT(Value_is_bool, "bool", condition);
+        if (!Value_as_bool(condition))
+            ip += offset;
+        DISPATCH();
+    }
+    TARGET(REG_OP_RETURN) : {
+        return (RunResult){.tag = RESULT_OK, .value = {.ok = REG()}};
+    }
+    TARGET(REG_OP_ADD) : {
+        REGISTER_OP(ARITHMETIC_OP, wrapping_add, OP_ADD);
+        DISPATCH();
+    }
+    TARGET(REG_OP_SUB) : {
+        REGISTER_OP(ARITHMETIC_OP, wrapping_sub, OP_SUB);
+        DISPATCH();
+    }
+    TARGET(REG_OP_MUL) : {
+        REGISTER_OP(ARITHMETIC_OP, wrapping_mul, OP_MUL);
+        DISPATCH();
+    }
+    TARGET(REG_OP_DIV) : {
+        REGISTER_OP(DIVISION_OP, wrapping_div, OP_DIV);
+        DISPATCH();
+    }
+    TARGET(REG_OP_MOD) : {
+        REGISTER_OP(DIVISION_OP, wrapping_mod, fmod);
+        DISPATCH();
+    }
+    TARGET(REG_OP_NOT) : {
+        Value *dst = &REG();
+        NOT_OP(*dst, REG());
+        DISPATCH();
+    }
+    TARGET(REG_OP_AND) : {
+        REGISTER_OP(BOOL_OP, OP_AND);
+        DISPATCH();
+    }
+    TARGET(REG_OP_OR) : {
+        REGISTER_OP(BOOL_OP, OP_OR);
+        DISPATCH();
+    }
+    TARGET(REG_OP_LT) : {
+        REGISTER_OP(COMPARISON_OP, OP_LT);
+        DISPATCH();
+    }
+    TARGET(REG_OP_LEQ) : {
+        REGISTER_OP(COMPARISON_OP, OP_LEQ);
+        DISPATCH();
+    }
+    TARGET(REG_OP_GT) : {
+        REGISTER_OP(COMPARISON_OP, OP_GT);
+        DISPATCH();
+    }
+    TARGET(REG_OP_GEQ) : {
+        REGISTER_OP(COMPARISON_OP, OP_GEQ);
+        DISPATCH();
+    }
+    TARGET(REG_OP_EQ) : {
+        Value *dst = &REG();
+        Value lhs = REG();
+        EQ_OP(*dst, lhs, REG());
+        DISPATCH();
+    }
+    TARGET(REG_OP_NEQ) : {
+        Value *dst = &REG();
+        Value lhs = REG();
+        NEQ_OP(*dst, lhs, REG());
+        DISPATCH();
+    }
+    TARGET(REG_OP_NEGATE) : {
+        Value *dst = &REG();
+        NEGATE_OP(*dst, REG());
+        DISPATCH();
+    }
+#ifndef VM_THREADED_DISPATCH
+        }
+        // The compiler never emits anything outside of 'RegOpCode'
+        UNREACHABLE;
+    }
+#endif
+
+#undef READ
+#undef REG
+#undef REGISTER_OP
+#undef TARGET
+#undef DISPATCH
+
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
+
+#ifdef VM_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
@@ -0,0 +1,122 @@
+#include <string.h>
+
+#include "common.h"
+#include "hashtable.h"
+#include "memory.h"
+#include "rope.h"
+
+// Concatenations shorter than this are copied into a flat string, since a
+// rope's header and the later flattening would cost more than the copy
+constexpr size_t ROPE_MIN_LENGTH = 64;
+
+Value Value_string(Heap *heap, String string) {
+    if (string.length <= VALUE_SHORT_STRING_MAX)
+        return Value_short_string(string.buffer, string.length);
+    return Value_obj(&ObjString_copy(heap, string)->obj);
+}
+
+size_t Value_string_length(Value value) {
+    if (Value_is_short_string(value)) {
+        char buffer[VALUE_SHORT_STRING_MAX];
+        return Value_short_string_read(value, buffer);
+    }
+    Obj *obj = Value_as_obj(value);
+    return obj->type == OBJ_STRING ? ((ObjString *)obj)->length
+                                   : ((ObjRope *)obj)->length;
+}
+
+// Copies the characters of the rope's halves into one buffer, then lets go of
+// the halves. Ropes built by appending in a loop are as deep as they are
+// long, so this keeps its own stack of the strings left to copy rather than
+// recursing.
+static void flatten(ObjRope *rope) {
+    char *flat = reallocate_as(MEMORY_STRINGS, NULL, 0, rope->length);
+    Values pending = Values_new();
+    Values_push(&pending, rope->right);
+    Values_push(&pending, rope->left);
+    size_t offset = 0;
+    while (pending.length > 0) {
+        Value value = pending.buffer[--pending.length];
+        if (Value_is_obj_type(value, OBJ_ROPE) &&
+            Value_as_rope(value)->flat == NULL) {
+            Values_push(&pending, Value_as_rope(value)->right);
+            Values_push(&pending, Value_as_rope(value)->left);
+            continue;
+        }
+        char buffer[VALUE_SHORT_STRING_MAX];
+        String chars = Value_string_chars(value, buffer);
+        memcpy(flat + offset, chars.buffer, chars.length);
+        offset += chars.length;
+    }
+    Values_free(&pending);
+    ASSERT(offset == rope->length, "A rope is as long as its halves");
+
+    rope->flat = flat;
+    rope->left = Value_unit();
+    rope->right = Value_unit();
+}
+
+String Value_string_chars(Value value, char *buffer) {
+    if (Value_is_short_string(value)) {
+        size_t length = Value_short_string_read(value, buffer);
+        return (String){.buffer = buffer, .length = length};
+    }
+    if (Value_is_obj_type(value, OBJ_STRING))
+        return ObjString_as_string(Value_as_string(value));
+
+    ObjRope *rope = Value_as_rope(value);
+    if (rope->flat == NULL)
+        flatten(rope);
+    return (String){.buffer = rope->flat, .length = rope->length};
+}
+
+Value Value_concat_strings(Heap *heap, Value a, Value b) {
+    size_t a_length = Value_string_length(a);
+    size_t b_length = Value_string_length(b);
+    if (a_length == 0)
+        return b;
+    if (b_length == 0)
+        return a;
+
+    size_t length = a_length + b_length;
+    if (length >= ROPE_MIN_LENGTH)
+        return Value_obj(&ObjRope_new(heap, a, b, length)->obj);
+
+    char a_buffer[VALUE_SHORT_STRING_MAX], b_buffer[VALUE_SHORT_STRING_MAX];
+    String a_chars = Value_string_chars(a, a_buffer);
+    String b_chars = Value_string_chars(b, b_buffer);
+    char chars[ROPE_MIN_LENGTH];
+    memcpy(chars, a_chars.buffer, a_length);
+    memcpy(chars + a_length, b_chars.buffer, b_length);
+    return Value_string(heap, (String){.buffer = chars, .length = length});
+}
+
+uint32_t Value_string_hash(Value value) {
+    if (Value_is_obj_type(value, OBJ_STRING))
+        return Value_as_string(value)->hash;
+
+    char buffer[VALUE_SHORT_STRING_MAX];
+    if (Value_is_short_string(value))
+        return hash_string(Value_string_chars(value, buffer));
+
+    ObjRope *rope = Value_as_rope(value);
+    if (!rope->hashed) {
+        rope->hash = hash_string(Value_string_chars(value, buffer));
+        rope->hashed = true;
+    }
+    return rope->hash;
+}
+
+bool Value_string_eq(Value a, Value b) {
+    if (Value_string_length(a) != Value_string_length(b))
+        return false;
+    // Flat strings always know their hash, so it's worth checking first to
+    // save comparing the characters of long strings that differ
+    if (Value_is_obj_type(a, OBJ_STRING) && Value_is_obj_type(b, OBJ_STRING) &&
+        Value_as_string(a)->hash != Value_as_string(b)->hash)
+        return false;
+
+    char a_buffer[VALUE_SHORT_STRING_MAX], b_buffer[VALUE_SHORT_STRING_MAX];
+    return String_eq(Value_string_chars(a, a_buffer),
+                     Value_string_chars(b, b_buffer));
+}
@@ -0,0 +1,49 @@
+#ifndef CLAM_ROPE_H
+#define CLAM_ROPE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "object.h"
+#include "string.h"
+#include "value.h"
+
+// A string value is stored in one of three ways, depending on its length and
+// where it came from:
+//
+// * Strings of up to 'VALUE_SHORT_STRING_MAX' characters are packed into the
+//   value itself, so they never allocate. Every string that fits is stored
+//   like this, so a short string is never equal to any other kind.
+// * Longer literals and concatenations are flat strings, an ObjString.
+// * Long concatenations are ropes, an ObjRope of the two halves, which makes
+//   `++` O(1) no matter how long the strings are. A rope's characters are
+//   copied into one buffer the first time they're needed, and kept there.
+//
+// The length of a string is always known without looking at its characters,
+// and its hash is worked out at most once.
+
+// Returns the string value with a copy of the characters in 'string'
+Value Value_string(Heap *heap, String string);
+
+// Returns the concatenation of two strings (`a ++ b`)
+//
+// Pre-condition: `Value_is_string(a) && Value_is_string(b)`
+Value Value_concat_strings(Heap *heap, Value a, Value b);
+
+// Pre-condition: `Value_is_string(value)`
+size_t Value_string_length(Value value);
+
+// Produces the characters of a string, flattening it first if it is a rope.
+// The characters of a short string are copied into 'buffer', which needs room
+// for 'VALUE_SHORT_STRING_MAX' of them.
+//
+// Pre-condition: `Value_is_string(value)`
+String Value_string_chars(Value value, char *buffer);
+
+// Pre-condition: `Value_is_string(value)`
+uint32_t Value_string_hash(Value value);
+
+// Pre-condition: `Value_is_string(a) && Value_is_string(b)`
+bool Value_string_eq(Value a, Value b);
+
+#endif
@@ -23,11 +23,10 @@ bool String_eq(String a, String b) {
 
 DEF_VEC(char, StringBuf)
 VEC_WITH_CAP(char, StringBuf)
+VEC_BULK(char, StringBuf)
 
 void StringBuf_push_string(StringBuf *dest_buf, String src_str) {
-    for (size_t idx = 0; idx < src_str.length; idx++) {
-        StringBuf_push(dest_buf, src_str.buffer[idx]);
-    }
+    StringBuf_extend(dest_buf, src_str.buffer, src_str.length);
 }
 
 void StringBuf_print(StringBuf string) {
@@ -26,6 +26,8 @@ DECL_VEC_HEADER(char, StringBuf)
 
 VEC_WITH_CAP_SIG(char, StringBuf)
 
+VEC_BULK_SIG(char, StringBuf)
+
 #define BUF_TO_STR(x)                                                          \
     (String) { .buffer = (x).buffer, .length = (x).length }
 
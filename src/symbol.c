@@ -0,0 +1,64 @@
+#include <string.h>
+
+#include "arena.h"
+#include "common.h"
+#include "hashtable.h"
+#include "memory.h"
+#include "symbol.h"
+#include "vec.h"
+
+DEF_VEC_T(String, Names)
+
+// Maps each name to its symbol through 'table', and each symbol back to its
+// name through 'names', which it is the index into. The names are copied into
+// 'arena' so they outlive the source they were interned from.
+typedef struct Interner {
+    StringTable table;
+    Names names;
+    Arena arena;
+} Interner;
+
+// Zero-initialisation leaves each of the fields empty
+static Interner interner;
+
+Symbol Symbol_intern(String name) {
+    uint32_t *existing = StringTable_find(&interner.table, name);
+    if (existing != NULL)
+        return *existing;
+
+    ASSERT(interner.names.length < SYMBOL_NONE, "Too many symbols");
+    // Allocating an extra byte means the copy is never NULL, even for an
+    // empty name
+    char *buffer = Arena_alloc(&interner.arena, name.length + 1);
+    memcpy(buffer, name.buffer, name.length);
+    buffer[name.length] = '\0';
+    String copy = {.buffer = buffer, .length = name.length};
+
+    MemoryTag saved_tag = set_memory_tag(MEMORY_SYMBOLS);
+    Symbol symbol = (Symbol)Names_push(&interner.names, copy);
+    set_memory_tag(saved_tag);
+    StringTable_set(&interner.table, copy, symbol);
+    return symbol;
+}
+
+String Symbol_name(Symbol symbol) {
+    if (symbol == SYMBOL_NONE)
+        return (String){.buffer = NULL, .length = 0};
+
+    ASSERT(symbol < interner.names.length, "Symbols are always interned");
+    return interner.names.buffer[symbol];
+}
+
+void Symbol_free_all(void) {
+    StringTable_free(&interner.table);
+    MemoryTag saved_tag = set_memory_tag(MEMORY_SYMBOLS);
+    Names_free(&interner.names);
+    set_memory_tag(saved_tag);
+    Arena_free(&interner.arena);
+    // Leave the interner ready to be used again
+    interner = (Interner){
+        .table = StringTable_new(),
+        .names = Names_new(),
+        .arena = Arena_new(),
+    };
+}
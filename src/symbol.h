@@ -0,0 +1,28 @@
+#ifndef CLAM_SYMBOL_H
+#define CLAM_SYMBOL_H
+
+#include <stdint.h>
+
+#include "string.h"
+
+// An interned name, where two symbols are equal exactly when their names are,
+// so comparing names is a single integer comparison
+typedef uint32_t Symbol;
+
+// Stands in for a name where there isn't one (e.g. for anonymous functions),
+// and is never handed out by 'Symbol_intern'
+constexpr Symbol SYMBOL_NONE = UINT32_MAX;
+
+// Get the symbol for 'name', interning a copy of it if it hasn't been seen
+// before. Symbols come from a single global interner, so they stay the same
+// across parses.
+Symbol Symbol_intern(String name);
+
+// Get the name that 'symbol' was interned from (or an empty string for
+// 'SYMBOL_NONE'), which stays valid until 'Symbol_free_all' is called
+String Symbol_name(Symbol symbol);
+
+// Free every interned name, which invalidates every symbol
+void Symbol_free_all(void);
+
+#endif
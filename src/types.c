@@ -0,0 +1,175 @@
+#include "types.h"
+
+DEF_VEC(StaticType, StaticTypes)
+
+// A variable in scope, and the type of its value
+typedef struct TypedName {
+    Symbol name;
+    StaticType type;
+} TypedName;
+
+DEF_VEC_T(TypedName, Scope)
+
+// Stores type inference state
+typedef struct TypeInferrer {
+    AST *ast;
+    StaticTypes types;
+    // The variables currently in scope, innermost last, which mirrors how the
+    // compiler resolves names
+    Scope scope;
+} TypeInferrer;
+
+static StaticType infer(TypeInferrer *self, ASTIndex index);
+
+static StaticType lookup(TypeInferrer *self, Symbol name) {
+    for (size_t i = self->scope.length; i > 0; i--) {
+        TypedName *variable = &self->scope.buffer[i - 1];
+        if (variable->name == name)
+            return variable->type;
+    }
+    return STATIC_TYPE_UNKNOWN;
+}
+
+// 'name' is the name of the `let` binding that the function is the value of,
+// which the function can use to refer to itself
+static StaticType infer_abstraction(TypeInferrer *self, ASTIndex index,
+                                    Symbol name) {
+    struct AST_Abstraction *abstraction = &self->ast->data[index].abstraction;
+    size_t saved_scope = self->scope.length;
+    Scope_push(&self->scope,
+               (TypedName){.name = name, .type = STATIC_TYPE_FUNCTION});
+    // Nothing is known about the arguments a function is called with
+    Scope_push(&self->scope, (TypedName){.name = abstraction->argument,
+                                         .type = STATIC_TYPE_UNKNOWN});
+    infer(self, abstraction->body);
+    self->scope.length = saved_scope;
+    return STATIC_TYPE_FUNCTION;
+}
+
+static StaticType infer_let_in(TypeInferrer *self, ASTIndex index) {
+    size_t saved_scope = self->scope.length;
+    AST_BindingIter bindings = AST_bindings(self->ast, index);
+    AST_LetBind binding;
+    while (AST_next_binding(&bindings, &binding)) {
+        StaticType type;
+        if (AST_tag(self->ast, binding.value) == AST_ABSTRACTION) {
+            type = infer_abstraction(self, binding.value, binding.ident);
+            self->types.buffer[binding.value] = type;
+        } else {
+            type = infer(self, binding.value);
+        }
+        Scope_push(&self->scope,
+                   (TypedName){.name = binding.ident, .type = type});
+    }
+
+    StaticType type = infer(self, self->ast->data[index].let_in.body);
+    self->scope.length = saved_scope;
+    return type;
+}
+
+static StaticType infer_binary_op(TypeInferrer *self, ASTIndex index) {
+    struct AST_BinaryOp *binop = &self->ast->data[index].binary_op;
+    StaticType lhs = infer(self, binop->lhs);
+    StaticType rhs = infer(self, binop->rhs);
+    switch (AST_binop(self->ast, index)) {
+    case BINOP_ADD:
+    case BINOP_SUB:
+    case BINOP_MUL:
+    case BINOP_DIV:
+    case BINOP_MOD:
+        // Any float operand makes the result a float, but an int operand on
+        // its own doesn't say anything about the result
+        if (lhs == STATIC_TYPE_FLOAT || rhs == STATIC_TYPE_FLOAT)
+            return STATIC_TYPE_FLOAT;
+        else if (lhs == STATIC_TYPE_INT && rhs == STATIC_TYPE_INT)
+            return STATIC_TYPE_INT;
+        else
+            return STATIC_TYPE_UNKNOWN;
+    case BINOP_AND:
+    case BINOP_OR:
+    case BINOP_LT:
+    case BINOP_LEQ:
+    case BINOP_GT:
+    case BINOP_GEQ:
+    case BINOP_EQ:
+    case BINOP_NEQ:
+        return STATIC_TYPE_BOOL;
+    case BINOP_APPEND:
+        return STATIC_TYPE_LIST;
+    case BINOP_CONCAT:
+        // Strings and lists can both be concatenated, but only with their own
+        // kind
+        return lhs == STATIC_TYPE_STRING || lhs == STATIC_TYPE_LIST
+                   ? lhs
+                   : STATIC_TYPE_UNKNOWN;
+    case BINOP_FNPIPE:
+        return STATIC_TYPE_UNKNOWN;
+    }
+    UNREACHABLE;
+}
+
+static StaticType infer_node(TypeInferrer *self, ASTIndex index) {
+    ASTData *node = &self->ast->data[index];
+    switch (AST_tag(self->ast, index)) {
+    case AST_LITERAL:
+        return (StaticType)node->literal.tag;
+    case AST_IDENT:
+        return lookup(self, node->ident);
+    case AST_LIST: {
+        AST_Items items = AST_list(self->ast, index);
+        for (size_t i = 0; i < items.length; i++)
+            infer(self, items.buffer[i]);
+        return STATIC_TYPE_LIST;
+    }
+    case AST_LET_IN:
+        return infer_let_in(self, index);
+    case AST_ABSTRACTION:
+        return infer_abstraction(self, index, SYMBOL_NONE);
+    case AST_APPLICATION:
+        infer(self, node->application.function);
+        infer(self, node->application.argument);
+        return STATIC_TYPE_UNKNOWN;
+    case AST_PRINT:
+        infer(self, node->print.expr);
+        return STATIC_TYPE_UNIT;
+    case AST_IF_ELSE: {
+        infer(self, node->if_else.condition);
+        ASTIndex *branches = AST_branches(self->ast, index);
+        StaticType then = infer(self, branches[0]);
+        StaticType else_ = infer(self, branches[1]);
+        return then == else_ ? then : STATIC_TYPE_UNKNOWN;
+    }
+    case AST_UNARY_OP: {
+        StaticType operand = infer(self, node->unary_op.operand);
+        if (node->unary_op.op == UNOP_NOT)
+            return STATIC_TYPE_BOOL;
+        else if (operand == STATIC_TYPE_INT || operand == STATIC_TYPE_FLOAT)
+            return operand;
+        else
+            return STATIC_TYPE_UNKNOWN;
+    }
+    case AST_BINARY_OP:
+        return infer_binary_op(self, index);
+    }
+    UNREACHABLE;
+}
+
+static StaticType infer(TypeInferrer *self, ASTIndex index) {
+    StaticType type = infer_node(self, index);
+    self->types.buffer[index] = type;
+    return type;
+}
+
+StaticTypes infer_types(AST *ast, ASTIndex root) {
+    TypeInferrer inferrer = {
+        .ast = ast,
+        .types = StaticTypes_new(),
+        .scope = Scope_new(),
+    };
+    for (size_t i = 0; i < ast->length; i++)
+        StaticTypes_push(&inferrer.types, STATIC_TYPE_UNKNOWN);
+
+    infer(&inferrer, root);
+    Scope_free(&inferrer.scope);
+    return inferrer.types;
+}
@@ -0,0 +1,32 @@
+#ifndef CLAM_TYPES_H
+#define CLAM_TYPES_H
+
+#include <stdint.h>
+
+#include "ast.h"
+#include "value.h"
+#include "vec.h"
+
+// What is known about the type of an expression without running it, the values
+// match up with ValueType
+typedef enum StaticType : uint8_t {
+    STATIC_TYPE_UNIT = VALUE_TYPE_UNIT,
+    STATIC_TYPE_BOOL = VALUE_TYPE_BOOL,
+    STATIC_TYPE_INT = VALUE_TYPE_INT,
+    STATIC_TYPE_FLOAT = VALUE_TYPE_FLOAT,
+    STATIC_TYPE_STRING = VALUE_TYPE_STRING,
+    STATIC_TYPE_FUNCTION = VALUE_TYPE_FUNCTION,
+    STATIC_TYPE_MAP = VALUE_TYPE_MAP,
+    STATIC_TYPE_LIST = VALUE_TYPE_LIST,
+    // The expression may evaluate to values of different types
+    STATIC_TYPE_UNKNOWN,
+} StaticType;
+
+DECL_VEC_HEADER(StaticType, StaticTypes)
+
+// Work out the type of every node reachable from 'root', indexed by the node's
+// index in 'ast'. A type only describes the values an expression evaluates to
+// if it succeeds, so e.g. `x * 2.0` is a float even if `x` could be a string.
+StaticTypes infer_types(AST *ast, ASTIndex root);
+
+#endif
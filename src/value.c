@@ -0,0 +1,217 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "hashtable.h"
+#include "list.h"
+#include "map.h"
+#include "native.h"
+#include "object.h"
+#include "rope.h"
+#include "value.h"
+
+DEF_VEC(Value, Values)
+
+static ValueType obj_type(Obj *obj) {
+    switch (obj->type) {
+    case OBJ_STRING:
+    case OBJ_ROPE:
+        return VALUE_TYPE_STRING;
+    case OBJ_FUNCTION:
+    case OBJ_CLOSURE:
+    case OBJ_PARTIAL:
+    case OBJ_NATIVE:
+        return VALUE_TYPE_FUNCTION;
+    case OBJ_MAP:
+        return VALUE_TYPE_MAP;
+    case OBJ_LIST:
+        return VALUE_TYPE_LIST;
+    case OBJ_MAP_NODE:
+    case OBJ_LIST_CHUNK:
+    case OBJ_LIST_CONCAT:
+        break;
+    }
+    UNREACHABLE;
+}
+
+ValueType Value_type(Value value) {
+    if (Value_is_int(value))
+        return VALUE_TYPE_INT;
+    else if (Value_is_float(value))
+        return VALUE_TYPE_FLOAT;
+    else if (Value_is_bool(value))
+        return VALUE_TYPE_BOOL;
+    else if (Value_is_obj(value))
+        return obj_type(Value_as_obj(value));
+    else if (Value_is_short_string(value))
+        return VALUE_TYPE_STRING;
+    else
+        return VALUE_TYPE_UNIT;
+}
+
+static bool obj_eq(Obj *a, Obj *b) {
+    if (a == b)
+        return true;
+    else if (a->type != b->type)
+        return false;
+
+    switch (a->type) {
+    case OBJ_MAP:
+        return ObjMap_eq((ObjMap *)a, (ObjMap *)b);
+    case OBJ_LIST:
+        return ObjList_eq((ObjList *)a, (ObjList *)b);
+    // Functions can't be compared structurally, so only identity counts
+    case OBJ_FUNCTION:
+    case OBJ_CLOSURE:
+    case OBJ_PARTIAL:
+    case OBJ_NATIVE:
+        return false;
+    // Strings are compared by 'Value_eq', since they aren't all objects
+    case OBJ_STRING:
+    case OBJ_ROPE:
+    case OBJ_MAP_NODE:
+    case OBJ_LIST_CHUNK:
+    case OBJ_LIST_CONCAT:
+        break;
+    }
+    UNREACHABLE;
+}
+
+bool Value_eq(Value a, Value b) {
+    if (Value_is_number(a) && Value_is_number(b)) {
+        if (Value_is_int(a) && Value_is_int(b))
+            return Value_as_int(a) == Value_as_int(b);
+        else
+            return Value_as_number(a) == Value_as_number(b);
+    } else if (Value_is_string(a) && Value_is_string(b)) {
+        return Value_string_eq(a, b);
+    } else if (Value_is_obj(a) && Value_is_obj(b)) {
+        return obj_eq(Value_as_obj(a), Value_as_obj(b));
+    } else if (Value_is_bool(a) && Value_is_bool(b)) {
+        return Value_as_bool(a) == Value_as_bool(b);
+    } else {
+        return Value_is_unit(a) && Value_is_unit(b);
+    }
+}
+
+uint32_t Value_hash(Value value) {
+    switch (Value_type(value)) {
+    case VALUE_TYPE_UNIT:
+    case VALUE_TYPE_BOOL:
+        return hash_word((uint64_t)Value_type(value) << 32 |
+                         (Value_is_bool(value) && Value_as_bool(value)));
+    case VALUE_TYPE_INT:
+    case VALUE_TYPE_FLOAT: {
+        // Ints are hashed as floats, since they're equal to the same floats,
+        // and so are both zeroes
+        double real = Value_as_number(value);
+        if (real == 0)
+            real = 0;
+        uint64_t bits;
+        memcpy(&bits, &real, sizeof(bits));
+        return hash_word(bits);
+    }
+    case VALUE_TYPE_STRING:
+        return Value_string_hash(value);
+    case VALUE_TYPE_FUNCTION:
+        return hash_word((uintptr_t)Value_as_obj(value));
+    case VALUE_TYPE_MAP:
+        return ObjMap_hash(Value_as_map(value));
+    case VALUE_TYPE_LIST:
+        return ObjList_hash(Value_as_list(value));
+    }
+    UNREACHABLE;
+}
+
+static void write_float(double real, FILE *file) {
+    char num[32];
+    int length = snprintf(num, sizeof(num), "%.15g", real);
+    fputs(num, file);
+    // Make sure that floats with integral values don't look like ints
+    if (strspn(num, "-0123456789") == (size_t)length)
+        fputs(".0", file);
+}
+
+static void write_function(Obj *obj, FILE *file) {
+    ObjFunction *function;
+    switch (obj->type) {
+    case OBJ_FUNCTION:
+        function = (ObjFunction *)obj;
+        break;
+    case OBJ_CLOSURE:
+        function = ((ObjClosure *)obj)->function;
+        break;
+    case OBJ_PARTIAL:
+        write_function(((ObjPartial *)obj)->callee, file);
+        return;
+    case OBJ_NATIVE:
+        fputs("<native ", file);
+        String_write(((ObjNative *)obj)->native->name, file);
+        fputc('>', file);
+        return;
+    default:
+        UNREACHABLE;
+    }
+
+    if (function->name.length == 0) {
+        fputs("<function>", file);
+    } else {
+        fputs("<function ", file);
+        String_write(function->name, file);
+        fputc('>', file);
+    }
+}
+
+void Value_write(Value value, FILE *file) {
+    switch (Value_type(value)) {
+    case VALUE_TYPE_UNIT:
+        fputs("unit", file);
+        break;
+    case VALUE_TYPE_BOOL:
+        fputs(Value_as_bool(value) ? "true" : "false", file);
+        break;
+    case VALUE_TYPE_INT:
+        fprintf(file, "%d", Value_as_int(value));
+        break;
+    case VALUE_TYPE_FLOAT:
+        write_float(Value_as_float(value), file);
+        break;
+    case VALUE_TYPE_STRING: {
+        char buffer[VALUE_SHORT_STRING_MAX];
+        String_write(Value_string_chars(value, buffer), file);
+        break;
+    }
+    case VALUE_TYPE_FUNCTION:
+        write_function(Value_as_obj(value), file);
+        break;
+    case VALUE_TYPE_MAP:
+        ObjMap_write(Value_as_map(value), file);
+        break;
+    case VALUE_TYPE_LIST:
+        ObjList_write(Value_as_list(value), file);
+        break;
+    }
+}
+
+String ValueType_to_string(ValueType type) {
+    switch (type) {
+    case VALUE_TYPE_UNIT:
+        return STR("unit");
+    case VALUE_TYPE_BOOL:
+        return STR("bool");
+    case VALUE_TYPE_INT:
+        return STR("int");
+    case VALUE_TYPE_FLOAT:
+        return STR("float");
+    case VALUE_TYPE_STRING:
+        return STR("string");
+    case VALUE_TYPE_FUNCTION:
+        return STR("function");
+    case VALUE_TYPE_MAP:
+        return STR("map");
+    case VALUE_TYPE_LIST:
+        return STR("list");
+    }
+    UNREACHABLE;
+}
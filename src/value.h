@@ -0,0 +1,311 @@
+#ifndef CLAM_VALUE_H
+#define CLAM_VALUE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "string.h"
+#include "vec.h"
+
+// The values should match up with AST_LiteralTag, apart from the types which
+// have no literals
+typedef enum ValueType : uint8_t {
+    VALUE_TYPE_UNIT = 0,
+    VALUE_TYPE_BOOL = 1,
+    VALUE_TYPE_INT = 2,
+    VALUE_TYPE_FLOAT = 3,
+    VALUE_TYPE_STRING = 4,
+    VALUE_TYPE_FUNCTION = 5,
+    VALUE_TYPE_MAP = 6,
+    VALUE_TYPE_LIST = 7,
+} ValueType;
+
+typedef enum ObjType : uint8_t {
+    OBJ_STRING,
+    OBJ_ROPE,
+    OBJ_FUNCTION,
+    OBJ_CLOSURE,
+    OBJ_PARTIAL,
+    OBJ_NATIVE,
+    OBJ_MAP,
+    // Only ever referenced by maps and other nodes, never a value on its own
+    OBJ_MAP_NODE,
+    OBJ_LIST,
+    // Only ever referenced by lists and concatenation nodes
+    OBJ_LIST_CHUNK,
+    OBJ_LIST_CONCAT,
+} ObjType;
+
+// The header shared by every heap-allocated value, the concrete object types
+// live in "object.h"
+typedef struct Obj {
+    ObjType type;
+    // Set while the garbage collector is tracing, for objects that are live
+    bool marked;
+    struct Obj *next;
+} Obj;
+
+// By default a value is NaN-boxed into a single 64-bit word, with the
+// tagged-union representation kept around (behind the 'value_repr' meson
+// option) so that the two can be benchmarked against each other
+#ifndef CLAM_TAGGED_VALUES
+
+#define VALUE_REPR "nan-boxed"
+
+// Every double that isn't a quiet NaN with these bits set is stored as is,
+// everything else is packed into the 51 bits of NaN payload that remain:
+//
+// * Heap pointers set the sign bit and use the low 48 bits for the address
+// * Other values put a tag in bits 32 to 34 and their payload in the low 32 bits
+// * Except for short strings, which also use bits 35 to 37 for their length and
+//   bits 40 to 47 for their fifth character
+typedef uint64_t Value;
+
+constexpr uint64_t VALUE_SIGN_BIT = 0x8000000000000000;
+constexpr uint64_t VALUE_QNAN = 0x7ffc000000000000;
+constexpr uint64_t VALUE_TAG_MASK = 0x0000000700000000;
+constexpr uint64_t VALUE_TAG_UNIT = 0x0000000100000000;
+constexpr uint64_t VALUE_TAG_BOOL = 0x0000000200000000;
+constexpr uint64_t VALUE_TAG_INT = 0x0000000300000000;
+constexpr uint64_t VALUE_TAG_SHORT_STRING = 0x0000000400000000;
+// The longest string that fits in a value without a heap allocation
+constexpr size_t VALUE_SHORT_STRING_MAX = 5;
+// The NaN produced by arithmetic is canonicalised to this so that it can't
+// alias a boxed value
+constexpr uint64_t VALUE_CANONICAL_NAN = 0x7ff8000000000000;
+
+static inline Value Value_unit(void) { return VALUE_QNAN | VALUE_TAG_UNIT; }
+
+static inline Value Value_bool(bool boolean) {
+    return VALUE_QNAN | VALUE_TAG_BOOL | (uint64_t)boolean;
+}
+
+static inline Value Value_int(int32_t integer) {
+    return VALUE_QNAN | VALUE_TAG_INT | (uint32_t)integer;
+}
+
+static inline Value Value_float(double real) {
+    Value value;
+    memcpy(&value, &real, sizeof(double));
+    return real != real ? VALUE_CANONICAL_NAN : value;
+}
+
+static inline Value Value_obj(Obj *obj) {
+    return VALUE_SIGN_BIT | VALUE_QNAN | (uint64_t)(uintptr_t)obj;
+}
+
+// The bit that the character at 'index' of a short string starts at
+static inline unsigned short_string_shift(size_t index) {
+    return index < 4 ? (unsigned)(8 * index) : 40;
+}
+
+// Pre-condition: `length <= VALUE_SHORT_STRING_MAX`
+static inline Value Value_short_string(const char *chars, size_t length) {
+    Value value = VALUE_QNAN | VALUE_TAG_SHORT_STRING | (uint64_t)length << 35;
+    for (size_t i = 0; i < length; i++)
+        value |= (uint64_t)(uint8_t)chars[i] << short_string_shift(i);
+    return value;
+}
+
+static inline bool Value_is_unit(Value value) { return value == Value_unit(); }
+
+static inline bool Value_is_bool(Value value) {
+    return (value | 1) == Value_bool(true);
+}
+
+static inline bool Value_is_int(Value value) {
+    return (value & (VALUE_SIGN_BIT | VALUE_QNAN | VALUE_TAG_MASK)) ==
+           (VALUE_QNAN | VALUE_TAG_INT);
+}
+
+static inline bool Value_is_float(Value value) {
+    return (value & VALUE_QNAN) != VALUE_QNAN;
+}
+
+static inline bool Value_is_short_string(Value value) {
+    return (value & (VALUE_SIGN_BIT | VALUE_QNAN | VALUE_TAG_MASK)) ==
+           (VALUE_QNAN | VALUE_TAG_SHORT_STRING);
+}
+
+static inline bool Value_is_obj(Value value) {
+    return (value & (VALUE_SIGN_BIT | VALUE_QNAN)) ==
+           (VALUE_SIGN_BIT | VALUE_QNAN);
+}
+
+static inline bool Value_as_bool(Value value) { return value & 1; }
+
+static inline int32_t Value_as_int(Value value) {
+    return (int32_t)(uint32_t)value;
+}
+
+static inline double Value_as_float(Value value) {
+    double real;
+    memcpy(&real, &value, sizeof(double));
+    return real;
+}
+
+static inline Obj *Value_as_obj(Value value) {
+    return (Obj *)(uintptr_t)(value & ~(VALUE_SIGN_BIT | VALUE_QNAN));
+}
+
+// Copies the characters of a short string into 'buffer', which needs room
+// for 'VALUE_SHORT_STRING_MAX' of them, producing its length
+//
+// Pre-condition: `Value_is_short_string(value)`
+static inline size_t Value_short_string_read(Value value, char *buffer) {
+    size_t length = (value >> 35) & 0x7;
+    for (size_t i = 0; i < length; i++)
+        buffer[i] = (char)(uint8_t)(value >> short_string_shift(i));
+    return length;
+}
+
+#else
+
+#define VALUE_REPR "tagged-union"
+
+typedef struct Value {
+    enum ValueTag : uint8_t {
+        VALUE_TAG_UNIT,
+        VALUE_TAG_BOOL,
+        VALUE_TAG_INT,
+        VALUE_TAG_FLOAT,
+        VALUE_TAG_OBJ,
+        VALUE_TAG_SHORT_STRING,
+    } tag;
+    union ValueUnion {
+        bool boolean;
+        int32_t integer;
+        double real;
+        Obj *obj;
+        struct ValueShortString {
+            char chars[7];
+            uint8_t length;
+        } short_string;
+    } value;
+} Value;
+
+// The longest string that fits in a value without a heap allocation
+constexpr size_t VALUE_SHORT_STRING_MAX = 7;
+
+static inline Value Value_unit(void) { return (Value){.tag = VALUE_TAG_UNIT}; }
+
+static inline Value Value_bool(bool boolean) {
+    return (Value){.tag = VALUE_TAG_BOOL, .value = {.boolean = boolean}};
+}
+
+static inline Value Value_int(int32_t integer) {
+    return (Value){.tag = VALUE_TAG_INT, .value = {.integer = integer}};
+}
+
+static inline Value Value_float(double real) {
+    return (Value){.tag = VALUE_TAG_FLOAT, .value = {.real = real}};
+}
+
+static inline Value Value_obj(Obj *obj) {
+    return (Value){.tag = VALUE_TAG_OBJ, .value = {.obj = obj}};
+}
+
+// Pre-condition: `length <= VALUE_SHORT_STRING_MAX`
+static inline Value Value_short_string(const char *chars, size_t length) {
+    Value value = {.tag = VALUE_TAG_SHORT_STRING,
+                   .value = {.short_string = {.length = (uint8_t)length}}};
+    memcpy(value.value.short_string.chars, chars, length);
+    return value;
+}
+
+static inline bool Value_is_unit(Value value) {
+    return value.tag == VALUE_TAG_UNIT;
+}
+
+static inline bool Value_is_bool(Value value) {
+    return value.tag == VALUE_TAG_BOOL;
+}
+
+static inline bool Value_is_int(Value value) {
+    return value.tag == VALUE_TAG_INT;
+}
+
+static inline bool Value_is_float(Value value) {
+    return value.tag == VALUE_TAG_FLOAT;
+}
+
+static inline bool Value_is_obj(Value value) {
+    return value.tag == VALUE_TAG_OBJ;
+}
+
+static inline bool Value_is_short_string(Value value) {
+    return value.tag == VALUE_TAG_SHORT_STRING;
+}
+
+static inline bool Value_as_bool(Value value) { return value.value.boolean; }
+
+static inline int32_t Value_as_int(Value value) { return value.value.integer; }
+
+static inline double Value_as_float(Value value) { return value.value.real; }
+
+static inline Obj *Value_as_obj(Value value) { return value.value.obj; }
+
+// Copies the characters of a short string into 'buffer', which needs room
+// for 'VALUE_SHORT_STRING_MAX' of them, producing its length
+//
+// Pre-condition: `Value_is_short_string(value)`
+static inline size_t Value_short_string_read(Value value, char *buffer) {
+    memcpy(buffer, value.value.short_string.chars,
+           value.value.short_string.length);
+    return value.value.short_string.length;
+}
+
+#endif
+
+static inline bool Value_is_obj_type(Value value, ObjType type) {
+    return Value_is_obj(value) && Value_as_obj(value)->type == type;
+}
+
+// Strings are short strings if they fit, and otherwise either flat strings or
+// ropes (see "rope.h")
+static inline bool Value_is_string(Value value) {
+    return Value_is_short_string(value) ||
+           Value_is_obj_type(value, OBJ_STRING) ||
+           Value_is_obj_type(value, OBJ_ROPE);
+}
+
+static inline bool Value_is_closure(Value value) {
+    return Value_is_obj_type(value, OBJ_CLOSURE);
+}
+
+static inline bool Value_is_map(Value value) {
+    return Value_is_obj_type(value, OBJ_MAP);
+}
+
+static inline bool Value_is_list(Value value) {
+    return Value_is_obj_type(value, OBJ_LIST);
+}
+
+static inline bool Value_is_number(Value value) {
+    return Value_is_int(value) || Value_is_float(value);
+}
+
+// Pre-condition: `Value_is_number(value)`
+static inline double Value_as_number(Value value) {
+    return Value_is_int(value) ? (double)Value_as_int(value)
+                               : Value_as_float(value);
+}
+
+ValueType Value_type(Value value);
+
+// Structural equality, where ints and floats are compared numerically and
+// values of any other differing types are never equal
+bool Value_eq(Value a, Value b);
+
+// A hash which agrees with 'Value_eq', so e.g. `1` and `1.0` hash the same
+uint32_t Value_hash(Value value);
+
+void Value_write(Value value, FILE *file);
+
+// Get the name of a type, for use in diagnostics
+String ValueType_to_string(ValueType type);
+
+DECL_VEC_HEADER(Value, Values)
+
+#endif
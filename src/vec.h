@@ -2,6 +2,7 @@
 #define CLAM_VEC_H
 
 #include <stddef.h>
+#include <string.h>
 
 #include "memory.h"
 
@@ -25,9 +26,11 @@
 #define VEC_WITH_CAP_SIG(T, Name) Name Name##_with_capacity(size_t capacity);
 #define VEC_WITH_CAP(T, Name)                                                  \
     Name Name##_with_capacity(size_t capacity) {                               \
-        return (Name){.buffer = (T *)reallocate(NULL, sizeof(T) * capacity),   \
-                      .length = 0,                                             \
-                      .capacity = capacity};                                   \
+        return (Name){                                                         \
+            .buffer = (T *)reallocate(NULL, 0, sizeof(T) * capacity),          \
+            .length = 0,                                                       \
+            .capacity = capacity,                                              \
+        };                                                                     \
     }
 
 #define VEC_PUSH_SIG(T, Name) size_t Name##_push(Name *vec, T value);
@@ -36,8 +39,9 @@
         if (vec->capacity < vec->length + 1) {                                 \
             size_t old_capacity = vec->capacity;                               \
             vec->capacity = grow_allocation(old_capacity);                     \
-            vec->buffer =                                                      \
-                (T *)reallocate(vec->buffer, sizeof(T) * vec->capacity);       \
+            vec->buffer = (T *)reallocate(vec->buffer,                         \
+                                          sizeof(T) * old_capacity,            \
+                                          sizeof(T) * vec->capacity);          \
         }                                                                      \
                                                                                \
         vec->buffer[vec->length] = value;                                      \
@@ -47,12 +51,58 @@
 #define VEC_FREE_SIG(T, Name) void Name##_free(Name *vec);
 #define VEC_FREE(T, Name)                                                      \
     void Name##_free(Name *vec) {                                              \
-        free(vec->buffer);                                                     \
+        reallocate(vec->buffer, sizeof(T) * vec->capacity, 0);                 \
         vec->buffer = NULL;                                                    \
         vec->capacity = 0;                                                     \
         vec->length = 0;                                                       \
     }
 
+// Bulk operations, which aren't part of every vector since most only ever push
+#define VEC_BULK_SIG(T, Name)                                                  \
+    void Name##_reserve(Name *vec, size_t additional);                         \
+    void Name##_extend(Name *vec, const T *items, size_t count);               \
+    void Name##_truncate(Name *vec, size_t length);                            \
+    void Name##_shrink_to_fit(Name *vec);
+#define VEC_BULK(T, Name)                                                      \
+    /* Make room for at least 'additional' more elements, growing the way      \
+     * pushing does so that reserving in a loop stays amortised */             \
+    void Name##_reserve(Name *vec, size_t additional) {                        \
+        size_t needed = vec->length + additional;                              \
+        if (vec->capacity >= needed)                                           \
+            return;                                                            \
+        size_t old_capacity = vec->capacity;                                   \
+        size_t capacity = grow_allocation(old_capacity);                       \
+        vec->capacity = capacity < needed ? needed : capacity;                 \
+        vec->buffer =                                                          \
+            (T *)reallocate(vec->buffer, sizeof(T) * old_capacity,             \
+                            sizeof(T) * vec->capacity);                        \
+    }                                                                          \
+                                                                               \
+    /* Push a copy of the 'count' elements at 'items' */                       \
+    void Name##_extend(Name *vec, const T *items, size_t count) {              \
+        if (count == 0)                                                        \
+            return;                                                            \
+        Name##_reserve(vec, count);                                            \
+        memcpy(vec->buffer + vec->length, items, sizeof(T) * count);           \
+        vec->length += count;                                                  \
+    }                                                                          \
+                                                                               \
+    /* Drop the elements past 'length', keeping the capacity */                \
+    void Name##_truncate(Name *vec, size_t length) {                           \
+        if (length < vec->length)                                              \
+            vec->length = length;                                              \
+    }                                                                          \
+                                                                               \
+    /* Give back the capacity that isn't being used */                         \
+    void Name##_shrink_to_fit(Name *vec) {                                     \
+        if (vec->capacity == vec->length)                                      \
+            return;                                                            \
+        vec->buffer =                                                          \
+            (T *)reallocate(vec->buffer, sizeof(T) * vec->capacity,            \
+                            sizeof(T) * vec->length);                          \
+        vec->capacity = vec->length;                                           \
+    }
+
 #define DECL_VEC_HEADER(T, Name)                                               \
     CREATE_VEC(T, Name)                                                        \
     VEC_NEW_SIG(T, Name) VEC_PUSH_SIG(T, Name) VEC_FREE_SIG(T, Name)
@@ -63,4 +113,97 @@
 
 #define DEF_VEC(T, Name) VEC_NEW(T, Name) VEC_PUSH(T, Name) VEC_FREE(T, Name)
 
+// A vector which keeps up to 'N' elements inline, and only allocates once it
+// outgrows them.
+//
+// Whether the elements are inline depends on 'capacity' rather than 'length',
+// so that truncating a vector which has spilled onto the heap doesn't lose
+// track of its allocation. Elements should always be reached through
+// 'Name##_items', since a vector can be copied (and so moved) at any time.
+#define CREATE_SMALLVEC(T, Name, N)                                            \
+    typedef struct Name {                                                      \
+        size_t capacity;                                                       \
+        size_t length;                                                         \
+        union {                                                                \
+            T small[N];                                                        \
+            T *heap;                                                           \
+        };                                                                     \
+    } Name;                                                                    \
+                                                                               \
+    static inline T *Name##_items(Name *vec) {                                 \
+        return vec->capacity > (N) ? vec->heap : vec->small;                   \
+    }
+
+#define SMALLVEC_SIG(T, Name)                                                  \
+    Name Name##_new(void);                                                     \
+    size_t Name##_push(Name *vec, T value);                                    \
+    void Name##_free(Name *vec);                                               \
+    VEC_BULK_SIG(T, Name)
+
+#define DEF_SMALLVEC(T, Name, N)                                               \
+    Name Name##_new(void) { return (Name){.capacity = (N), .length = 0}; }     \
+                                                                               \
+    void Name##_reserve(Name *vec, size_t additional) {                        \
+        size_t needed = vec->length + additional;                              \
+        if (vec->capacity >= needed)                                           \
+            return;                                                            \
+        size_t old_capacity = vec->capacity;                                   \
+        size_t capacity = grow_allocation(old_capacity);                       \
+        capacity = capacity < needed ? needed : capacity;                      \
+        if (old_capacity > (N)) {                                              \
+            vec->heap = (T *)reallocate(vec->heap, sizeof(T) * old_capacity,   \
+                                        sizeof(T) * capacity);                 \
+        } else {                                                               \
+            T *heap = (T *)reallocate(NULL, 0, sizeof(T) * capacity);          \
+            memcpy(heap, vec->small, sizeof(T) * vec->length);                 \
+            vec->heap = heap;                                                  \
+        }                                                                      \
+        vec->capacity = capacity;                                              \
+    }                                                                          \
+                                                                               \
+    size_t Name##_push(Name *vec, T value) {                                   \
+        Name##_reserve(vec, 1);                                                \
+        Name##_items(vec)[vec->length] = value;                                \
+        return vec->length++;                                                  \
+    }                                                                          \
+                                                                               \
+    void Name##_extend(Name *vec, const T *items, size_t count) {              \
+        if (count == 0)                                                        \
+            return;                                                            \
+        Name##_reserve(vec, count);                                            \
+        memcpy(Name##_items(vec) + vec->length, items, sizeof(T) * count);     \
+        vec->length += count;                                                  \
+    }                                                                          \
+                                                                               \
+    void Name##_truncate(Name *vec, size_t length) {                           \
+        if (length < vec->length)                                              \
+            vec->length = length;                                              \
+    }                                                                          \
+                                                                               \
+    /* Moves the elements back inline if they fit */                           \
+    void Name##_shrink_to_fit(Name *vec) {                                     \
+        if (vec->capacity <= (N) || vec->capacity == vec->length)              \
+            return;                                                            \
+        if (vec->length > (N)) {                                               \
+            vec->heap = (T *)reallocate(vec->heap, sizeof(T) * vec->capacity,  \
+                                        sizeof(T) * vec->length);              \
+            vec->capacity = vec->length;                                       \
+            return;                                                            \
+        }                                                                      \
+        T *heap = vec->heap;                                                   \
+        memcpy(vec->small, heap, sizeof(T) * vec->length);                     \
+        reallocate(heap, sizeof(T) * vec->capacity, 0);                        \
+        vec->capacity = (N);                                                   \
+    }                                                                          \
+                                                                               \
+    void Name##_free(Name *vec) {                                              \
+        if (vec->capacity > (N))                                               \
+            reallocate(vec->heap, sizeof(T) * vec->capacity, 0);               \
+        *vec = Name##_new();                                                   \
+    }
+
+#define DECL_SMALLVEC_HEADER(T, Name, N)                                       \
+    CREATE_SMALLVEC(T, Name, N)                                                \
+    SMALLVEC_SIG(T, Name)
+
 #endif
@@ -1,4 +1,685 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "common.h"
+#include "list.h"
+#include "memory.h"
+#include "native.h"
+#include "rope.h"
 #include "vm.h"
-#include "vec.h"
+#include "vm_ops.h"
+
+VM VM_new(Heap *heap) {
+    return (VM){
+        .stack = (Value *)reallocate(NULL, 0, sizeof(Value) * VM_STACK_MAX),
+        .frames = (CallFrame *)reallocate(NULL, 0,
+                                          sizeof(CallFrame) * VM_FRAMES_MAX),
+        .heap = heap,
+    };
+}
+
+void VM_free(VM *self) {
+    self->stack = reallocate(self->stack, sizeof(Value) * VM_STACK_MAX, 0);
+    self->frames =
+        reallocate(self->frames, sizeof(CallFrame) * VM_FRAMES_MAX, 0);
+}
+
+// Free every object that the program can no longer reach, where the roots are
+// the stack below 'sp', the closures of the frames up to 'frame' and the
+// constants of the top-level 'chunk'. Upvalues are copied into the closures
+// that capture them, so they are traced through those.
+static void collect_garbage(VM *self, Chunk *chunk, CallFrame *frame,
+                            Value *sp) {
+    Heap *heap = self->heap;
+    for (Value *slot = self->stack; slot < sp; slot++)
+        Heap_mark_value(heap, *slot);
+    for (CallFrame *f = self->frames; f <= frame; f++)
+        if (f->closure != NULL)
+            Heap_mark_object(heap, &f->closure->obj);
+    for (size_t i = 0; i < chunk->constants.length; i++)
+        Heap_mark_value(heap, chunk->constants.buffer[i]);
+    Heap_collect(heap);
+}
+
+// Closures and natives are the only things that can be called directly, since
+// partial applications are spread out first
+static inline bool Value_is_callable(Value value) {
+    return Value_is_closure(value) || Value_is_obj_type(value, OBJ_NATIVE);
+}
+
+// Pre-condition: `Value_is_callable(callee)`
+static inline uint16_t callable_arity(Value callee) {
+    if (Value_is_closure(callee))
+        return Value_as_closure(callee)->function->arity;
+    return Value_as_native(callee)->native->arity;
+}
+
+void RuntimeError_print(RuntimeError error, FILE *stream) {
+    fputs("\x1b[31;1mError\x1b[0m: ", stream);
+    switch (error.tag) {
+    case RUNTIME_ERROR_TYPE:
+        fputs("type error, expected ", stream);
+        String_write(error.error.type.expected, stream);
+        fputs(", got ", stream);
+        String_write(ValueType_to_string(error.error.type.got), stream);
+        break;
+    case RUNTIME_ERROR_DIVISION_BY_ZERO:
+        fputs("division by zero", stream);
+        break;
+    case RUNTIME_ERROR_STACK_OVERFLOW:
+        fputs("stack overflow", stream);
+        break;
+    }
+    fputc('\n', stream);
+}
+
+// Labels as values are a GNU extension, which is exactly what we're after here
+#ifdef VM_THREADED_DISPATCH
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wpedantic"
+#endif
+
+RunResult VM_run(VM *self, Chunk *chunk) {
+    RuntimeError error;
+    if (chunk->max_stack > VM_STACK_MAX) {
+        error = (RuntimeError){.tag = RUNTIME_ERROR_STACK_OVERFLOW};
+        goto FAILURE;
+    }
+
+    Value *const stack = self->stack;
+    CallFrame *frame = self->frames;
+    *frame = (CallFrame){
+        .closure = NULL,
+        .chunk = chunk,
+        .ip = chunk->code.buffer,
+        .slots = stack,
+    };
+
+    // Keep the current frame's state in locals so the compiler can put them in
+    // registers, rather than going through 'frame' every time
+    const uint16_t *ip;
+    const Value *constants;
+    Value *slots;
+    Value *sp = stack;
+
+#define LOAD_FRAME()                                                           \
+    do {                                                                       \
+        ip = frame->ip;                                                        \
+        constants = frame->chunk->constants.buffer;                            \
+        slots = frame->slots;                                                  \
+    } while (0)
+
+    LOAD_FRAME();
+
+#define READ() (*ip++)
+#define PUSH(value) (*sp++ = (value))
+#define POP() (*--sp)
+#define PEEK(distance) (sp[-1 - (distance)])
+
+// Pops the right operand and replaces the left one with the result, which
+// saves adjusting the stack pointer twice
+#define STACK_OP(operation, ...)                                               \
+    do {                                                                       \
+        Value rhs = POP();                                                     \
+        operation(PEEK(0), PEEK(0), rhs, __VA_ARGS__);                        \
+    } while (0)
+
+// Applies 'operation' to the top of the stack and a constant operand in place
+#define CONST_OP(operation, ...)                                               \
+    do {                                                                       \
+        Value rhs = constants[READ()];                                         \
+        operation(PEEK(0), PEEK(0), rhs, __VA_ARGS__);                        \
+    } while (0)
+
+// Pushes the result of applying 'operation' to two locals
+#define LOCALS_OP(operation, ...)                                              \
+    do {                                                                       \
+        Value lhs = slots[READ()];                                             \
+        Value rhs = slots[READ()];                                             \
+        Value *dst = sp++;                                                     \
+        operation(*dst, lhs, rhs, __VA_ARGS__);                                \
+    } while (0)
+
+// Pops both operands of a comparison and jumps if the result is false
+#define JUMP_IF_NOT_OP(operation, ...)                                         \
+    do {                                                                       \
+        uint16_t offset = READ();                                              \
+        Value rhs = POP();                                                     \
+        Value lhs = POP();                                                     \
+        Value condition;                                                       \
+        operation(condition, lhs, rhs, __VA_ARGS__);                           \
+        if (!Value_as_bool(condition))                                         \
+            ip += offset;                                                      \
+    } while (0)
+
+// Like STACK_OP, for operands that are statically known to be ints, so their
+// types don't need checking
+#define INT_OP(make_result, operation)                                         \
+    do {                                                                       \
+        Value rhs = POP();                                                     \
+        PEEK(0) =                                                              \
+            make_result(operation(Value_as_int(PEEK(0)), Value_as_int(rhs)));  \
+    } while (0)
+
+// Like INT_OP, for floats
+#define FLOAT_OP(make_result, operation)                                       \
+    do {                                                                       \
+        Value rhs = POP();                                                     \
+        PEEK(0) = make_result(                                                 \
+            operation(Value_as_float(PEEK(0)), Value_as_float(rhs)));          \
+    } while (0)
+
+// Gets the closure or native in 'callee_slots' ready to be called with the
+// 'count' values above it, first spreading out the arguments that were already
+// applied if it is actually a partial application, and produces its arity
+#define PREPARE_CALL(callee_slots, count, arity)                               \
+    do {                                                                       \
+        if (Value_is_obj_type(*(callee_slots), OBJ_PARTIAL)) {                 \
+            ObjPartial *partial = Value_as_partial(*(callee_slots));           \
+            if (partial->count > (size_t)(stack + VM_STACK_MAX - sp)) {        \
+                error = (RuntimeError){.tag = RUNTIME_ERROR_STACK_OVERFLOW};   \
+                goto FAILURE;                                                  \
+            }                                                                  \
+            memmove((callee_slots) + 1 + partial->count, (callee_slots) + 1,   \
+                    sizeof(Value) * (count));                                  \
+            memcpy((callee_slots) + 1, partial->arguments,                     \
+                   sizeof(Value) * partial->count);                            \
+            *(callee_slots) = Value_obj(partial->callee);                      \
+            sp += partial->count;                                              \
+            (count) += partial->count;                                         \
+        }                                                                      \
+        EXPECT(Value_is_callable, "function", *(callee_slots));                \
+        (arity) = callable_arity(*(callee_slots));                             \
+        ASSERT((count) <= (arity),                                             \
+               "Calls never pass more arguments than the function takes");     \
+    } while (0)
+
+// Must come before every allocation, where everything that is live has to be on
+// the stack (below 'sp') or referenced by a frame
+#define MAYBE_COLLECT()                                                        \
+    do {                                                                       \
+        if (Heap_should_collect(self->heap))                                   \
+            collect_garbage(self, chunk, frame, sp);                           \
+    } while (0)
+
+// Replaces a closure or native being called with too few arguments, and the
+// arguments, with a partial application
+#define PARTIAL_APPLY(callee_slots, count)                                     \
+    do {                                                                       \
+        MAYBE_COLLECT();                                                       \
+        ObjPartial *partial =                                                  \
+            ObjPartial_new(self->heap, Value_as_obj(*(callee_slots)),          \
+                           (uint16_t)(count), sp - (count));                   \
+        sp = (callee_slots);                                                   \
+        PUSH(Value_obj(&partial->obj));                                        \
+    } while (0)
+
+// Replaces a native being called with all of its arguments, and the arguments,
+// with its result. The arguments stay on the stack during the call, so they
+// can't be collected while the native is using them.
+#define CALL_NATIVE(callee_slots)                                              \
+    do {                                                                       \
+        MAYBE_COLLECT();                                                       \
+        const Native *native = Value_as_native(*(callee_slots))->native;       \
+        RunResult result = native->function(self->heap, (callee_slots) + 1);   \
+        if (result.tag == RESULT_ERR) {                                        \
+            error = result.value.err;                                          \
+            goto FAILURE;                                                      \
+        }                                                                      \
+        sp = (callee_slots);                                                   \
+        PUSH(result.value.ok);                                                 \
+    } while (0)
+
+#ifdef VM_THREADED_DISPATCH
+    // Each handler jumps straight to the next one, which gives the branch
+    // predictor a separate indirect branch per opcode to learn from
+    static void *const dispatch_table[] = {
+        [VM_OP_LOAD_CONST] = &&VM_OP_LOAD_CONST_LABEL,
+        [VM_OP_POP] = &&VM_OP_POP_LABEL,
+        [VM_OP_PRINT] = &&VM_OP_PRINT_LABEL,
+        [VM_OP_LOAD_LOCAL] = &&VM_OP_LOAD_LOCAL_LABEL,
+        [VM_OP_SLIDE] = &&VM_OP_SLIDE_LABEL,
+        [VM_OP_JUMP] = &&VM_OP_JUMP_LABEL,
+        [VM_OP_JUMP_IF_FALSE] = &&VM_OP_JUMP_IF_FALSE_LABEL,
+        [VM_OP_RETURN] = &&VM_OP_RETURN_LABEL,
+        [VM_OP_LOAD_UPVALUE] = &&VM_OP_LOAD_UPVALUE_LABEL,
+        [VM_OP_CLOSURE] = &&VM_OP_CLOSURE_LABEL,
+        [VM_OP_CALL] = &&VM_OP_CALL_LABEL,
+        [VM_OP_TAIL_CALL] = &&VM_OP_TAIL_CALL_LABEL,
+        [VM_OP_LOOP] = &&VM_OP_LOOP_LABEL,
+        [VM_OP_LIST] = &&VM_OP_LIST_LABEL,
+        [VM_OP_APPEND] = &&VM_OP_APPEND_LABEL,
+        [VM_OP_CONCAT] = &&VM_OP_CONCAT_LABEL,
+        [VM_OP_ADD] = &&VM_OP_ADD_LABEL,
+        [VM_OP_SUB] = &&VM_OP_SUB_LABEL,
+        [VM_OP_MUL] = &&VM_OP_MUL_LABEL,
+        [VM_OP_DIV] = &&VM_OP_DIV_LABEL,
+        [VM_OP_MOD] = &&VM_OP_MOD_LABEL,
+        [VM_OP_NOT] = &&VM_OP_NOT_LABEL,
+        [VM_OP_AND] = &&VM_OP_AND_LABEL,
+        [VM_OP_OR] = &&VM_OP_OR_LABEL,
+        [VM_OP_LT] = &&VM_OP_LT_LABEL,
+        [VM_OP_LEQ] = &&VM_OP_LEQ_LABEL,
+        [VM_OP_GT] = &&VM_OP_GT_LABEL,
+        [VM_OP_GEQ] = &&VM_OP_GEQ_LABEL,
+        [VM_OP_EQ] = &&VM_OP_EQ_LABEL,
+        [VM_OP_NEQ] = &&VM_OP_NEQ_LABEL,
+        [VM_OP_NEGATE] = &&VM_OP_NEGATE_LABEL,
+        [VM_OP_ADD_CONST] = &&VM_OP_ADD_CONST_LABEL,
+        [VM_OP_SUB_CONST] = &&VM_OP_SUB_CONST_LABEL,
+        [VM_OP_ADD_LOCALS] = &&VM_OP_ADD_LOCALS_LABEL,
+        [VM_OP_SUB_LOCALS] = &&VM_OP_SUB_LOCALS_LABEL,
+        [VM_OP_JUMP_IF_NOT_LT] = &&VM_OP_JUMP_IF_NOT_LT_LABEL,
+        [VM_OP_JUMP_IF_NOT_LEQ] = &&VM_OP_JUMP_IF_NOT_LEQ_LABEL,
+        [VM_OP_JUMP_IF_NOT_GT] = &&VM_OP_JUMP_IF_NOT_GT_LABEL,
+        [VM_OP_JUMP_IF_NOT_GEQ] = &&VM_OP_JUMP_IF_NOT_GEQ_LABEL,
+        [VM_OP_JUMP_IF_NOT_EQ] = &&VM_OP_JUMP_IF_NOT_EQ_LABEL,
+        [VM_OP_JUMP_IF_NOT_NEQ] = &&VM_OP_JUMP_IF_NOT_NEQ_LABEL,
+        [VM_OP_ADD_INT] = &&VM_OP_ADD_INT_LABEL,
+        [VM_OP_SUB_INT] = &&VM_OP_SUB_INT_LABEL,
+        [VM_OP_MUL_INT] = &&VM_OP_MUL_INT_LABEL,
+        [VM_OP_DIV_INT] = &&VM_OP_DIV_INT_LABEL,
+        [VM_OP_LT_INT] = &&VM_OP_LT_INT_LABEL,
+        [VM_OP_LEQ_INT] = &&VM_OP_LEQ_INT_LABEL,
+        [VM_OP_GT_INT] = &&VM_OP_GT_INT_LABEL,
+        [VM_OP_GEQ_INT] = &&VM_OP_GEQ_INT_LABEL,
+        [VM_OP_ADD_FLOAT] = &&VM_OP_ADD_FLOAT_LABEL,
+        [VM_OP_SUB_FLOAT] = &&VM_OP_SUB_FLOAT_LABEL,
+        [VM_OP_MUL_FLOAT] = &&VM_OP_MUL_FLOAT_LABEL,
+        [VM_OP_DIV_FLOAT] = &&VM_OP_DIV_FLOAT_LABEL,
+        [VM_OP_LT_FLOAT] = &&VM_OP_LT_FLOAT_LABEL,
+        [VM_OP_LEQ_FLOAT] = &&VM_OP_LEQ_FLOAT_LABEL,
+        [VM_OP_GT_FLOAT] = &&VM_OP_GT_FLOAT_LABEL,
+        [VM_OP_GEQ_FLOAT] = &&VM_OP_GEQ_FLOAT_LABEL,
+    };
+#define TARGET(op) op##_LABEL
+#define DISPATCH() goto *dispatch_table[READ()]
+
+    DISPATCH();
+#else
+#define TARGET(op) case op
+#define DISPATCH() continue
+
+    while (true) {
+        switch ((OpCode)READ()) {
+#endif
+    TARGET(VM_OP_LOAD_CONST) : {
+        PUSH(constants[READ()]);
+        DISPATCH();
+    }
+    TARGET(VM_OP_POP) : {
+        sp--;
+        DISPATCH();
+    }
+    TARGET(VM_OP_PRINT) : {
+        Value_write(PEEK(0), stdout);
+        putchar('\n');
+        PEEK(0) = Value_unit();
+        DISPATCH();
+    }
+    TARGET(VM_OP_LOAD_LOCAL) : {
+        PUSH(slots[READ()]);
+        DISPATCH();
+    }
+    TARGET(VM_OP_SLIDE) : {
+        uint16_t count = READ();
+        sp[-1 - count] = PEEK(0);
+        sp -= count;
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP) : {
+        uint16_t offset = READ();
+        ip += offset;
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_FALSE) : {
+        uint16_t offset = READ();
+        Value condition = POP();
+        EXPECT(Value_is_bool, "bool", condition);
+        if (!Value_as_bool(condition))
+            ip += offset;
+        DISPATCH();
+    }
+    TARGET(VM_OP_RETURN) : {
+        Value result = POP();
+        if (frame == self->frames)
+            return (RunResult){.tag = RESULT_OK, .value = {.ok = result}};
+
+        // Replace the closure and its arguments with the result
+        sp = slots;
+        PUSH(result);
+        frame--;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(VM_OP_LOAD_UPVALUE) : {
+        PUSH(frame->closure->upvalues[READ()]);
+        DISPATCH();
+    }
+    TARGET(VM_OP_CLOSURE) : {
+        ObjFunction *function = Value_as_function(constants[READ()]);
+        MAYBE_COLLECT();
+        ObjClosure *closure = ObjClosure_new(self->heap, function);
+        for (size_t i = 0; i < function->captures.length; i++) {
+            Capture capture = function->captures.buffer[i];
+            closure->upvalues[i] = capture.kind == CAPTURE_LOCAL
+                                       ? slots[capture.index]
+                                       : frame->closure->upvalues[capture.index];
+        }
+        PUSH(Value_obj(&closure->obj));
+        DISPATCH();
+    }
+    TARGET(VM_OP_CALL) : {
+        size_t count = READ();
+        Value *callee_slots = sp - 1 - count;
+        uint16_t arity;
+        PREPARE_CALL(callee_slots, count, arity);
+        if (count < arity) {
+            PARTIAL_APPLY(callee_slots, count);
+            DISPATCH();
+        } else if (!Value_is_closure(*callee_slots)) {
+            CALL_NATIVE(callee_slots);
+            DISPATCH();
+        }
+
+        ObjClosure *closure = Value_as_closure(*callee_slots);
+        Chunk *callee_chunk = &closure->function->chunk;
+        if (frame == &self->frames[VM_FRAMES_MAX - 1] ||
+            callee_chunk->max_stack >
+                (size_t)(stack + VM_STACK_MAX - callee_slots)) {
+            error = (RuntimeError){.tag = RUNTIME_ERROR_STACK_OVERFLOW};
+            goto FAILURE;
+        }
+
+        frame->ip = ip;
+        *++frame = (CallFrame){
+            .closure = closure,
+            .chunk = callee_chunk,
+            .ip = callee_chunk->code.buffer,
+            .slots = callee_slots,
+        };
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(VM_OP_TAIL_CALL) : {
+        size_t count = READ();
+        Value *callee_slots = sp - 1 - count;
+        uint16_t arity;
+        PREPARE_CALL(callee_slots, count, arity);
+        if (count < arity) {
+            PARTIAL_APPLY(callee_slots, count);
+            DISPATCH();
+        } else if (!Value_is_closure(*callee_slots)) {
+            // There's no frame to replace, the RETURN after this returns the
+            // result
+            CALL_NATIVE(callee_slots);
+            DISPATCH();
+        }
+
+        ObjClosure *closure = Value_as_closure(*callee_slots);
+        Chunk *callee_chunk = &closure->function->chunk;
+        if (callee_chunk->max_stack > (size_t)(stack + VM_STACK_MAX - slots)) {
+            error = (RuntimeError){.tag = RUNTIME_ERROR_STACK_OVERFLOW};
+            goto FAILURE;
+        }
+
+        // Move the closure and its arguments down to the start of the frame,
+        // on top of whatever the current function was using it for
+        memmove(slots, callee_slots, sizeof(Value) * (1 + count));
+        sp = slots + 1 + count;
+        frame->closure = closure;
+        frame->chunk = callee_chunk;
+        frame->ip = callee_chunk->code.buffer;
+        LOAD_FRAME();
+        DISPATCH();
+    }
+    TARGET(VM_OP_LOOP) : {
+        size_t count = READ();
+        memmove(slots + 1, sp - count, sizeof(Value) * count);
+        sp = slots + 1 + count;
+        ip = frame->chunk->code.buffer;
+        DISPATCH();
+    }
+    TARGET(VM_OP_LIST) : {
+        uint16_t count = READ();
+        MAYBE_COLLECT();
+        ObjList *list = ObjList_of(self->heap, sp - count, count);
+        sp -= count;
+        PUSH(Value_obj(&list->obj));
+        DISPATCH();
+    }
+    TARGET(VM_OP_APPEND) : {
+        EXPECT(Value_is_list, "list", PEEK(1));
+        MAYBE_COLLECT();
+        ObjList *list =
+            ObjList_push(self->heap, Value_as_list(PEEK(1)), PEEK(0));
+        sp--;
+        PEEK(0) = Value_obj(&list->obj);
+        DISPATCH();
+    }
+    TARGET(VM_OP_CONCAT) : {
+        MAYBE_COLLECT();
+        Value result;
+        if (Value_is_string(PEEK(1))) {
+            EXPECT(Value_is_string, "string", PEEK(0));
+            result = Value_concat_strings(self->heap, PEEK(1), PEEK(0));
+        } else {
+            EXPECT(Value_is_list, "list or string", PEEK(1));
+            EXPECT(Value_is_list, "list", PEEK(0));
+            ObjList *list = ObjList_concat(self->heap, Value_as_list(PEEK(1)),
+                                           Value_as_list(PEEK(0)));
+            result = Value_obj(&list->obj);
+        }
+        sp--;
+        PEEK(0) = result;
+        DISPATCH();
+    }
+    TARGET(VM_OP_ADD) : {
+        STACK_OP(ARITHMETIC_OP, wrapping_add, OP_ADD);
+        DISPATCH();
+    }
+    TARGET(VM_OP_SUB) : {
+        STACK_OP(ARITHMETIC_OP, wrapping_sub, OP_SUB);
+        DISPATCH();
+    }
+    TARGET(VM_OP_MUL) : {
+        STACK_OP(ARITHMETIC_OP, wrapping_mul, OP_MUL);
+        DISPATCH();
+    }
+    TARGET(VM_OP_DIV) : {
+        STACK_OP(DIVISION_OP, wrapping_div, OP_DIV);
+        DISPATCH();
+    }
+    TARGET(VM_OP_MOD) : {
+        STACK_OP(DIVISION_OP, wrapping_mod, fmod);
+        DISPATCH();
+    }
+    TARGET(VM_OP_NOT) : {
+        NOT_OP(PEEK(0), PEEK(0));
+        DISPATCH();
+    }
+    TARGET(VM_OP_AND) : {
+        STACK_OP(BOOL_OP, OP_AND);
+        DISPATCH();
+    }
+    TARGET(VM_OP_OR) : {
+        STACK_OP(BOOL_OP, OP_OR);
+        DISPATCH();
+    }
+    TARGET(VM_OP_LT) : {
+        STACK_OP(COMPARISON_OP, OP_LT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_LEQ) : {
+        STACK_OP(COMPARISON_OP, OP_LEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_GT) : {
+        STACK_OP(COMPARISON_OP, OP_GT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_GEQ) : {
+        STACK_OP(COMPARISON_OP, OP_GEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_EQ) : {
+        Value rhs = POP();
+        EQ_OP(PEEK(0), PEEK(0), rhs);
+        DISPATCH();
+    }
+    TARGET(VM_OP_NEQ) : {
+        Value rhs = POP();
+        NEQ_OP(PEEK(0), PEEK(0), rhs);
+        DISPATCH();
+    }
+    TARGET(VM_OP_NEGATE) : {
+        NEGATE_OP(PEEK(0), PEEK(0));
+        DISPATCH();
+    }
+    TARGET(VM_OP_ADD_CONST) : {
+        CONST_OP(ARITHMETIC_OP, wrapping_add, OP_ADD);
+        DISPATCH();
+    }
+    TARGET(VM_OP_SUB_CONST) : {
+        CONST_OP(ARITHMETIC_OP, wrapping_sub, OP_SUB);
+        DISPATCH();
+    }
+    TARGET(VM_OP_ADD_LOCALS) : {
+        LOCALS_OP(ARITHMETIC_OP, wrapping_add, OP_ADD);
+        DISPATCH();
+    }
+    TARGET(VM_OP_SUB_LOCALS) : {
+        LOCALS_OP(ARITHMETIC_OP, wrapping_sub, OP_SUB);
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_NOT_LT) : {
+        JUMP_IF_NOT_OP(COMPARISON_OP, OP_LT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_NOT_LEQ) : {
+        JUMP_IF_NOT_OP(COMPARISON_OP, OP_LEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_NOT_GT) : {
+        JUMP_IF_NOT_OP(COMPARISON_OP, OP_GT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_NOT_GEQ) : {
+        JUMP_IF_NOT_OP(COMPARISON_OP, OP_GEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_NOT_EQ) : {
+        uint16_t offset = READ();
+        Value rhs = POP();
+        if (!Value_eq(POP(), rhs))
+            ip += offset;
+        DISPATCH();
+    }
+    TARGET(VM_OP_JUMP_IF_NOT_NEQ) : {
+        uint16_t offset = READ();
+        Value rhs = POP();
+        if (Value_eq(POP(), rhs))
+            ip += offset;
+        DISPATCH();
+    }
+    TARGET(VM_OP_ADD_INT) : {
+        INT_OP(Value_int, wrapping_add);
+        DISPATCH();
+    }
+    TARGET(VM_OP_SUB_INT) : {
+        INT_OP(Value_int, wrapping_sub);
+        DISPATCH();
+    }
+    TARGET(VM_OP_MUL_INT) : {
+        INT_OP(Value_int, wrapping_mul);
+        DISPATCH();
+    }
+    TARGET(VM_OP_DIV_INT) : {
+        if (Value_as_int(PEEK(0)) == 0) {
+            error = (RuntimeError){.tag = RUNTIME_ERROR_DIVISION_BY_ZERO};
+            goto FAILURE;
+        }
+        INT_OP(Value_int, wrapping_div);
+        DISPATCH();
+    }
+    TARGET(VM_OP_LT_INT) : {
+        INT_OP(Value_bool, OP_LT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_LEQ_INT) : {
+        INT_OP(Value_bool, OP_LEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_GT_INT) : {
+        INT_OP(Value_bool, OP_GT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_GEQ_INT) : {
+        INT_OP(Value_bool, OP_GEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_ADD_FLOAT) : {
+        FLOAT_OP(Value_float, OP_ADD);
+        DISPATCH();
+    }
+    TARGET(VM_OP_SUB_FLOAT) : {
+        FLOAT_OP(Value_float, OP_SUB);
+        DISPATCH();
+    }
+    TARGET(VM_OP_MUL_FLOAT) : {
+        FLOAT_OP(Value_float, OP_MUL);
+        DISPATCH();
+    }
+    TARGET(VM_OP_DIV_FLOAT) : {
+        FLOAT_OP(Value_float, OP_DIV);
+        DISPATCH();
+    }
+    TARGET(VM_OP_LT_FLOAT) : {
+        FLOAT_OP(Value_bool, OP_LT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_LEQ_FLOAT) : {
+        FLOAT_OP(Value_bool, OP_LEQ);
+        DISPATCH();
+    }
+    TARGET(VM_OP_GT_FLOAT) : {
+        FLOAT_OP(Value_bool, OP_GT);
+        DISPATCH();
+    }
+    TARGET(VM_OP_GEQ_FLOAT) : {
+        FLOAT_OP(Value_bool, OP_GEQ);
+        DISPATCH();
+    }
+#ifndef VM_THREADED_DISPATCH
+        }
+        // The compiler never emits anything outside of 'OpCode'
+        UNREACHABLE;
+    }
+#endif
+
+#undef LOAD_FRAME
+#undef READ
+#undef PUSH
+#undef POP
+#undef PEEK
+#undef STACK_OP
+#undef CONST_OP
+#undef LOCALS_OP
+#undef JUMP_IF_NOT_OP
+#undef INT_OP
+#undef FLOAT_OP
+#undef PREPARE_CALL
+#undef MAYBE_COLLECT
+#undef PARTIAL_APPLY
+#undef CALL_NATIVE
+#undef TARGET
+#undef DISPATCH
+
+FAILURE:
+    return (RunResult){.tag = RESULT_ERR, .value = {.err = error}};
+}
 
-DEF_VEC(Value, Values)
+#ifdef VM_THREADED_DISPATCH
+#pragma GCC diagnostic pop
+#endif
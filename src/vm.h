@@ -2,46 +2,79 @@
 #define CLAM_VM_H
 
 #include <stdint.h>
+#include <stdio.h>
 
-#include "vec.h"
-
-typedef enum OpCode : uint16_t {
-    VM_OP_LOAD_CONST = 1,
-    VM_OP_POP = 2,
-    VM_OP_PRINT = 3,
-
-    /* BINARY OPERATIONS (values match up with AST_BinOp) */
-
-    VM_OP_ADD = 26,
-    VM_OP_SUB = 27,
-    VM_OP_MUL = 28,
-    VM_OP_DIV = 29,
-    VM_OP_MOD = 30,
-
-    VM_OP_AND = 32,
-    VM_OP_OR = 33,
-
-    VM_OP_LT = 34,
-    VM_OP_LEQ = 35,
-    VM_OP_GT = 36,
-    VM_OP_GEQ = 37,
-    VM_OP_EQ = 38,
-    VM_OP_NEQ = 39,
-} OpCode;
-
-typedef enum ValueType : uint8_t {
-    VALUE_TYPE_BOOL = 0,
-    VALUE_TYPE_INT = 1
-} ValueType;
-
-typedef struct Value {
-    ValueType tag;
-    union ValueUnion {
-        bool boolean;
-        int32_t integer;
-    } value;
-} Value;
-
-DECL_VEC_HEADER(Value, Values)
+#include "chunk.h"
+#include "object.h"
+#include "result.h"
+#include "value.h"
+
+// Use direct threading (computed gotos) for instruction dispatch wherever the
+// compiler supports it, unless the build explicitly asks for the portable
+// `switch`-based loop (see the 'dispatch' meson option)
+#if defined(__GNUC__) && !defined(CLAM_SWITCH_DISPATCH)
+#define VM_THREADED_DISPATCH
+#define VM_DISPATCH_MODE "threaded"
+#else
+#define VM_DISPATCH_MODE "switch"
+#endif
+
+constexpr size_t VM_STACK_MAX = 1 << 16;
+// Every call needs at least two stack slots (for the function and its
+// argument), so the stack would overflow before this many calls anyway
+constexpr size_t VM_FRAMES_MAX = VM_STACK_MAX / 2;
+
+// The state of a function call (or of the top-level code)
+typedef struct CallFrame {
+    // NULL for the top-level code
+    ObjClosure *closure;
+    Chunk *chunk;
+    // Where to continue from once the call that this frame made returns
+    const uint16_t *ip;
+    // The first of the frame's stack slots, which holds the closure itself
+    Value *slots;
+} CallFrame;
+
+// Stores VM state
+typedef struct VM {
+    Value *stack;
+    CallFrame *frames;
+    // Where objects created at runtime are allocated
+    Heap *heap;
+} VM;
+
+VM VM_new(Heap *heap);
+
+void VM_free(VM *self);
+
+typedef struct RuntimeError_Type {
+    // 'expected.length' should exclude the null terminator (which should be
+    // present)
+    String expected;
+    ValueType got;
+} RuntimeError_Type;
+
+typedef struct RuntimeError {
+    enum RuntimeErrorTag {
+        RUNTIME_ERROR_TYPE,
+        RUNTIME_ERROR_DIVISION_BY_ZERO,
+        RUNTIME_ERROR_STACK_OVERFLOW,
+    } tag;
+    union RuntimeErrorUnion {
+        RuntimeError_Type type;
+    } error;
+} RuntimeError;
+
+void RuntimeError_print(RuntimeError error, FILE *stream);
+
+DEF_RESULT(Value, RuntimeError, Run);
+
+// Execute 'chunk' from the start until it returns, producing the returned
+// value
+RunResult VM_run(VM *self, Chunk *chunk);
+
+// Execute a chunk of register bytecode (see 'compile_registers') from the
+// start until it returns, producing the returned value
+RunResult VM_run_registers(VM *self, Chunk *chunk);
 
 #endif
@@ -0,0 +1,134 @@
+#ifndef CLAM_VM_OPS_H
+#define CLAM_VM_OPS_H
+
+// The semantics of the primitive operations, shared between the stack and
+// register interpreter loops. The macros expect a `RuntimeError error` local and
+// a `FAILURE` label to be in scope.
+
+#include <math.h>
+#include <stdint.h>
+
+#include "value.h"
+
+// Integer arithmetic wraps around on overflow, so do it on unsigned integers
+// to avoid undefined behaviour
+static inline int32_t wrapping_add(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a + (uint32_t)b);
+}
+
+static inline int32_t wrapping_sub(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a - (uint32_t)b);
+}
+
+static inline int32_t wrapping_mul(int32_t a, int32_t b) {
+    return (int32_t)((uint32_t)a * (uint32_t)b);
+}
+
+// Pre-condition: `b != 0`
+static inline int32_t wrapping_div(int32_t a, int32_t b) {
+    return b == -1 ? wrapping_sub(0, a) : a / b;
+}
+
+// Pre-condition: `b != 0`
+static inline int32_t wrapping_mod(int32_t a, int32_t b) {
+    return b == -1 ? 0 : a % b;
+}
+
+#define OP_ADD(a, b) ((a) + (b))
+#define OP_SUB(a, b) ((a) - (b))
+#define OP_MUL(a, b) ((a) * (b))
+#define OP_DIV(a, b) ((a) / (b))
+#define OP_LT(a, b) ((a) < (b))
+#define OP_LEQ(a, b) ((a) <= (b))
+#define OP_GT(a, b) ((a) > (b))
+#define OP_GEQ(a, b) ((a) >= (b))
+#define OP_AND(a, b) ((a) && (b))
+#define OP_OR(a, b) ((a) || (b))
+
+#define TYPE_ERROR(expected_type, value)                                       \
+    do {                                                                       \
+        error = (RuntimeError){                                                \
+            .tag = RUNTIME_ERROR_TYPE,                                         \
+            .error = {.type = {.expected = STR(expected_type),                 \
+                               .got = Value_type(value)}},                     \
+        };                                                                     \
+        goto FAILURE;                                                          \
+    } while (0)
+
+#define EXPECT(is_type, expected_type, value)                                  \
+    do {                                                                       \
+        if (!is_type(value))                                                   \
+            TYPE_ERROR(expected_type, value);                                  \
+    } while (0)
+
+// Stores the result of applying the operation to 'lhs' and 'rhs' in 'result'.
+// Ints take the fast path, and any other combination of numbers is promoted to
+// floats.
+#define NUMERIC_OP(result, lhs, rhs, make_int, int_operation, make_float,      \
+                   float_operation)                                            \
+    do {                                                                       \
+        Value lhs_value = (lhs);                                               \
+        Value rhs_value = (rhs);                                               \
+        if (Value_is_int(lhs_value) && Value_is_int(rhs_value)) {              \
+            (result) = make_int(                                               \
+                int_operation(Value_as_int(lhs_value), Value_as_int(rhs_value))); \
+        } else {                                                               \
+            EXPECT(Value_is_number, "number", lhs_value);                      \
+            EXPECT(Value_is_number, "number", rhs_value);                      \
+            (result) = make_float(float_operation(Value_as_number(lhs_value),  \
+                                                  Value_as_number(rhs_value))); \
+        }                                                                      \
+    } while (0)
+
+#define ARITHMETIC_OP(result, lhs, rhs, int_operation, float_operation)        \
+    NUMERIC_OP(result, lhs, rhs, Value_int, int_operation, Value_float,        \
+               float_operation)
+
+#define COMPARISON_OP(result, lhs, rhs, operation)                             \
+    NUMERIC_OP(result, lhs, rhs, Value_bool, operation, Value_bool, operation)
+
+// Only integer division can fail, floats follow IEEE 754
+#define DIVISION_OP(result, lhs, rhs, int_operation, float_operation)          \
+    do {                                                                       \
+        Value divisor = (rhs);                                                 \
+        if (Value_is_int(divisor) && Value_as_int(divisor) == 0 &&             \
+            Value_is_int(lhs)) {                                               \
+            error = (RuntimeError){.tag = RUNTIME_ERROR_DIVISION_BY_ZERO};     \
+            goto FAILURE;                                                      \
+        }                                                                      \
+        ARITHMETIC_OP(result, lhs, divisor, int_operation, float_operation);   \
+    } while (0)
+
+#define BOOL_OP(result, lhs, rhs, operation)                                   \
+    do {                                                                       \
+        Value lhs_value = (lhs);                                               \
+        Value rhs_value = (rhs);                                               \
+        EXPECT(Value_is_bool, "bool", lhs_value);                              \
+        EXPECT(Value_is_bool, "bool", rhs_value);                              \
+        (result) = Value_bool(                                                 \
+            operation(Value_as_bool(lhs_value), Value_as_bool(rhs_value)));    \
+    } while (0)
+
+#define EQ_OP(result, lhs, rhs) (result) = Value_bool(Value_eq(lhs, rhs))
+
+#define NEQ_OP(result, lhs, rhs) (result) = Value_bool(!Value_eq(lhs, rhs))
+
+#define NOT_OP(result, operand)                                                \
+    do {                                                                       \
+        Value operand_value = (operand);                                       \
+        EXPECT(Value_is_bool, "bool", operand_value);                          \
+        (result) = Value_bool(!Value_as_bool(operand_value));                 \
+    } while (0)
+
+#define NEGATE_OP(result, operand)                                             \
+    do {                                                                       \
+        Value operand_value = (operand);                                       \
+        if (Value_is_int(operand_value)) {                                     \
+            (result) = Value_int(wrapping_sub(0, Value_as_int(operand_value))); \
+        } else {                                                               \
+            EXPECT(Value_is_float, "number", operand_value);                   \
+            (result) = Value_float(-Value_as_float(operand_value));            \
+        }                                                                      \
+    } while (0)
+
+#endif
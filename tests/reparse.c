@@ -0,0 +1,304 @@
+// Applies a sequence of edits to a generated program with an incremental
+// parser, and checks after each one that the tokens, the printed AST and the
+// offsets and spans of every node are the same as a parse from scratch of the
+// edited source gives. The nodes after an edit are reused, so their offsets
+// come from the shift log and the tokens after the gap.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "src/parser.h"
+#include "src/symbol.h"
+
+// Enough bindings for the `let` to get a tree of runs two levels deep
+constexpr size_t BINDINGS = 600;
+// Enough edits back and forth to go past the cap on shifts, which has the
+// parser start from scratch
+constexpr size_t TOGGLES = 1100;
+
+// An edit which replaces the text from the first 'at' in the source up to the
+// first 'until' after it (or nothing if it's NULL) with 'inserted'
+typedef struct Step {
+    const char *at;
+    const char *until;
+    const char *inserted;
+} Step;
+
+static const Step STEPS[] = {
+    // A binding in the middle of the `let`
+    {" x20 =", NULL, " y = 7,"},
+    // A longer number inside a binding
+    {"* 3 + 20)", "+ 20)", "* 33 "},
+    // Taking a binding out
+    {" x30 =", " x31 =", ""},
+    // Before everything, which moves every node
+    {"let x0", NULL, "# head\n"},
+    // A list which isn't closed, and then is
+    {"\nin print", NULL, ",\n    z = {1, 2"},
+    {"2\nin print", "\nin print", "2}  "},
+    // More of the last binding's value, starting at the `in` that ended it
+    {"in print", NULL, "+ 1 "},
+    // A different string
+    {"\"s\\n\"} 12,", "} 12,", "\"t\\tu\""},
+    // A grouping with one parenthesis, then none
+    {"(x5 * 3", "x5 * 3", ""},
+    {"+ 6) else", " else", "+ 6"},
+    // After everything
+    {"# done", NULL, "1 + "},
+    // A binding which is a `let` itself
+    {" x400 =", "if x399", " x400 = let a = 1, b = {a} in "},
+    // An identifier that becomes a keyword
+    {"f {x77,", "{x77,", "in "},
+    {"in {x77,", "{x77,", "f "},
+};
+
+// Generates a `let` with a binding on each line, each of which has a
+// grouping, an application, a list and a string in it
+static StringBuf generate_program(void) {
+    StringBuf source = StringBuf_new();
+    char line[160];
+    StringBuf_push_string(&source, STR("let x0 = 1"));
+    for (size_t i = 1; i < BINDINGS; i++) {
+        int length = snprintf(line, sizeof(line),
+                              ",\n    x%zu = if x%zu < 100 then (x%zu * 3 + "
+                              "%zu) else f {x%zu, \"s\\n\"} %zu",
+                              i, i - 1, i - 1, i, i - 1, i);
+        StringBuf_push_string(&source,
+                              (String){.buffer = line, .length = length});
+    }
+    int length =
+        snprintf(line, sizeof(line),
+                 "\nin print (fun a => a + 1) x%zu # done\n", BINDINGS - 1);
+    StringBuf_push_string(&source, (String){.buffer = line, .length = length});
+    StringBuf_push(&source, '\0');
+    return source;
+}
+
+// The trailing NUL is the lexer's sentinel rather than part of the source
+static String without_sentinel(StringBuf source) {
+    return (String){.buffer = source.buffer, .length = source.length - 1};
+}
+
+static size_t find(String source, size_t from, const char *needle) {
+    size_t length = strlen(needle);
+    for (size_t i = from; i + length <= source.length; i++) {
+        if (memcmp(source.buffer + i, needle, length) == 0)
+            return i;
+    }
+    fprintf(stderr, "'%s' isn't in the source\n", needle);
+    exit(1);
+}
+
+// Applies 'step' to 'source', returning the edited source with a sentinel and
+// the edit
+static StringBuf apply(String source, Step step, /* out */ TextEdit *edit) {
+    size_t start = find(source, 0, step.at);
+    size_t old_end =
+        step.until == NULL ? start : find(source, start, step.until);
+    size_t inserted = strlen(step.inserted);
+    StringBuf edited = StringBuf_new();
+    StringBuf_extend(&edited, source.buffer, start);
+    StringBuf_extend(&edited, step.inserted, inserted);
+    StringBuf_extend(&edited, source.buffer + old_end,
+                     source.length - old_end);
+    StringBuf_push(&edited, '\0');
+    *edit = (TextEdit){
+        .start = start, .old_end = old_end, .new_end = start + inserted};
+    return edited;
+}
+
+static bool check_node(const AST *reparsed, ASTIndex a, const AST *fresh,
+                       ASTIndex b);
+
+// Checks that the bindings of two `let`s start at the same offsets and that
+// their values are the same
+static bool check_bindings(const AST *reparsed, ASTIndex a, const AST *fresh,
+                           ASTIndex b) {
+    AST_BindingIter a_bindings = AST_bindings(reparsed, a);
+    AST_BindingIter b_bindings = AST_bindings(fresh, b);
+    AST_LetBind a_binding, b_binding;
+    while (AST_next_binding(&a_bindings, &a_binding)) {
+        if (!AST_next_binding(&b_bindings, &b_binding) ||
+            a_binding.ident != b_binding.ident ||
+            a_binding.start != b_binding.start ||
+            !check_node(reparsed, a_binding.value, fresh, b_binding.value))
+            return false;
+    }
+    return !AST_next_binding(&b_bindings, &b_binding);
+}
+
+// Checks that two nodes and all of their children have the same tags, starts
+// and spans
+static bool check_node(const AST *reparsed, ASTIndex a, const AST *fresh,
+                       ASTIndex b) {
+    Span a_span = AST_span(reparsed, a);
+    Span b_span = AST_span(fresh, b);
+    if (reparsed->tags[a] != fresh->tags[b] ||
+        AST_start(reparsed, a) != AST_start(fresh, b) ||
+        a_span.start != b_span.start || a_span.end != b_span.end) {
+        fprintf(stderr, "A node at %zu..%zu should be at %zu..%zu\n",
+                a_span.start, a_span.end, b_span.start, b_span.end);
+        return false;
+    }
+
+    ASTData a_data = reparsed->data[a];
+    ASTData b_data = fresh->data[b];
+    switch (AST_tag(fresh, b)) {
+    case AST_LITERAL:
+    case AST_IDENT:
+        return true;
+    case AST_LIST: {
+        AST_Items a_items = AST_list(reparsed, a);
+        AST_Items b_items = AST_list(fresh, b);
+        if (a_items.length != b_items.length)
+            return false;
+        for (size_t i = 0; i < a_items.length; i++) {
+            if (!check_node(reparsed, a_items.buffer[i], fresh,
+                            b_items.buffer[i]))
+                return false;
+        }
+        return true;
+    }
+    case AST_LET_IN:
+        return check_bindings(reparsed, a, fresh, b) &&
+               check_node(reparsed, a_data.let_in.body, fresh,
+                          b_data.let_in.body);
+    case AST_ABSTRACTION:
+        return check_node(reparsed, a_data.abstraction.body, fresh,
+                          b_data.abstraction.body);
+    case AST_APPLICATION:
+        return check_node(reparsed, a_data.application.function, fresh,
+                          b_data.application.function) &&
+               check_node(reparsed, a_data.application.argument, fresh,
+                          b_data.application.argument);
+    case AST_PRINT:
+        return check_node(reparsed, a_data.print.expr, fresh,
+                          b_data.print.expr);
+    case AST_IF_ELSE:
+        return check_node(reparsed, a_data.if_else.condition, fresh,
+                          b_data.if_else.condition) &&
+               check_node(reparsed, AST_branches(reparsed, a)[0], fresh,
+                          AST_branches(fresh, b)[0]) &&
+               check_node(reparsed, AST_branches(reparsed, a)[1], fresh,
+                          AST_branches(fresh, b)[1]);
+    case AST_UNARY_OP:
+        return check_node(reparsed, a_data.unary_op.operand, fresh,
+                          b_data.unary_op.operand);
+    case AST_BINARY_OP:
+        return check_node(reparsed, a_data.binary_op.lhs, fresh,
+                          b_data.binary_op.lhs) &&
+               check_node(reparsed, a_data.binary_op.rhs, fresh,
+                          b_data.binary_op.rhs);
+    }
+    return false;
+}
+
+static bool same_errors(SyntaxError a, SyntaxError b) {
+    if (a.tag != b.tag)
+        return false;
+    Span a_span = a.tag == ERROR_INVALID_ESC_SEQ
+                      ? a.error.invalid_esc_seq.escape_sequence
+                      : a.error.unexpected_token.span;
+    Span b_span = b.tag == ERROR_INVALID_ESC_SEQ
+                      ? b.error.invalid_esc_seq.escape_sequence
+                      : b.error.unexpected_token.span;
+    return a_span.start == b_span.start && a_span.end == b_span.end;
+}
+
+// Checks the result of reparsing 'source' against parsing it from scratch
+static bool check(Parser *parser, ParseResult result, String source) {
+    Parser fresh = Parser_new(STR("fresh"), source);
+    ParseResult fresh_result = Parser_parse_expr(&fresh);
+    bool same = true;
+
+    if (parser->tokens.length != fresh.tokens.length) {
+        fputs("The tokens differ in number\n", stderr);
+        same = false;
+    }
+    for (size_t i = 0; same && i < fresh.tokens.length; i++) {
+        Token a = TokenGap_get(&parser->tokens, i);
+        Token b = TokenGap_get(&fresh.tokens, i);
+        if (a.kind != b.kind || a.start != b.start) {
+            fprintf(stderr, "Token %zu is at %u but should be at %u\n", i,
+                    a.start, b.start);
+            same = false;
+        }
+    }
+
+    if (!same) {
+    } else if (result.tag != fresh_result.tag) {
+        fputs("Only one of the parses failed\n", stderr);
+        same = false;
+    } else if (result.tag == RESULT_ERR) {
+        same = same_errors(result.value.err, fresh_result.value.err);
+        if (!same)
+            fputs("The parses failed differently\n", stderr);
+    } else {
+        StringBuf a = format_ast(&parser->ast, result.value.ok);
+        StringBuf b = format_ast(&fresh.ast, fresh_result.value.ok);
+        if (a.length != b.length || memcmp(a.buffer, b.buffer, a.length) != 0) {
+            fputs("The reparsed AST differs from the one parsed from scratch\n",
+                  stderr);
+            same = false;
+        }
+        StringBuf_free(&a);
+        StringBuf_free(&b);
+        same = same && check_node(&parser->ast, result.value.ok, &fresh.ast,
+                                  fresh_result.value.ok);
+    }
+    Parser_free(&fresh);
+    return same;
+}
+
+int main(void) {
+    StringBuf source = generate_program();
+    Parser parser =
+        Parser_new_incremental(STR("reparse"), without_sentinel(source));
+    ParseResult result = Parser_parse_expr(&parser);
+    if (!check(&parser, result, parser.source))
+        return 1;
+
+    size_t steps = sizeof(STEPS) / sizeof(STEPS[0]);
+    for (size_t i = 0; i < steps; i++) {
+        TextEdit edit;
+        StringBuf edited = apply(without_sentinel(source), STEPS[i], &edit);
+        String text = without_sentinel(edited);
+        result = Parser_reparse(&parser, text, edit);
+        if (!check(&parser, result, text)) {
+            fprintf(stderr, "after step %zu, at '%s'\n", i + 1, STEPS[i].at);
+            return 1;
+        }
+        StringBuf_free(&source);
+        source = edited;
+    }
+
+    // Edits near the start and the end in turn, which move the gaps all the
+    // way across and each add a shift. Parsing from scratch after each one
+    // would take most of the test's time, so only some are checked.
+    static const Step TOGGLES_STEPS[] = {
+        {"x1 = ", "if x0", "x1 = 2 + "},
+        {"x1 = 2 + ", "if x0", "x1 = "},
+        {"x598 = ", "if x597", "x598 = -"},
+        {"x598 = -", "if x597", "x598 = "},
+    };
+    for (size_t i = 0; i < TOGGLES; i++) {
+        TextEdit edit;
+        StringBuf edited =
+            apply(without_sentinel(source), TOGGLES_STEPS[i % 4], &edit);
+        String text = without_sentinel(edited);
+        result = Parser_reparse(&parser, text, edit);
+        bool checked = i % 16 == 15 || i + 4 >= TOGGLES;
+        if (checked && !check(&parser, result, text)) {
+            fprintf(stderr, "after toggle %zu\n", i + 1);
+            return 1;
+        }
+        StringBuf_free(&source);
+        source = edited;
+    }
+
+    Parser_free(&parser);
+    StringBuf_free(&source);
+    Symbol_free_all();
+    return 0;
+}